@@ -6,7 +6,10 @@
 
 #pragma once
 
+#include <android/binder_enums.h>
+
 #include <cstdint>
+#include <string_view>
 
 namespace aidl {
 namespace google {
@@ -25,9 +28,33 @@ enum class AdpfHintType : int32_t {
     ADPF_VOTE_POWER_EFFICIENCY = 5
 };
 
+// Display refresh rate modes sent through the power extension
+enum class AdpfRefreshRate : int32_t {
+    REFRESH_UNKNOWN = 0,
+    REFRESH_60FPS = 60,
+    REFRESH_90FPS = 90,
+    REFRESH_120FPS = 120,
+};
+
+constexpr AdpfRefreshRate toAdpfRefreshRate(std::string_view mode) {
+    if (mode == "REFRESH_120FPS") {
+        return AdpfRefreshRate::REFRESH_120FPS;
+    } else if (mode == "REFRESH_90FPS") {
+        return AdpfRefreshRate::REFRESH_90FPS;
+    } else if (mode == "REFRESH_60FPS") {
+        return AdpfRefreshRate::REFRESH_60FPS;
+    }
+    return AdpfRefreshRate::REFRESH_UNKNOWN;
+}
+
 constexpr int kUclampMin{0};
 constexpr int kUclampMax{1024};
 
+template <class T>
+constexpr size_t enum_size() {
+    return static_cast<size_t>(*(ndk::enum_range<T>().end() - 1)) + 1;
+}
+
 }  // namespace pixel
 }  // namespace impl
 }  // namespace power
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "ApiStats.h"
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <sys/system_properties.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+constexpr const char *kApiNames[ApiStats::kApiCount] = {
+        "Power::setMode",
+        "Power::isModeSupported",
+        "Power::setBoost",
+        "Power::isBoostSupported",
+        "Power::createHintSession",
+        "Power::getHintSessionPreferredRate",
+        "PowerExt::setMode",
+        "PowerExt::isModeSupported",
+        "PowerExt::setBoost",
+        "PowerExt::isBoostSupported",
+        "PowerHintSession::close",
+        "PowerHintSession::pause",
+        "PowerHintSession::resume",
+        "PowerHintSession::updateTargetWorkDuration",
+        "PowerHintSession::reportActualWorkDuration",
+        "PowerHintSession::sendHint",
+        "PowerHintSession::setMode",
+        "PowerHintSession::setThreads",
+};
+
+// Shard of the calling thread, threads take the shards in the order they first record
+size_t currentShard() {
+    static std::atomic<size_t> sNextShard{0};
+    thread_local const size_t shard =
+            sNextShard.fetch_add(1, std::memory_order_relaxed) % ApiStats::kShards;
+    return shard;
+}
+}  // namespace
+
+ApiStats &ApiStats::getInstance() {
+    static ApiStats *instance = new ApiStats();
+    return *instance;
+}
+
+void ApiStats::record(ApiId id, std::chrono::nanoseconds latency) {
+    mShards[currentShard()].latencyNs[static_cast<size_t>(id)].record(latency.count());
+}
+
+uint64_t ApiStats::count(ApiId id) const {
+    uint64_t total = 0;
+    for (const auto &shard : mShards) {
+        total += shard.latencyNs[static_cast<size_t>(id)].count();
+    }
+    return total;
+}
+
+void ApiStats::reset() {
+    for (auto &shard : mShards) {
+        for (auto &histogram : shard.latencyNs) {
+            histogram.reset();
+        }
+    }
+}
+
+void ApiStats::dumpToFd(int fd) const {
+    std::string out("API latency:\n");
+    for (size_t i = 0; i < kApiCount; ++i) {
+        Histogram combined;
+        for (const auto &shard : mShards) {
+            combined.add(shard.latencyNs[i]);
+        }
+        if (combined.count() == 0) {
+            continue;
+        }
+        ::android::base::StringAppendF(&out, "  %s: %s\n", kApiNames[i],
+                                       combined.toString(1000.0, "us").c_str());
+    }
+    ::android::base::WriteStringToFd(out, fd);
+}
+
+void ApiStats::startResetWatcher(const char *property) {
+    // Take the serial before returning so a change right after is seen
+    const prop_info *pi = __system_property_find(property);
+    uint32_t serial = pi != nullptr ? __system_property_serial(pi) : 0;
+    std::thread([this, name = std::string(property), pi, serial]() mutable {
+        if (pi == nullptr) {
+            // Creating the property is the first reset request
+            ::android::base::WaitForPropertyCreation(name);
+            pi = __system_property_find(name.c_str());
+            if (pi == nullptr) {
+                ALOGE("Failed to watch %s", name.c_str());
+                return;
+            }
+            serial = __system_property_serial(pi);
+            reset();
+        }
+        while (__system_property_wait(pi, serial, &serial, nullptr)) {
+            ALOGI("API stats reset by %s", name.c_str());
+            reset();
+        }
+    }).detach();
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
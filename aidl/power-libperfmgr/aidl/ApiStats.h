@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "disp-power/Histogram.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// AIDL entry points of Power, PowerExt and PowerHintSession
+enum class ApiId : uint8_t {
+    POWER_SET_MODE,
+    POWER_IS_MODE_SUPPORTED,
+    POWER_SET_BOOST,
+    POWER_IS_BOOST_SUPPORTED,
+    POWER_CREATE_HINT_SESSION,
+    POWER_GET_HINT_SESSION_PREFERRED_RATE,
+    EXT_SET_MODE,
+    EXT_IS_MODE_SUPPORTED,
+    EXT_SET_BOOST,
+    EXT_IS_BOOST_SUPPORTED,
+    SESSION_CLOSE,
+    SESSION_PAUSE,
+    SESSION_RESUME,
+    SESSION_UPDATE_TARGET_WORK_DURATION,
+    SESSION_REPORT_ACTUAL_WORK_DURATION,
+    SESSION_SEND_HINT,
+    SESSION_SET_MODE,
+    SESSION_SET_THREADS,
+    COUNT,
+};
+
+// Call count and latency distribution of every AIDL entry point. A thread
+// takes the next shard the first time it records and keeps it, so concurrent
+// calls do not bounce the same cache lines. There are enough shards for the
+// default binder pool and the main thread, more threads than that share
+// shards. Shards are only combined when reading.
+class ApiStats {
+  public:
+    static constexpr size_t kApiCount = static_cast<size_t>(ApiId::COUNT);
+    static constexpr size_t kShards = 8;
+
+    // Process wide instance, never destroyed so binder threads can record until exit
+    static ApiStats &getInstance();
+
+    void record(ApiId id, std::chrono::nanoseconds latency);
+    // Calls of id recorded since the last reset, over all shards
+    uint64_t count(ApiId id) const;
+    void reset();
+    void dumpToFd(int fd) const;
+
+    // Reset the stats every time the given property changes value, changes
+    // made after this returns are never missed
+    void startResetWatcher(const char *property);
+
+  private:
+    ApiStats() = default;
+
+    struct alignas(64) Shard {
+        std::array<Histogram, kApiCount> latencyNs;
+    };
+    std::array<Shard, kShards> mShards;
+};
+
+// Records the latency of the enclosing scope
+class ScopedApiLatency {
+  public:
+    explicit ScopedApiLatency(ApiId id) : mId(id), mStart(std::chrono::steady_clock::now()) {}
+    ~ScopedApiLatency() {
+        ApiStats::getInstance().record(mId, std::chrono::steady_clock::now() - mStart);
+    }
+    ScopedApiLatency(const ScopedApiLatency &) = delete;
+    ScopedApiLatency &operator=(const ScopedApiLatency &) = delete;
+
+  private:
+    const ApiId mId;
+    const std::chrono::steady_clock::time_point mStart;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -7,10 +7,11 @@
 #pragma once
 
 #include <aidl/android/hardware/power/SessionMode.h>
-#include <android-base/stringprintf.h>
 
 #include <string>
 
+#include "AdpfTypes.h"
+
 namespace aidl {
 namespace google {
 namespace hardware {
@@ -18,39 +19,39 @@ namespace power {
 namespace impl {
 namespace pixel {
 
-template <class T>
-constexpr size_t enum_size() {
-    return static_cast<size_t>(*(ndk::enum_range<T>().end() - 1)) + 1;
-}
-
 // The App Hint Descriptor struct manages information necessary
 // to calculate the next uclamp min value from the PID function
 // and is separate so that it can be used as a pointer for
 // easily passing to the pid function
 struct AppDescriptorTrace {
     AppDescriptorTrace(const std::string &idString) {
-        using ::android::base::StringPrintf;
-        trace_pid_err = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.err");
-        trace_pid_integral = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.integral");
-        trace_pid_derivative = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.derivative");
-        trace_pid_pOut = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.pOut");
-        trace_pid_iOut = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.iOut");
-        trace_pid_dOut = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.dOut");
-        trace_pid_output = StringPrintf("adpf.%s-%s", idString.c_str(), "pid.output");
-        trace_target = StringPrintf("adpf.%s-%s", idString.c_str(), "target");
-        trace_active = StringPrintf("adpf.%s-%s", idString.c_str(), "active");
-        trace_add_threads = StringPrintf("adpf.%s-%s", idString.c_str(), "add_threads");
-        trace_actl_last = StringPrintf("adpf.%s-%s", idString.c_str(), "act_last");
-        trace_min = StringPrintf("adpf.%s-%s", idString.c_str(), "min");
-        trace_batch_size = StringPrintf("adpf.%s-%s", idString.c_str(), "batch_size");
-        trace_hint_count = StringPrintf("adpf.%s-%s", idString.c_str(), "hint_count");
-        trace_hint_overtime = StringPrintf("adpf.%s-%s", idString.c_str(), "hint_overtime");
-        trace_is_first_frame = StringPrintf("adpf.%s-%s", idString.c_str(), "is_first_frame");
-        trace_session_hint = StringPrintf("adpf.%s-%s", idString.c_str(), "session_hint");
+        // Plain concatenation, this runs for every session creation
+        const std::string prefix = "adpf." + idString + "-";
+        trace_pid_err = prefix + "pid.err";
+        trace_pid_integral = prefix + "pid.integral";
+        trace_pid_derivative = prefix + "pid.derivative";
+        trace_pid_pOut = prefix + "pid.pOut";
+        trace_pid_iOut = prefix + "pid.iOut";
+        trace_pid_dOut = prefix + "pid.dOut";
+        trace_pid_output = prefix + "pid.output";
+        trace_target = prefix + "target";
+        trace_active = prefix + "active";
+        trace_add_threads = prefix + "add_threads";
+        trace_actl_last = prefix + "act_last";
+        trace_min = prefix + "min";
+        trace_batch_size = prefix + "batch_size";
+        trace_hint_count = prefix + "hint_count";
+        trace_hint_overtime = prefix + "hint_overtime";
+        trace_is_first_frame = prefix + "is_first_frame";
+        trace_session_hint = prefix + "session_hint";
+        trace_vsync_multiple = prefix + "vsync_multiple";
+        trace_cpu_busy = prefix + "cpu_busy";
+        trace_boost_suppressed = prefix + "boost_suppressed";
+        trace_thermal_scale = prefix + "thermal_scale";
         for (size_t i = 0; i < trace_modes.size(); ++i) {
-            trace_modes[i] = StringPrintf(
-                    "adpf.%s-%s_mode", idString.c_str(),
-                    toString(static_cast<aidl::android::hardware::power::SessionMode>(i)).c_str());
+            trace_modes[i] = prefix +
+                             toString(static_cast<aidl::android::hardware::power::SessionMode>(i)) +
+                             "_mode";
         }
     }
 
@@ -72,6 +73,10 @@ struct AppDescriptorTrace {
     std::string trace_hint_overtime;
     std::string trace_is_first_frame;
     std::string trace_session_hint;
+    std::string trace_vsync_multiple;
+    std::string trace_cpu_busy;
+    std::string trace_boost_suppressed;
+    std::string trace_thermal_scale;
     std::array<std::string, enum_size<aidl::android::hardware::power::SessionMode>()> trace_modes;
 };
 
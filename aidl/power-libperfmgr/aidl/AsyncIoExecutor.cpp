@@ -0,0 +1,128 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include "AsyncIoExecutor.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+
+AsyncIoExecutor::AsyncIoExecutor(const std::string &sysfsRoot)
+    : mSysfsRoot(sysfsRoot), mThread([this]() { loop(); }) {
+    pthread_setname_np(mThread.native_handle(), "powerhal_io");
+}
+
+AsyncIoExecutor::~AsyncIoExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+    }
+    mCv.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void AsyncIoExecutor::writeFile(const std::string &path, const std::string &value) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto itr = mPending.find(path);
+        if (itr != mPending.end()) {
+            // Not started yet, superseded by the newer request which must not
+            // overtake the writes queued in between
+            itr->second = value;
+            mOrder.erase(std::find(mOrder.begin(), mOrder.end(), path));
+            ++mStats[path].collapsed;
+        } else {
+            mPending.emplace(path, value);
+        }
+        mOrder.push_back(path);
+    }
+    mCv.notify_all();
+}
+
+void AsyncIoExecutor::loop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCv.wait(lock, [&]() { return !mRunning || !mOrder.empty(); });
+        if (mOrder.empty()) {
+            break;
+        }
+
+        const std::string path = std::move(mOrder.front());
+        mOrder.pop_front();
+        auto itr = mPending.find(path);
+        const std::string value = std::move(itr->second);
+        mPending.erase(itr);
+        lock.unlock();
+
+        const std::string fullPath = mSysfsRoot + path;
+        const auto start = std::chrono::steady_clock::now();
+        bool ok;
+        {
+            ATRACE_NAME(path.c_str());
+            ok = ::android::base::WriteStringToFile(value, fullPath);
+        }
+        const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+        if (!ok) {
+            ALOGW("Failed to write %s to %s (%s)", value.c_str(), fullPath.c_str(),
+                  strerror(errno));
+        }
+        ALOGV("Async io %s took %lld us", path.c_str(), static_cast<long long>(latency.count()));
+
+        lock.lock();
+        auto &stats = mStats[path];
+        ++stats.completed;
+        if (!ok) {
+            ++stats.failed;
+        }
+        stats.lastLatency = latency;
+        stats.maxLatency = std::max(stats.maxLatency, latency);
+    }
+}
+
+void AsyncIoExecutor::dumpToFd(int fd) {
+    std::string buf("========== Begin Async IO ==========\n"
+                    "Target: Completed Collapsed Failed LastUs MaxUs\n");
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto &[target, stats] : mStats) {
+            StringAppendF(&buf, "  %s: %" PRIu64 " %" PRIu64 " %" PRIu64 " %lld %lld\n",
+                          target.c_str(), stats.completed, stats.collapsed, stats.failed,
+                          static_cast<long long>(stats.lastLatency.count()),
+                          static_cast<long long>(stats.maxLatency.count()));
+        }
+        StringAppendF(&buf, "Pending: %zu\n", mOrder.size());
+    }
+    buf.append("========== End Async IO ==========\n");
+    if (!::android::base::WriteStringToFd(buf, fd)) {
+        ALOGE("Failed to dump async io stats to fd:%d", fd);
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
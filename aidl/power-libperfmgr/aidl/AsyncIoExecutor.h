@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Single worker executor for blocking sysfs writes that must not run on
+// binder threads.
+// Writes run in submission order. A new write to a path whose previous write
+// has not started yet replaces it (last value wins) and moves to the tail of
+// the queue, so writes to different paths are never reordered.
+class AsyncIoExecutor {
+  public:
+    // All file paths are resolved relative to sysfsRoot, tests can point
+    // this at a fake tree
+    explicit AsyncIoExecutor(const std::string &sysfsRoot = "");
+    // Runs the pending writes before returning
+    ~AsyncIoExecutor();
+
+    // Queue writing value to path
+    void writeFile(const std::string &path, const std::string &value);
+    void dumpToFd(int fd);
+
+  private:
+    struct TargetStats {
+        uint64_t completed{0};
+        uint64_t collapsed{0};
+        uint64_t failed{0};
+        std::chrono::microseconds lastLatency{0};
+        std::chrono::microseconds maxLatency{0};
+    };
+
+    void loop();
+
+    const std::string mSysfsRoot;
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mRunning{true};
+    // Paths with a pending write, in submission order
+    std::deque<std::string> mOrder;
+    std::unordered_map<std::string, std::string> mPending;
+    std::map<std::string, TargetStats> mStats;
+    std::thread mThread;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
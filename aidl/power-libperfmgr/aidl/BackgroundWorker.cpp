@@ -9,6 +9,12 @@
 
 #include "BackgroundWorker.h"
 
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+
+#include <algorithm>
+
 namespace aidl {
 namespace google {
 namespace hardware {
@@ -16,91 +22,125 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+namespace {
+constexpr size_t kInitialQueueCapacity = 64;
+}  // namespace
+
 PriorityQueueWorkerPool::PriorityQueueWorkerPool(size_t threadCount,
                                                  const std::string &threadNamePrefix) {
     mRunning = true;
-    mThreadPool.reserve(threadCount);
+    threadCount = std::max<size_t>(1, threadCount);
+    mShards.reserve(threadCount);
+    for (size_t threadId = 0; threadId < threadCount; ++threadId) {
+        mShards.push_back(std::make_unique<Shard>());
+        // Start with room for a burst so steady state scheduling does not allocate
+        std::vector<Package> storage;
+        storage.reserve(kInitialQueueCapacity);
+        mShards.back()->mPackageQueue =
+                std::priority_queue<Package>(std::less<Package>(), std::move(storage));
+    }
     for (size_t threadId = 0; threadId < threadCount; ++threadId) {
-        mThreadPool.push_back(std::thread([&, tid = threadId]() { loop(); }));
+        Shard *shard = mShards[threadId].get();
+        shard->mThread = std::thread([this, shard]() { loop(shard); });
 
         if (!threadNamePrefix.empty()) {
             const std::string fullThreadName = threadNamePrefix + std::to_string(threadId);
-            pthread_setname_np(mThreadPool.back().native_handle(), fullThreadName.c_str());
+            pthread_setname_np(shard->mThread.native_handle(), fullThreadName.c_str());
         }
     }
 }
 
 PriorityQueueWorkerPool::~PriorityQueueWorkerPool() {
-    {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mRunning = false;
-        mCv.notify_all();
+    mRunning = false;
+    for (auto &shard : mShards) {
+        std::lock_guard<InstrumentedMutex> lock(shard->mMutex);
+        shard->mCv.notify_all();
     }
-    for (auto &t : mThreadPool) {
-        if (t.joinable()) {
-            t.join();
+    for (auto &shard : mShards) {
+        if (shard->mThread.joinable()) {
+            shard->mThread.join();
         }
     }
 }
 
-void PriorityQueueWorkerPool::addCallback(int64_t templateQueueWorkerId,
-                                          std::function<void(int64_t)> callback) {
-    if (!callback) {
+int64_t PriorityQueueWorkerPool::addCallback(Callback callback, void *context) {
+    if (callback == nullptr) {
         // Don't add callback if it isn't callable to prevent having to check later
-        return;
+        return -1;
     }
-    std::unique_lock<std::shared_mutex> lock(mSharedMutex);
-    auto itr = mCallbackMap.find(templateQueueWorkerId);
-    if (itr != mCallbackMap.end()) {
-        return;
+    std::unique_lock<InstrumentedSharedMutex> lock(mSharedMutex);
+    for (size_t i = 0; i < mCallbacks.size(); ++i) {
+        auto &slot = mCallbacks[i];
+        if (slot.callback == nullptr) {
+            slot.callback = callback;
+            slot.context = context;
+            return (static_cast<int64_t>(slot.generation) << 32) | i;
+        }
     }
-    mCallbackMap[templateQueueWorkerId] = callback;
+    ALOGE("PriorityQueueWorkerPool: all %zu callback slots are in use", mCallbacks.size());
+    return -1;
 }
 
-void PriorityQueueWorkerPool::removeCallback(int64_t templateQueueWorkerId) {
-    std::unique_lock<std::shared_mutex> lock(mSharedMutex);
-    auto itr = mCallbackMap.find(templateQueueWorkerId);
-    if (itr == mCallbackMap.end()) {
-        return;
+void PriorityQueueWorkerPool::removeCallback(int64_t callbackHandle) {
+    const size_t index = static_cast<size_t>(callbackHandle & 0xffffffff);
+    const uint32_t generation = static_cast<uint32_t>(callbackHandle >> 32);
+    {
+        std::unique_lock<InstrumentedSharedMutex> lock(mSharedMutex);
+        if (callbackHandle < 0 || index >= mCallbacks.size() ||
+            mCallbacks[index].generation != generation || mCallbacks[index].callback == nullptr) {
+            return;
+        }
+        mCallbacks[index] = {nullptr, nullptr, generation + 1};
+    }
+    // Threads may have looked the callback up before it was unregistered
+    for (auto &shard : mShards) {
+        std::unique_lock<InstrumentedMutex> lock(shard->mMutex);
+        shard->mCv.wait(lock, [&]() { return shard->mRunningCallbackHandle != callbackHandle; });
     }
-    mCallbackMap.erase(itr);
 }
 
-void PriorityQueueWorkerPool::schedule(int64_t templateQueueWorkerId, int64_t packageId,
-                                       std::chrono::steady_clock::time_point deadline) {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mPackageQueue.emplace(deadline, templateQueueWorkerId, packageId);
-    mCv.notify_all();
+void PriorityQueueWorkerPool::schedule(int64_t callbackHandle, int64_t packageId,
+                                       std::chrono::steady_clock::time_point deadline,
+                                       uint64_t affinityKey) {
+    Shard *shard = mShards[affinityKey % mShards.size()].get();
+    std::unique_lock<InstrumentedMutex> lock(shard->mMutex);
+    const bool earliest =
+            shard->mPackageQueue.empty() || deadline < shard->mPackageQueue.top().deadline;
+    shard->mPackageQueue.emplace(deadline, callbackHandle, packageId);
+    // Only the thread of this shard waits on the queue, wake it if its deadline moved
+    if (earliest) {
+        shard->mCv.notify_all();
+    }
 }
 
-void PriorityQueueWorkerPool::loop() {
+void PriorityQueueWorkerPool::loop(Shard *shard) {
     Package package;
     while (mRunning) {
-        std::unique_lock<std::mutex> lock(mMutex);
+        std::unique_lock<InstrumentedMutex> lock(shard->mMutex);
         // Default to longest wait possible without overflowing if there is
         // nothing to work on in the queue
         std::chrono::steady_clock::time_point deadline =
                 std::chrono::steady_clock::time_point::max();
 
         // Use next item to work on deadline if available
-        if (!mPackageQueue.empty()) {
-            deadline = mPackageQueue.top().deadline;
+        if (!shard->mPackageQueue.empty()) {
+            deadline = shard->mPackageQueue.top().deadline;
         }
 
         // Wait until signal or deadline
-        mCv.wait_until(lock, deadline, [&]() {
+        shard->mCv.wait_until(lock, deadline, [&]() {
             // Check if stop running requested, if so return now
             if (!mRunning)
                 return true;
 
             // Check if nothing in queue (e.g. spurious wakeup), wait as long as possible again
-            if (mPackageQueue.empty()) {
+            if (shard->mPackageQueue.empty()) {
                 deadline = std::chrono::steady_clock::time_point::max();
                 return false;
             }
 
             // Something in queue, use that as next deadline
-            deadline = mPackageQueue.top().deadline;
+            deadline = shard->mPackageQueue.top().deadline;
             // Check if deadline is in the future still, continue waiting with updated deadline
             if (deadline > std::chrono::steady_clock::now())
                 return false;
@@ -110,26 +150,53 @@ void PriorityQueueWorkerPool::loop() {
 
         if (!mRunning)
             break;
-        if (mPackageQueue.empty())
+        if (shard->mPackageQueue.empty())
             continue;
 
         // Copy work entry from queue and unlock
-        package = mPackageQueue.top();
-        mPackageQueue.pop();
+        package = shard->mPackageQueue.top();
+        shard->mPackageQueue.pop();
+        shard->mRunningCallbackHandle = package.callbackHandle;
         lock.unlock();
 
-        // Find callback based on package's callback id
+        // Find callback based on package's callback handle
+        CallbackSlot callback;
         {
-            std::shared_lock<std::shared_mutex> lockCb(mSharedMutex);
-            auto callbackItr = mCallbackMap.find(package.templateQueueWorkerId);
-            if (callbackItr == mCallbackMap.end()) {
-                // Callback was removed before package could be worked on, that's ok just ignore
-                continue;
+            std::shared_lock<InstrumentedSharedMutex> lockCb(mSharedMutex);
+            const size_t index = static_cast<size_t>(package.callbackHandle & 0xffffffff);
+            if (index < mCallbacks.size() &&
+                mCallbacks[index].generation ==
+                        static_cast<uint32_t>(package.callbackHandle >> 32)) {
+                callback = mCallbacks[index];
             }
+        }
+        // Callback may have been removed before package could be worked on, that's ok just ignore
+        if (callback.callback != nullptr) {
+            const auto lag = std::chrono::steady_clock::now() - package.deadline;
+            shard->mDispatchLagNs.record(
+                    std::max<int64_t>(0, std::chrono::nanoseconds(lag).count()));
             // Exceptions disabled so no need to wrap this
-            callbackItr->second(package.packageId);
+            callback.callback(callback.context, package.packageId);
+        }
+
+        lock.lock();
+        shard->mRunningCallbackHandle = -1;
+        shard->mCv.notify_all();
+    }
+}
+
+void PriorityQueueWorkerPool::dumpToFd(int fd) const {
+    std::string out("PriorityQueueWorkerPool:\n");
+    for (size_t i = 0; i < mShards.size(); ++i) {
+        size_t queued;
+        {
+            std::lock_guard<InstrumentedMutex> lock(mShards[i]->mMutex);
+            queued = mShards[i]->mPackageQueue.size();
         }
+        ::android::base::StringAppendF(&out, "  thread %zu: queued %zu, lag %s\n", i, queued,
+                                       mShards[i]->mDispatchLagNs.toString(1000.0, "us").c_str());
     }
+    ::android::base::WriteStringToFd(out, fd);
 }
 
 }  // namespace pixel
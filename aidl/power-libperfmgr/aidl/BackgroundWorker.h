@@ -6,17 +6,24 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <functional>
+#include <cstddef>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
 #include <shared_mutex>
 #include <string>
 #include <thread>
-#include <unordered_map>
+#include <type_traits>
+#include <vector>
 
 #include "AdpfTypes.h"
+#include "disp-power/Histogram.h"
+#include "disp-power/InstrumentedMutex.h"
 
 namespace aidl {
 namespace google {
@@ -25,111 +32,186 @@ namespace power {
 namespace impl {
 namespace pixel {
 
-// Background thread processing from priority queue based on time deadline
+// Background threads processing from priority queues based on time deadline
+// Every thread owns its queue, work is spread over the threads by an affinity
+// key so work with the same key is run in deadline order by the same thread.
+// Callbacks run without any pool lock held.
 // This class isn't meant to be used directly, use TemplatePriorityQueueWorker below
 class PriorityQueueWorkerPool {
   public:
+    // Plain function and context so registering and running need no allocation
+    using Callback = void (*)(void *context, int64_t packageId);
+    // Most callbacks which can be registered at the same time
+    static constexpr size_t kMaxCallbacks = 16;
+
     // CTOR
     // thread count is number of threads to create in thread pool
     // thread name prefix is use for naming threads to help with debugging
     PriorityQueueWorkerPool(size_t threadCount, const std::string &threadNamePrefix);
     // DTOR
     ~PriorityQueueWorkerPool();
-    // Map callback id to callback function
-    void addCallback(int64_t templateQueueWorkerId, std::function<void(int64_t)> callback);
-    // Unmap callback id with callback function
-    void removeCallback(int64_t templateQueueWorkerId);
-    // Schedule work for specific worker id with package id to be run at time deadline
-    void schedule(int64_t templateQueueWorkerId, int64_t packageId,
-                  std::chrono::steady_clock::time_point deadline);
+    // Register a callback, returns the handle to schedule work with or -1 if
+    // all slots are in use
+    int64_t addCallback(Callback callback, void *context);
+    // Unregister a callback, waits for running calls of it to return
+    void removeCallback(int64_t callbackHandle);
+    // Schedule work for specific callback with package id to be run at time deadline
+    // on the thread affinityKey maps to
+    void schedule(int64_t callbackHandle, int64_t packageId,
+                  std::chrono::steady_clock::time_point deadline, uint64_t affinityKey = 0);
+    // Per thread queue depth and lag between deadline and callback start
+    void dumpToFd(int fd) const;
 
   private:
-    // Thread coordination
-    std::mutex mMutex;
-    bool mRunning;
-    std::condition_variable mCv;
-    std::vector<std::thread> mThreadPool;
-    void loop();
-
-    // Work package with worker id to find correct callback in
+    // Work package with callback handle to find correct callback in
     struct Package {
         Package() {}
-        Package(std::chrono::steady_clock::time_point pDeadline, int64_t pTemplateQueueWorkerId,
+        Package(std::chrono::steady_clock::time_point pDeadline, int64_t pCallbackHandle,
                 int64_t pPackageId)
-            : deadline(pDeadline),
-              templateQueueWorkerId(pTemplateQueueWorkerId),
-              packageId(pPackageId) {}
+            : deadline(pDeadline), callbackHandle(pCallbackHandle), packageId(pPackageId) {}
         std::chrono::steady_clock::time_point deadline;
-        int64_t templateQueueWorkerId{0};
+        int64_t callbackHandle{0};
         int64_t packageId{0};
         // Sort time earliest first
         bool operator<(const Package &p) const { return deadline > p.deadline; }
     };
-    std::priority_queue<Package> mPackageQueue;
 
-    // Callback management
-    std::shared_mutex mSharedMutex;
-    std::unordered_map<int64_t, std::function<void(int64_t)>> mCallbackMap;
+    // Thread coordination, one per thread
+    struct Shard {
+        InstrumentedMutex mMutex{"PriorityQueueWorkerPool::Shard::mMutex"};
+        InstrumentedConditionVariable mCv;
+        std::priority_queue<Package> mPackageQueue;
+        // Callback being run by the thread, -1 if none, guarded by mMutex
+        int64_t mRunningCallbackHandle{-1};
+        Histogram mDispatchLagNs;
+        std::thread mThread;
+    };
+    std::atomic<bool> mRunning;
+    std::vector<std::unique_ptr<Shard>> mShards;
+    void loop(Shard *shard);
+
+    // Callback slots, a handle is the slot index with its generation in the
+    // upper 32 bits so packages of a removed callback are recognized as stale
+    struct CallbackSlot {
+        Callback callback{nullptr};
+        void *context{nullptr};
+        uint32_t generation{0};
+    };
+    InstrumentedSharedMutex mSharedMutex{"PriorityQueueWorkerPool::mSharedMutex"};
+    std::array<CallbackSlot, kMaxCallbacks> mCallbacks;
 };
 
-// Generic templated worker for registering a single std::function callback one time
-// and reusing it to reduce memory allocations. Many TemplatePriorityQueueWorkers
+// Generic templated worker for registering a single callback one time and
+// reusing it to reduce memory allocations. Many TemplatePriorityQueueWorkers
 // can make use of the same PriorityQueue worker which enables sharing a thread pool
 // across callbacks of different types. This class is a template to allow for different
 // types of work packages while not requiring virtual calls.
+// Packages live in a slab of generation indexed slots which only grows when
+// more packages are pending than ever before, the callback is stored inline.
 template <typename PACKAGE>
 class TemplatePriorityQueueWorker {
   public:
+    static constexpr size_t kInlineCallbackSize = 4 * sizeof(void *);
+    static constexpr size_t kDefaultCapacity = 32;
+
     // CTOR, callback to run when added work is run, worker to use for adding work to
-    TemplatePriorityQueueWorker(std::function<void(const PACKAGE &)> cb,
-                                std::shared_ptr<PriorityQueueWorkerPool> worker)
-        : mCallbackId(reinterpret_cast<std::intptr_t>(this)), mCallback(cb), mWorker(worker) {
-        if (!mCallback) {
-            mCallback = [](const auto &) {};
-        }
-        mWorker->addCallback(mCallbackId, [&](int64_t packageId) { process(packageId); });
+    template <typename FN>
+    TemplatePriorityQueueWorker(FN cb, std::shared_ptr<PriorityQueueWorkerPool> worker,
+                                size_t capacity = kDefaultCapacity)
+        : mWorker(worker) {
+        static_assert(sizeof(FN) <= kInlineCallbackSize &&
+                              alignof(FN) <= alignof(std::max_align_t),
+                      "callback does not fit the inline storage");
+        static_assert(std::is_trivially_destructible_v<FN>,
+                      "callback must be trivially destructible");
+        new (mCallbackStorage) FN(std::move(cb));
+        mInvoke = [](void *storage, const PACKAGE &package) {
+            (*std::launder(reinterpret_cast<FN *>(storage)))(package);
+        };
+        grow(std::max<size_t>(1, capacity));
+        mCallbackHandle = mWorker->addCallback(
+                [](void *context, int64_t packageId) {
+                    static_cast<TemplatePriorityQueueWorker *>(context)->process(packageId);
+                },
+                this);
     }
 
     // DTOR
-    ~TemplatePriorityQueueWorker() { mWorker->removeCallback(mCallbackId); }
+    ~TemplatePriorityQueueWorker() { mWorker->removeCallback(mCallbackHandle); }
 
+    TemplatePriorityQueueWorker(const TemplatePriorityQueueWorker &) = delete;
+    TemplatePriorityQueueWorker &operator=(const TemplatePriorityQueueWorker &) = delete;
+
+    // Packages sharing an affinity key are run in deadline order on one thread
     void schedule(const PACKAGE &package,
-                  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now()) {
+                  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now(),
+                  uint64_t affinityKey = 0) {
+        int64_t packageId;
         {
             std::lock_guard<std::mutex> lock(mMutex);
-            ++mPackageIdCounter;
-            mPackages.emplace(mPackageIdCounter, package);
+            if (mFreeSlots.empty()) {
+                grow(mSlots.size() * 2);
+            }
+            const uint32_t index = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            Slot &slot = mSlots[index];
+            slot.package = package;
+            slot.used = true;
+            packageId = (static_cast<int64_t>(slot.generation) << 32) | index;
         }
-        mWorker->schedule(mCallbackId, mPackageIdCounter, t);
+        mWorker->schedule(mCallbackHandle, packageId, t, affinityKey);
+    }
+
+    // Number of package slots, only grows past its initial value under burst load
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mSlots.size();
     }
 
   private:
-    int64_t mCallbackId{0};
-    std::function<void(const PACKAGE &)> mCallback;
+    struct Slot {
+        PACKAGE package{};
+        uint32_t generation{0};
+        bool used{false};
+    };
+
+    int64_t mCallbackHandle{-1};
+    alignas(std::max_align_t) unsigned char mCallbackStorage[kInlineCallbackSize];
+    void (*mInvoke)(void *storage, const PACKAGE &package){nullptr};
     // Must ensure PriorityQueueWorker does not go out of scope before this class does
     std::shared_ptr<PriorityQueueWorkerPool> mWorker;
     mutable std::mutex mMutex;
-    // Counter is used as a unique identifier for work packages
-    int64_t mPackageIdCounter{0};
-    // Want a container that is:
-    // fast to add, fast random find find, fast random removal,
-    // and with reasonable space efficiency
-    std::unordered_map<int64_t, PACKAGE> mPackages;
+    std::vector<Slot> mSlots;
+    // Free list sized for all slots so releasing a slot never allocates
+    std::vector<uint32_t> mFreeSlots;
+
+    void grow(size_t capacity) {
+        const size_t oldSize = mSlots.size();
+        mSlots.resize(capacity);
+        mFreeSlots.reserve(capacity);
+        for (size_t i = capacity; i > oldSize; --i) {
+            mFreeSlots.push_back(static_cast<uint32_t>(i - 1));
+        }
+    }
 
     void process(int64_t packageId) {
+        const uint32_t index = static_cast<uint32_t>(packageId & 0xffffffff);
+        const uint32_t generation = static_cast<uint32_t>(packageId >> 32);
         PACKAGE package;
         {
             std::lock_guard<std::mutex> lock(mMutex);
-            auto itr = mPackages.find(packageId);
-            if (itr == mPackages.end()) {
+            if (index >= mSlots.size() || !mSlots[index].used ||
+                mSlots[index].generation != generation) {
                 // Work id does not have matching entry, drop it
                 return;
             }
-
-            package = itr->second;
-            mPackages.erase(itr);
+            Slot &slot = mSlots[index];
+            package = slot.package;
+            slot.used = false;
+            slot.generation++;
+            mFreeSlots.push_back(index);
         }
-        mCallback(package);
+        mInvoke(mCallbackStorage, package);
     }
 };
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include "BoostCoalescer.h"
+
+#include <utils/Trace.h>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+BoostCoalescer::BoostCoalescer(size_t boostCount) : mWindows(boostCount) {}
+
+bool BoostCoalescer::shouldIssueLocked(BoostWindow *window, int32_t durationMs,
+                                       std::chrono::steady_clock::time_point timePoint) {
+    if (durationMs <= 0) {
+        // Ending a boost always changes coverage. An untimed boost restarts
+        // every action for its configured duration, which is not known here,
+        // so it is never coalesced and nothing is known to cover later requests.
+        window->activeEnd = {};
+        ++window->issued;
+        return true;
+    }
+
+    const auto requestedEnd = timePoint + std::chrono::milliseconds(durationMs);
+    if (window->activeEnd >= requestedEnd) {
+        ATRACE_NAME("boost coalesced");
+        ++window->coalesced;
+        return false;
+    }
+    window->activeEnd = requestedEnd;
+    ++window->issued;
+    return true;
+}
+
+void BoostCoalescer::reset() {
+    for (auto &window : mWindows) {
+        std::lock_guard<std::mutex> lock(window.mutex);
+        window.activeEnd = {};
+    }
+}
+
+uint64_t BoostCoalescer::issuedCount(size_t boostIndex) const {
+    if (boostIndex >= mWindows.size()) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(mWindows[boostIndex].mutex);
+    return mWindows[boostIndex].issued;
+}
+
+uint64_t BoostCoalescer::coalescedCount(size_t boostIndex) const {
+    if (boostIndex >= mWindows.size()) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(mWindows[boostIndex].mutex);
+    return mWindows[boostIndex].coalesced;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
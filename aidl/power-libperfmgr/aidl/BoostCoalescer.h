@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Track the active window of each boost so that a request already covered
+// by an active boost of the same type does not issue another hint. Only
+// requests that extend the coverage (or end the boost) are issued.
+class BoostCoalescer {
+  public:
+    explicit BoostCoalescer(size_t boostCount);
+
+    // Call doHint unless the request is coalesced into the active boost and
+    // return whether it was called. Follows setBoost duration semantics: > 0
+    // timed boost, 0 boost for the durations of the powerhint config, < 0 end
+    // the boost. doHint runs under the lock of the boost so a concurrent end
+    // and start of the same boost reach HintManager in the order they were
+    // accounted.
+    template <typename FN>
+    bool issue(size_t boostIndex, int32_t durationMs,
+               std::chrono::steady_clock::time_point timePoint, FN doHint) {
+        if (boostIndex >= mWindows.size()) {
+            doHint();
+            return true;
+        }
+        BoostWindow &window = mWindows[boostIndex];
+        std::lock_guard<std::mutex> lock(window.mutex);
+        if (!shouldIssueLocked(&window, durationMs, timePoint)) {
+            return false;
+        }
+        doHint();
+        return true;
+    }
+
+    // Forget all active windows, used when hints get ended behind our back
+    void reset();
+
+    uint64_t issuedCount(size_t boostIndex) const;
+    uint64_t coalescedCount(size_t boostIndex) const;
+
+  private:
+    struct BoostWindow {
+        mutable std::mutex mutex;
+        std::chrono::steady_clock::time_point activeEnd{};
+        uint64_t issued{0};
+        uint64_t coalesced{0};
+    };
+
+    bool shouldIssueLocked(BoostWindow *window, int32_t durationMs,
+                           std::chrono::steady_clock::time_point timePoint);
+
+    std::vector<BoostWindow> mWindows;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "ClusterPlacement.h"
+
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+
+ClusterPlacement::ClusterPlacement(const std::vector<std::string> &profiles,
+                                   const std::vector<int> &thresholds, int hysteresis)
+    : mHysteresis(std::max(0, hysteresis)) {
+    if (thresholds.empty()) {
+        return;
+    }
+    if (profiles.size() != thresholds.size() + 1 || profiles.size() > kMaxBands ||
+        !std::is_sorted(thresholds.begin(), thresholds.end())) {
+        ALOGE("Cluster placement disabled: need %zu profiles for %zu ascending thresholds, "
+              "at most %zu",
+              thresholds.size() + 1, thresholds.size(), kMaxBands);
+        return;
+    }
+    mProfiles = profiles;
+    mThresholds = thresholds;
+}
+
+int ClusterPlacement::nextBand(int currentBand, int setPoint) const {
+    const int bandCount = static_cast<int>(mThresholds.size());
+    int band = std::clamp(currentBand, 0, bandCount);
+    while (band < bandCount && setPoint >= mThresholds[band]) {
+        band++;
+    }
+    while (band > 0 && setPoint < mThresholds[band - 1] - mHysteresis) {
+        band--;
+    }
+    return band;
+}
+
+void ClusterPlacement::recordTransition(int fromBand, int toBand, size_t taskCount,
+                                        size_t failedCount) {
+    if (toBand > fromBand) {
+        mCounters.upCount++;
+    } else {
+        mCounters.downCount++;
+    }
+    mCounters.bandEntries[toBand]++;
+    mCounters.migrationCount += taskCount;
+    mCounters.failedCount += failedCount;
+}
+
+std::string ClusterPlacement::toString(const Counters &counters) const {
+    if (!enabled()) {
+        return "ClusterPlacement: disabled";
+    }
+    std::string result = ::android::base::StringPrintf(
+            "ClusterPlacement(hysteresis: %d, up: %" PRIu64 ", down: %" PRIu64
+            ", migrations: %" PRIu64 ", failed: %" PRIu64 ")",
+            mHysteresis, counters.upCount, counters.downCount, counters.migrationCount,
+            counters.failedCount);
+    for (size_t band = 0; band < mProfiles.size(); ++band) {
+        StringAppendF(&result, "\n  [%zu] %s from %d: %" PRIu64, band, mProfiles[band].c_str(),
+                      band == 0 ? 0 : mThresholds[band - 1], counters.bandEntries[band]);
+    }
+    return result;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
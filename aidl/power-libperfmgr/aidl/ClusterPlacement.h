@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Maps the PID set point of a session to a placement band, each band having a
+// task profile (e.g. a cpuset or affinity profile) applied to the session
+// threads. N ascending thresholds define N + 1 bands. A session moves up as
+// soon as its set point reaches the next threshold but only moves down once
+// it is hysteresis below the threshold, so it does not ping-pong between
+// clusters around a boundary.
+class ClusterPlacement {
+  public:
+    ClusterPlacement(const std::vector<std::string> &profiles, const std::vector<int> &thresholds,
+                     int hysteresis);
+
+    bool enabled() const { return !mThresholds.empty(); }
+
+    // Band to use for setPoint when currently in currentBand
+    int nextBand(int currentBand, int setPoint) const;
+    const std::string &getProfile(int band) const { return mProfiles[band]; }
+
+    static constexpr size_t kMaxBands = 8;
+    // Plain copy of the accounting, cheap to take under the caller's lock
+    struct Counters {
+        uint64_t upCount{0};
+        uint64_t downCount{0};
+        // Per-task profile applications and failures
+        uint64_t migrationCount{0};
+        uint64_t failedCount{0};
+        std::array<uint64_t, kMaxBands> bandEntries{};
+    };
+
+    // Accounting, callers serialize access
+    void recordTransition(int fromBand, int toBand, size_t taskCount, size_t failedCount);
+    const Counters &counters() const { return mCounters; }
+
+    // The config does not change after construction, counters may be a copy
+    // taken earlier
+    std::string toString(const Counters &counters) const;
+    std::string toString() const { return toString(mCounters); }
+
+  private:
+    std::vector<std::string> mProfiles;
+    std::vector<int> mThresholds;
+    const int mHysteresis;
+    Counters mCounters;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
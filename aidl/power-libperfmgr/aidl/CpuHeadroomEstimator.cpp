@@ -0,0 +1,281 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include "CpuHeadroomEstimator.h"
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+
+namespace {
+
+// Parse an unsigned decimal at *p and advance past it and trailing spaces
+bool parseU64(const char **p, const char *end, uint64_t *value) {
+    const char *c = *p;
+    while (c < end && *c == ' ') {
+        ++c;
+    }
+    if (c == end || *c < '0' || *c > '9') {
+        return false;
+    }
+    uint64_t v = 0;
+    while (c < end && *c >= '0' && *c <= '9') {
+        v = v * 10 + (*c - '0');
+        ++c;
+    }
+    *p = c;
+    *value = v;
+    return true;
+}
+
+bool readU64(int fd, uint64_t *value) {
+    char buf[32];
+    const ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf), 0));
+    if (len <= 0) {
+        return false;
+    }
+    const char *p = buf;
+    return parseU64(&p, buf + len, value);
+}
+
+// Parse a cpu list such as "0-3" or "4 5 6"
+std::vector<int> parseCpuList(const std::string &str) {
+    std::vector<int> cpus;
+    for (const auto &token : ::android::base::Split(::android::base::Trim(str), " ,")) {
+        const auto range = ::android::base::Split(token, "-");
+        int first = 0;
+        int last = 0;
+        if (range.empty() || !::android::base::ParseInt(range[0], &first, 0)) {
+            continue;
+        }
+        last = first;
+        if (range.size() == 2 && !::android::base::ParseInt(range[1], &last, first)) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+}  // namespace
+
+CpuHeadroomEstimator::CpuHeadroomEstimator(const std::string &procStatPath,
+                                           const std::string &cpufreqRoot, const Config &config)
+    : mConfig(config) {
+    mProcStatFd.reset(TEMP_FAILURE_RETRY(open(procStatPath.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (!mProcStatFd.ok()) {
+        ALOGW("Failed to open %s, CPU headroom disabled", procStatPath.c_str());
+        return;
+    }
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(cpufreqRoot.c_str()), closedir);
+    if (!dir) {
+        ALOGW("Failed to open %s, CPU headroom disabled", cpufreqRoot.c_str());
+        return;
+    }
+    int maxCpu = -1;
+    while (struct dirent *ent = readdir(dir.get())) {
+        if (!::android::base::StartsWith(ent->d_name, "policy")) {
+            continue;
+        }
+        const std::string policyPath = cpufreqRoot + "/" + ent->d_name;
+        std::string related;
+        std::string maxFreq;
+        if (!::android::base::ReadFileToString(policyPath + "/related_cpus", &related) ||
+            !::android::base::ReadFileToString(policyPath + "/cpuinfo_max_freq", &maxFreq)) {
+            continue;
+        }
+        Cluster cluster;
+        cluster.name = ent->d_name;
+        cluster.cpus = parseCpuList(related);
+        if (cluster.cpus.empty() ||
+            !::android::base::ParseUint(::android::base::Trim(maxFreq), &cluster.maxFreqKhz) ||
+            cluster.maxFreqKhz == 0) {
+            continue;
+        }
+        const std::string curFreqPath = policyPath + "/scaling_cur_freq";
+        cluster.curFreqFd.reset(
+                TEMP_FAILURE_RETRY(open(curFreqPath.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (!cluster.curFreqFd.ok()) {
+            ALOGW("Failed to open %s (%s)", curFreqPath.c_str(), strerror(errno));
+            continue;
+        }
+        maxCpu = std::max(maxCpu, *std::max_element(cluster.cpus.begin(), cluster.cpus.end()));
+        mClusters.push_back(std::move(cluster));
+    }
+    std::sort(mClusters.begin(), mClusters.end(),
+              [](const Cluster &a, const Cluster &b) { return a.cpus[0] < b.cpus[0]; });
+    mCpus.resize(maxCpu + 1);
+}
+
+bool CpuHeadroomEstimator::parseProcStatLocked() {
+    const ssize_t len =
+            TEMP_FAILURE_RETRY(pread(mProcStatFd.get(), mBuffer.data(), mBuffer.size(), 0));
+    if (len <= 0) {
+        return false;
+    }
+    // An offline CPU is missing from /proc/stat, leave it with no delta
+    for (auto &times : mCpus) {
+        times.prevBusy = times.busy;
+        times.prevTotal = times.total;
+    }
+    const char *p = mBuffer.data();
+    const char *end = p + len;
+    bool parsed = false;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr) {
+            // Truncated line, later lines are not cpu lines we track
+            break;
+        }
+        // "cpuN user nice system idle iowait irq softirq steal ..."
+        if (eol - p < 4 || p[0] != 'c' || p[1] != 'p' || p[2] != 'u') {
+            break;
+        }
+        const char *c = p + 3;
+        uint64_t cpu = 0;
+        if (*c != ' ' && parseU64(&c, eol, &cpu) && cpu < mCpus.size()) {
+            uint64_t fields[8] = {};
+            size_t count = 0;
+            while (count < 8 && parseU64(&c, eol, &fields[count])) {
+                ++count;
+            }
+            if (count >= 5) {
+                uint64_t total = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    total += fields[i];
+                }
+                auto &times = mCpus[cpu];
+                // idle + iowait
+                times.busy = total - fields[3] - fields[4];
+                times.total = total;
+                parsed = true;
+            }
+        }
+        p = eol + 1;
+    }
+    return parsed;
+}
+
+void CpuHeadroomEstimator::sampleLocked(std::chrono::steady_clock::time_point timePoint) {
+    if (mClusters.empty()) {
+        return;
+    }
+    if (mSampleCount > 0 && timePoint - mLastSampleTime < mConfig.minInterval) {
+        mSkippedCount++;
+        return;
+    }
+    ATRACE_CALL();
+    const auto start = std::chrono::steady_clock::now();
+    const bool firstSample = mSampleCount == 0;
+    mLastSampleTime = timePoint;
+    mSampleCount++;
+    if (!parseProcStatLocked()) {
+        return;
+    }
+    for (auto &cluster : mClusters) {
+        uint64_t busy = 0;
+        uint64_t total = 0;
+        for (const int cpu : cluster.cpus) {
+            const auto &times = mCpus[cpu];
+            // No delta for CPUs which were offline since the last sample
+            if (times.total > times.prevTotal) {
+                busy += times.busy - times.prevBusy;
+                total += times.total - times.prevTotal;
+            }
+        }
+        if (!readU64(cluster.curFreqFd.get(), &cluster.curFreqKhz)) {
+            cluster.curFreqKhz = cluster.maxFreqKhz;
+        }
+        if (firstSample || total == 0) {
+            continue;
+        }
+        const double freqScale =
+                std::min(1.0, static_cast<double>(cluster.curFreqKhz) / cluster.maxFreqKhz);
+        const double util = static_cast<double>(busy) / total * freqScale;
+        cluster.util = cluster.hasUtil ? mConfig.alpha * util + (1.0 - mConfig.alpha) * cluster.util
+                                       : util;
+        cluster.hasUtil = true;
+    }
+    const int64_t costNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+    mTotalCostNs += costNs;
+    mMaxCostNs = std::max(mMaxCostNs, costNs);
+}
+
+double CpuHeadroomEstimator::getHeadroom(size_t cluster,
+                                         std::chrono::steady_clock::time_point timePoint) {
+    std::lock_guard<std::mutex> lock(mLock);
+    sampleLocked(timePoint);
+    if (cluster >= mClusters.size() || !mClusters[cluster].hasUtil) {
+        return -1.0;
+    }
+    return std::clamp(1.0 - mClusters[cluster].util, 0.0, 1.0);
+}
+
+void CpuHeadroomEstimator::dumpToFd(int fd) {
+    std::string result = "========== Begin CPU headroom ==========\n";
+    {
+        // Reports the last estimate, dumping must not advance the samples
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mClusters.empty()) {
+            result += "Disabled\n";
+        }
+        for (const auto &cluster : mClusters) {
+            StringAppendF(&result, "%s: cpus %d-%d, freq %" PRIu64 "/%" PRIu64 " kHz",
+                          cluster.name.c_str(), cluster.cpus.front(), cluster.cpus.back(),
+                          cluster.curFreqKhz, cluster.maxFreqKhz);
+            if (cluster.hasUtil) {
+                StringAppendF(&result, ", util %.1f%%, headroom %.1f%%\n", cluster.util * 100,
+                              std::clamp(1.0 - cluster.util, 0.0, 1.0) * 100);
+            } else {
+                result += ", no sample yet\n";
+            }
+        }
+        StringAppendF(&result,
+                      "Samples: %" PRIu64 ", rate limited: %" PRIu64
+                      ", avg cost: %" PRId64 " ns, max cost: %" PRId64 " ns\n",
+                      mSampleCount, mSkippedCount,
+                      mSampleCount > 0 ? mTotalCostNs / static_cast<int64_t>(mSampleCount) : 0,
+                      mMaxCostNs);
+    }
+    result += "========== End CPU headroom ==========\n";
+    if (!::android::base::WriteStringToFd(result, fd)) {
+        ALOGE("Failed to dump CPU headroom");
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
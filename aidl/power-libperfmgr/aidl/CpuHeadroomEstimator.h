@@ -0,0 +1,90 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Estimates the CPU headroom of each cpufreq policy from the per-CPU times in
+// /proc/stat and the current frequency of the policy. Utilization is scaled by
+// cur/max frequency so a busy cluster at low frequency still reports headroom,
+// and is smoothed with an EWMA. Files are kept open and parsed in place from a
+// fixed buffer, a sample does not allocate. Sampling is rate-limited, callers
+// within the interval get the previous estimate.
+class CpuHeadroomEstimator {
+  public:
+    struct Config {
+        std::chrono::milliseconds minInterval{100};
+        // Weight of the newest sample in the moving average
+        double alpha{0.3};
+    };
+
+    CpuHeadroomEstimator(const std::string &procStatPath, const std::string &cpufreqRoot,
+                         const Config &config);
+
+    size_t getClusterCount() const { return mClusters.size(); }
+
+    // Smoothed free capacity of a cluster in [0, 1], refreshed if the interval elapsed.
+    // Returns -1 for an unknown cluster or before the first delta is available.
+    double getHeadroom(size_t cluster, std::chrono::steady_clock::time_point timePoint);
+
+    // Dump the last estimate without sampling
+    void dumpToFd(int fd);
+
+  private:
+    struct CpuTimes {
+        uint64_t busy{0};
+        uint64_t total{0};
+        uint64_t prevBusy{0};
+        uint64_t prevTotal{0};
+    };
+    struct Cluster {
+        std::string name;
+        std::vector<int> cpus;
+        ::android::base::unique_fd curFreqFd;
+        uint64_t maxFreqKhz{0};
+        uint64_t curFreqKhz{0};
+        double util{0.0};
+        bool hasUtil{false};
+    };
+
+    void sampleLocked(std::chrono::steady_clock::time_point timePoint);
+    bool parseProcStatLocked();
+
+    const Config mConfig;
+    ::android::base::unique_fd mProcStatFd;
+    std::vector<CpuTimes> mCpus;
+    std::vector<Cluster> mClusters;
+    // Large enough for the cpu lines of /proc/stat, the rest is not needed
+    std::array<char, 8192> mBuffer;
+
+    std::mutex mLock;
+    std::chrono::steady_clock::time_point mLastSampleTime{};
+    uint64_t mSampleCount{0};
+    uint64_t mSkippedCount{0};
+    int64_t mTotalCostNs{0};
+    int64_t mMaxCostNs{0};
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <perfmgr/HintManager.h>
+
+#include <array>
+#include <string>
+
+#include "AdpfTypes.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Hint name and support flags of a single enum value, resolved once
+struct HintTableEntry {
+    std::string name;
+    // A powerhint node action exists for this hint
+    bool hintSupported{false};
+    // An ADPF profile exists with this name
+    bool adpfSupported{false};
+    // Refresh rate selected by this mode, if it is a refresh rate mode
+    AdpfRefreshRate refreshRate{AdpfRefreshRate::REFRESH_UNKNOWN};
+};
+
+// Dense table indexed by AIDL enum value (Mode, Boost), built once at startup
+// so per-call dispatch does not need toString() and string keyed lookups.
+// Relies on the powerhint config being immutable for the process lifetime,
+// the service is restarted when the debug config changes.
+template <typename E>
+class HintTable {
+  public:
+    HintTable() {
+        auto hm = ::android::perfmgr::HintManager::GetInstance();
+        for (const auto type : ndk::enum_range<E>()) {
+            auto &entry = mEntries[static_cast<size_t>(type)];
+            entry.name = toString(type);
+            entry.hintSupported = hm->IsHintSupported(entry.name);
+            entry.adpfSupported = hm->IsAdpfProfileSupported(entry.name);
+        }
+    }
+
+    // Returns nullptr for values unknown to this build of the interface
+    const HintTableEntry *find(E type) const {
+        const auto index = static_cast<size_t>(type);
+        if (index >= mEntries.size()) {
+            return nullptr;
+        }
+        return &mEntries[index];
+    }
+
+    size_t size() const { return mEntries.size(); }
+
+  private:
+    std::array<HintTableEntry, enum_size<E>()> mEntries;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
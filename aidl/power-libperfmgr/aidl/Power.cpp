@@ -16,11 +16,16 @@
 #include <perfmgr/HintManager.h>
 #include <utils/Log.h>
 
+#include <cinttypes>
 #include <mutex>
+#include <string_view>
 
+#include "ApiStats.h"
 #include "PowerHintSession.h"
 #include "PowerSessionManager.h"
+#include "disp-power/DisplayIdleMonitor.h"
 #include "disp-power/DisplayLowPower.h"
+#include "disp-power/InstrumentedMutex.h"
 
 namespace aidl {
 namespace google {
@@ -36,21 +41,47 @@ constexpr char kPowerHalStateProp[] = "vendor.powerhal.state";
 constexpr char kPowerHalAudioProp[] = "vendor.powerhal.audio";
 constexpr char kPowerHalRenderingProp[] = "vendor.powerhal.rendering";
 
-static const std::vector<Mode> kAlwaysAllowedModes = {
-    Mode::DOUBLE_TAP_TO_WAKE,
-    Mode::INTERACTIVE,
-    Mode::DEVICE_IDLE,
-    Mode::DISPLAY_INACTIVE,
-};
+static constexpr bool isAlwaysAllowedMode(Mode type) {
+    switch (type) {
+        case Mode::DOUBLE_TAP_TO_WAKE:
+        case Mode::INTERACTIVE:
+        case Mode::DEVICE_IDLE:
+        case Mode::DISPLAY_INACTIVE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isAdpfEnabled() {
+    auto adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
+    return adpfConfig && adpfConfig->mReportingRateLimitNs > 0;
+}
 
-Power::Power(std::shared_ptr<DisplayLowPower> dlpw)
+Power::Power(std::shared_ptr<DisplayLowPower> dlpw,
+             std::shared_ptr<CpuHeadroomEstimator> cpuHeadroom)
     : mDisplayLowPower(dlpw),
+      mCpuHeadroom(cpuHeadroom),
+      mBoostCoalescer(mBoostTable.size()),
       mInteractionHandler(nullptr),
       mSustainedPerfModeOn(false),
       mBatterySaverOn(false) {
     mInteractionHandler = std::make_unique<InteractionHandler>();
     mInteractionHandler->Init();
 
+    for (const auto &hint : HintManager::GetInstance()->GetHints()) {
+        bool alwaysAllowed = false;
+        for (const auto type : ndk::enum_range<Mode>()) {
+            if (isAlwaysAllowedMode(type) && hint == mModeTable.find(type)->name) {
+                alwaysAllowed = true;
+                break;
+            }
+        }
+        if (!alwaysAllowed) {
+            mEndAllHintNames.push_back(hint);
+        }
+    }
+
     std::string state = ::android::base::GetProperty(kPowerHalStateProp, "");
     if (state == "SUSTAINED_PERFORMANCE") {
         LOG(INFO) << "Initialize with SUSTAINED_PERFORMANCE on";
@@ -76,36 +107,38 @@ Power::Power(std::shared_ptr<DisplayLowPower> dlpw)
     LOG(INFO) << "PowerHAL InterfaceVersion:" << mServiceVersion << " isOK: " << status.isOk();
 }
 
-static void endAllHints() {
+void Power::endAllHints() {
     std::shared_ptr<HintManager> hm = HintManager::GetInstance();
-    for (auto hint : hm->GetHints()) {
-        if (std::any_of(kAlwaysAllowedModes.begin(), kAlwaysAllowedModes.end(),
-                [hint](auto mode) { return hint == toString(mode); })) {
-            continue;
-        }
+    for (const auto &hint : mEndAllHintNames) {
         hm->EndHint(hint);
     }
+    mBoostCoalescer.reset();
 }
 
 ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
-    LOG(DEBUG) << "Power setMode: " << toString(type) << " to: " << enabled;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
-        PowerSessionManager::getInstance()->updateHintMode(toString(type), enabled);
+    ScopedApiLatency apiLatency(ApiId::POWER_SET_MODE);
+    const HintTableEntry *entry = mModeTable.find(type);
+    if (!entry) {
+        LOG(WARNING) << "Power setMode: unknown mode " << static_cast<int32_t>(type);
+        return ndk::ScopedAStatus::ok();
+    }
+    LOG(DEBUG) << "Power setMode: " << entry->name << " to: " << enabled;
+    if (entry->adpfSupported && isAdpfEnabled()) {
+        PowerSessionManager::getInstance()->updateHintMode(entry->name, enabled);
     }
     switch (type) {
-       case Mode::DOUBLE_TAP_TO_WAKE:
-            ::android::base::WriteStringToFile(enabled ? "sod_enable,1" : "sod_enable,0",
-                                               "/sys/devices/virtual/sec/tsp/cmd");
-            ::android::base::WriteStringToFile(enabled ? "1" : "0",
-                                               "/sys/devices/dsi_panel_driver/pre_sod_mode");
+        case Mode::DOUBLE_TAP_TO_WAKE:
+            mAsyncIo.writeFile("/sys/devices/virtual/sec/tsp/cmd",
+                               enabled ? "sod_enable,1" : "sod_enable,0");
+            mAsyncIo.writeFile("/sys/devices/dsi_panel_driver/pre_sod_mode", enabled ? "1" : "0");
             break;
         case Mode::LOW_POWER:
+            // Never blocks, the PPS client sends the command from its own thread
             mDisplayLowPower->SetDisplayLowPower(enabled);
             if (enabled) {
                 endAllHints();
-            } else {
-                HintManager::GetInstance()->EndHint(toString(type));
+            } else if (entry->hintSupported) {
+                HintManager::GetInstance()->EndHint(entry->name);
             }
             mBatterySaverOn = enabled;
             break;
@@ -135,14 +168,16 @@ ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
         case Mode::GAME_LOADING:
             [[fallthrough]];
         default:
-            if (mBatterySaverOn && std::find(kAlwaysAllowedModes.begin(),
-                    kAlwaysAllowedModes.end(), type) == kAlwaysAllowedModes.end()) {
+            if (mBatterySaverOn && !isAlwaysAllowedMode(type)) {
+                break;
+            }
+            if (!entry->hintSupported) {
                 break;
             }
             if (enabled) {
-                HintManager::GetInstance()->DoHint(toString(type));
+                HintManager::GetInstance()->DoHint(entry->name);
             } else {
-                HintManager::GetInstance()->EndHint(toString(type));
+                HintManager::GetInstance()->EndHint(entry->name);
             }
             break;
     }
@@ -151,6 +186,7 @@ ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
 }
 
 ndk::ScopedAStatus Power::isModeSupported(Mode type, bool *_aidl_return) {
+    ScopedApiLatency apiLatency(ApiId::POWER_IS_MODE_SUPPORTED);
     switch (mServiceVersion) {
         case 5:
             if (static_cast<int32_t>(type) <= static_cast<int32_t>(Mode::AUTOMOTIVE_PROJECTION))
@@ -172,24 +208,27 @@ ndk::ScopedAStatus Power::isModeSupported(Mode type, bool *_aidl_return) {
             *_aidl_return = false;
             return ndk::ScopedAStatus::ok();
     }
-    bool supported = HintManager::GetInstance()->IsHintSupported(toString(type));
+    const HintTableEntry *entry = mModeTable.find(type);
+    bool supported = entry && (entry->hintSupported || entry->adpfSupported);
     // LOW_POWER and DOUBLE_TAP_TO_WAKE handled insides PowerHAL specifically
     if (type == Mode::LOW_POWER || type == Mode::DOUBLE_TAP_TO_WAKE) {
         supported = true;
     }
-    if (!supported && HintManager::GetInstance()->IsAdpfProfileSupported(toString(type))) {
-        supported = true;
-    }
     LOG(INFO) << "Power mode " << toString(type) << " isModeSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
-    LOG(DEBUG) << "Power setBoost: " << toString(type) << " duration: " << durationMs;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
-        PowerSessionManager::getInstance()->updateHintBoost(toString(type), durationMs);
+    ScopedApiLatency apiLatency(ApiId::POWER_SET_BOOST);
+    const HintTableEntry *entry = mBoostTable.find(type);
+    if (!entry) {
+        LOG(WARNING) << "Power setBoost: unknown boost " << static_cast<int32_t>(type);
+        return ndk::ScopedAStatus::ok();
+    }
+    LOG(DEBUG) << "Power setBoost: " << entry->name << " duration: " << durationMs;
+    if (isAdpfEnabled()) {
+        PowerSessionManager::getInstance()->updateHintBoost(entry->name, durationMs);
     }
     switch (type) {
         case Boost::INTERACTION:
@@ -205,17 +244,21 @@ ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
         case Boost::AUDIO_LAUNCH:
             [[fallthrough]];
         default:
-            if (mSustainedPerfModeOn || mBatterySaverOn) {
+            if (mSustainedPerfModeOn || mBatterySaverOn || !entry->hintSupported) {
                 break;
             }
-            if (durationMs > 0) {
-                HintManager::GetInstance()->DoHint(toString(type),
-                                                   std::chrono::milliseconds(durationMs));
-            } else if (durationMs == 0) {
-                HintManager::GetInstance()->DoHint(toString(type));
-            } else {
-                HintManager::GetInstance()->EndHint(toString(type));
-            }
+            mBoostCoalescer.issue(
+                    static_cast<size_t>(type), durationMs, std::chrono::steady_clock::now(),
+                    [&]() {
+                        if (durationMs > 0) {
+                            HintManager::GetInstance()->DoHint(
+                                    entry->name, std::chrono::milliseconds(durationMs));
+                        } else if (durationMs == 0) {
+                            HintManager::GetInstance()->DoHint(entry->name);
+                        } else {
+                            HintManager::GetInstance()->EndHint(entry->name);
+                        }
+                    });
             break;
     }
 
@@ -223,6 +266,7 @@ ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
 }
 
 ndk::ScopedAStatus Power::isBoostSupported(Boost type, bool *_aidl_return) {
+    ScopedApiLatency apiLatency(ApiId::POWER_IS_BOOST_SUPPORTED);
     switch (mServiceVersion) {
         case 5:
             [[fallthrough]];
@@ -240,10 +284,8 @@ ndk::ScopedAStatus Power::isBoostSupported(Boost type, bool *_aidl_return) {
             *_aidl_return = false;
             return ndk::ScopedAStatus::ok();
     }
-    bool supported = HintManager::GetInstance()->IsHintSupported(toString(type));
-    if (!supported && HintManager::GetInstance()->IsAdpfProfileSupported(toString(type))) {
-        supported = true;
-    }
+    const HintTableEntry *entry = mBoostTable.find(type);
+    bool supported = entry && (entry->hintSupported || entry->adpfSupported);
     LOG(INFO) << "Power boost " << toString(type) << " isBoostSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
@@ -253,7 +295,33 @@ constexpr const char *boolToString(bool b) {
     return b ? "true" : "false";
 }
 
-binder_status_t Power::dump(int fd, const char **, uint32_t) {
+binder_status_t Power::dump(int fd, const char **args, uint32_t numArgs) {
+    if (numArgs > 0 && std::string_view(args[0]) == "--cpu-headroom") {
+        // One "<cluster> <headroom>" line per cpufreq policy, -1 if unknown yet
+        std::string buf;
+        if (mCpuHeadroom) {
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < mCpuHeadroom->getClusterCount(); i++) {
+                ::android::base::StringAppendF(&buf, "%zu %.3f\n", i,
+                                               mCpuHeadroom->getHeadroom(i, now));
+            }
+        }
+        if (!::android::base::WriteStringToFd(buf, fd)) {
+            PLOG(ERROR) << "Failed to dump CPU headroom to fd";
+        }
+        fsync(fd);
+        return STATUS_OK;
+    }
+    if (numArgs > 0 && std::string_view(args[0]) == "--adpf-stats-binary") {
+        PowerSessionManager::getInstance()->dumpStatsBinaryToFd(fd);
+        fsync(fd);
+        return STATUS_OK;
+    }
+    if (numArgs > 0 && std::string_view(args[0]) == "--adpf-json") {
+        PowerSessionManager::getInstance()->dumpToFd(fd, true);
+        fsync(fd);
+        return STATUS_OK;
+    }
     std::string buf(::android::base::StringPrintf(
             "HintManager Running: %s\n"
             "SustainedPerformanceMode: %s\n"
@@ -261,9 +329,35 @@ binder_status_t Power::dump(int fd, const char **, uint32_t) {
             boolToString(HintManager::GetInstance()->IsRunning()),
             boolToString(mSustainedPerfModeOn),
             boolToString(mBatterySaverOn)));
+    buf.append("Boost: Issued Coalesced\n");
+    for (const auto type : ndk::enum_range<Boost>()) {
+        const HintTableEntry *entry = mBoostTable.find(type);
+        if (type == Boost::INTERACTION || !entry || !entry->hintSupported) {
+            continue;
+        }
+        const auto index = static_cast<size_t>(type);
+        ::android::base::StringAppendF(&buf, "  %s: %" PRIu64 " %" PRIu64 "\n",
+                                       entry->name.c_str(), mBoostCoalescer.issuedCount(index),
+                                       mBoostCoalescer.coalescedCount(index));
+    }
     // Dump nodes through libperfmgr
     HintManager::GetInstance()->DumpToFd(fd);
     PowerSessionManager::getInstance()->dumpToFd(fd);
+    mAsyncIo.dumpToFd(fd);
+    mDisplayLowPower->DumpToFd(fd);
+    DisplayIdleMonitor::GetDefault()->DumpToFd(fd);
+    mInteractionHandler->DumpToFd(fd);
+    if (mCpuHeadroom) {
+        mCpuHeadroom->dumpToFd(fd);
+    }
+    DumpLockStats(fd);
+    ApiStats::getInstance().dumpToFd(fd);
+    for (uint32_t i = 0; i < numArgs; i++) {
+        if (std::string_view(args[i]) == "--reset-lockstats") {
+            ResetLockStats();
+            buf.append("Lock stats reset\n");
+        }
+    }
     if (!::android::base::WriteStringToFd(buf, fd)) {
         PLOG(ERROR) << "Failed to dump state to fd";
     }
@@ -275,8 +369,8 @@ ndk::ScopedAStatus Power::createHintSession(int32_t tgid, int32_t uid,
                                             const std::vector<int32_t> &threadIds,
                                             int64_t durationNanos,
                                             std::shared_ptr<IPowerHintSession> *_aidl_return) {
-    if (!HintManager::GetInstance()->GetAdpfProfile() ||
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs <= 0) {
+    ScopedApiLatency apiLatency(ApiId::POWER_CREATE_HINT_SESSION);
+    if (!isAdpfEnabled()) {
         *_aidl_return = nullptr;
         return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
     }
@@ -292,6 +386,7 @@ ndk::ScopedAStatus Power::createHintSession(int32_t tgid, int32_t uid,
 }
 
 ndk::ScopedAStatus Power::getHintSessionPreferredRate(int64_t *outNanoseconds) {
+    ScopedApiLatency apiLatency(ApiId::POWER_GET_HINT_SESSION_PREFERRED_RATE);
     *outNanoseconds = HintManager::GetInstance()->GetAdpfProfile()
                               ? HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs
                               : 0;
@@ -11,7 +11,12 @@
 #include <atomic>
 #include <memory>
 #include <thread>
+#include <vector>
 
+#include "AsyncIoExecutor.h"
+#include "BoostCoalescer.h"
+#include "CpuHeadroomEstimator.h"
+#include "HintTable.h"
 #include "disp-power/DisplayLowPower.h"
 #include "disp-power/InteractionHandler.h"
 
@@ -28,7 +33,8 @@ using ::aidl::android::hardware::power::Mode;
 
 class Power : public ::aidl::android::hardware::power::BnPower {
   public:
-    Power(std::shared_ptr<DisplayLowPower> dlpw);
+    Power(std::shared_ptr<DisplayLowPower> dlpw,
+          std::shared_ptr<CpuHeadroomEstimator> cpuHeadroom);
     ndk::ScopedAStatus setMode(Mode type, bool enabled) override;
     ndk::ScopedAStatus isModeSupported(Mode type, bool *_aidl_return) override;
     ndk::ScopedAStatus setBoost(Boost type, int32_t durationMs) override;
@@ -41,7 +47,18 @@ class Power : public ::aidl::android::hardware::power::BnPower {
     binder_status_t dump(int fd, const char **args, uint32_t numArgs) override;
 
   private:
+    void endAllHints();
+
     std::shared_ptr<DisplayLowPower> mDisplayLowPower;
+    std::shared_ptr<CpuHeadroomEstimator> mCpuHeadroom;
+    // Runs blocking sysfs and daemon side effects off the binder thread
+    AsyncIoExecutor mAsyncIo;
+    const HintTable<Mode> mModeTable;
+    const HintTable<Boost> mBoostTable;
+    // Skips timed boosts already covered by an active boost of the same type
+    BoostCoalescer mBoostCoalescer;
+    // Hints ended when entering LOW_POWER, excludes the always allowed modes
+    std::vector<std::string> mEndAllHintNames;
     std::unique_ptr<InteractionHandler> mInteractionHandler;
     std::atomic<bool> mSustainedPerfModeOn;
     std::atomic<bool> mBatterySaverOn;
@@ -18,6 +18,7 @@
 
 #include <mutex>
 
+#include "ApiStats.h"
 #include "PowerSessionManager.h"
 
 namespace aidl {
@@ -29,16 +30,50 @@ namespace pixel {
 
 using ::android::perfmgr::HintManager;
 
+static bool isAdpfEnabled() {
+    auto adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
+    return adpfConfig && adpfConfig->mReportingRateLimitNs > 0;
+}
+
+const HintTableEntry *PowerExt::lookupHint(const std::string &name) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mHintCacheMutex);
+        auto itr = mHintCache.find(name);
+        if (itr != mHintCache.end()) {
+            return &itr->second;
+        }
+    }
+    HintTableEntry entry;
+    entry.name = name;
+    entry.hintSupported = HintManager::GetInstance()->IsHintSupported(name);
+    entry.adpfSupported = HintManager::GetInstance()->IsAdpfProfileSupported(name);
+    entry.refreshRate = toAdpfRefreshRate(name);
+    if (!entry.hintSupported && !entry.adpfSupported &&
+        entry.refreshRate == AdpfRefreshRate::REFRESH_UNKNOWN) {
+        // Clients can send any string, only the known names are worth caching
+        static const HintTableEntry kUnsupportedHint;
+        return &kUnsupportedHint;
+    }
+    std::unique_lock<std::shared_mutex> lock(mHintCacheMutex);
+    return &mHintCache.emplace(name, entry).first->second;
+}
+
 ndk::ScopedAStatus PowerExt::setMode(const std::string &mode, bool enabled) {
+    ScopedApiLatency apiLatency(ApiId::EXT_SET_MODE);
     LOG(DEBUG) << "PowerExt setMode: " << mode << " to: " << enabled;
 
-    if (enabled) {
-        HintManager::GetInstance()->DoHint(mode);
-    } else {
-        HintManager::GetInstance()->EndHint(mode);
+    const HintTableEntry *entry = lookupHint(mode);
+    if (entry->hintSupported) {
+        if (enabled) {
+            HintManager::GetInstance()->DoHint(mode);
+        } else {
+            HintManager::GetInstance()->EndHint(mode);
+        }
     }
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
+    if (isAdpfEnabled()) {
+        if (enabled && entry->refreshRate != AdpfRefreshRate::REFRESH_UNKNOWN) {
+            PowerSessionManager::getInstance()->updateRefreshRate(entry->refreshRate);
+        }
         PowerSessionManager::getInstance()->updateHintMode(mode, enabled);
     }
 
@@ -46,23 +81,24 @@ ndk::ScopedAStatus PowerExt::setMode(const std::string &mode, bool enabled) {
 }
 
 ndk::ScopedAStatus PowerExt::isModeSupported(const std::string &mode, bool *_aidl_return) {
-    bool supported = HintManager::GetInstance()->IsHintSupported(mode);
-
-    if (!supported && HintManager::GetInstance()->IsAdpfProfileSupported(mode)) {
-        supported = true;
-    }
+    ScopedApiLatency apiLatency(ApiId::EXT_IS_MODE_SUPPORTED);
+    const HintTableEntry *entry = lookupHint(mode);
+    bool supported = entry->hintSupported || entry->adpfSupported;
     LOG(INFO) << "PowerExt mode " << mode << " isModeSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus PowerExt::setBoost(const std::string &boost, int32_t durationMs) {
+    ScopedApiLatency apiLatency(ApiId::EXT_SET_BOOST);
     LOG(DEBUG) << "PowerExt setBoost: " << boost << " duration: " << durationMs;
-    if (HintManager::GetInstance()->GetAdpfProfile() &&
-        HintManager::GetInstance()->GetAdpfProfile()->mReportingRateLimitNs > 0) {
+    if (isAdpfEnabled()) {
         PowerSessionManager::getInstance()->updateHintBoost(boost, durationMs);
     }
 
+    if (!lookupHint(boost)->hintSupported) {
+        return ndk::ScopedAStatus::ok();
+    }
     if (durationMs > 0) {
         HintManager::GetInstance()->DoHint(boost, std::chrono::milliseconds(durationMs));
     } else if (durationMs == 0) {
@@ -75,10 +111,9 @@ ndk::ScopedAStatus PowerExt::setBoost(const std::string &boost, int32_t duration
 }
 
 ndk::ScopedAStatus PowerExt::isBoostSupported(const std::string &boost, bool *_aidl_return) {
-    bool supported = HintManager::GetInstance()->IsHintSupported(boost);
-    if (!supported && HintManager::GetInstance()->IsAdpfProfileSupported(boost)) {
-        supported = true;
-    }
+    ScopedApiLatency apiLatency(ApiId::EXT_IS_BOOST_SUPPORTED);
+    const HintTableEntry *entry = lookupHint(boost);
+    bool supported = entry->hintSupported || entry->adpfSupported;
     LOG(INFO) << "PowerExt boost " << boost << " isBoostSupported: " << supported;
     *_aidl_return = supported;
     return ndk::ScopedAStatus::ok();
@@ -11,8 +11,11 @@
 
 #include <atomic>
 #include <memory>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
 
+#include "HintTable.h"
 #include "disp-power/DisplayLowPower.h"
 
 namespace aidl {
@@ -31,7 +34,14 @@ class PowerExt : public ::aidl::google::hardware::power::extension::pixel::BnPow
     ndk::ScopedAStatus isBoostSupported(const std::string &boost, bool *_aidl_return) override;
 
   private:
+    // Resolve support flags of an extension hint name. Names known to the
+    // powerhint config are cached after first use, entries are never erased so
+    // the returned pointer stays valid.
+    const HintTableEntry *lookupHint(const std::string &name);
+
     std::shared_ptr<DisplayLowPower> mDisplayLowPower;
+    std::shared_mutex mHintCacheMutex;
+    std::unordered_map<std::string, HintTableEntry> mHintCache;
 };
 
 }  // namespace pixel
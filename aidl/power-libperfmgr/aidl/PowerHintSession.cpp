@@ -19,8 +19,10 @@
 #include <time.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <atomic>
 
+#include "ApiStats.h"
 #include "PowerSessionManager.h"
 
 namespace aidl {
@@ -40,6 +42,12 @@ namespace {
 
 static std::atomic<int64_t> sSessionIDCounter{0};
 
+// Suppress PID boosting of frames whose threads were mostly blocked
+static const bool kSchedStatGating =
+        ::android::base::GetBoolProperty("vendor.powerhal.adpf.schedstat.enable", false);
+static const uint32_t kCpuBusyThresholdPct =
+        ::android::base::GetUintProperty("vendor.powerhal.adpf.schedstat.busy_pct", 60U);
+
 static inline int64_t ns_to_100us(int64_t ns) {
     return ns / 100000;
 }
@@ -112,11 +120,13 @@ AppHintDesc::AppHintDesc(int64_t sessionId, int32_t tgid, int32_t uid,
       tgid(tgid),
       uid(uid),
       targetNs(pTargetNs),
+      clientTargetNs(pTargetNs),
       pidSetPoint(0),
       is_active(true),
       update_count(0),
       integral_error(0),
-      previous_error(0) {}
+      previous_error(0),
+      suppressed_boost_count(0) {}
 
 PowerHintSession::PowerHintSession(int32_t tgid, int32_t uid, const std::vector<int32_t> &threadIds,
                                    int64_t durationNs)
@@ -130,17 +140,59 @@ PowerHintSession::PowerHintSession(int32_t tgid, int32_t uid, const std::vector<
     ATRACE_INT(mAppDescriptorTrace.trace_target.c_str(), mDescriptor->targetNs.count());
     ATRACE_INT(mAppDescriptorTrace.trace_active.c_str(), mDescriptor->is_active.load());
 
+    mDescriptor->stats = mPSManager->acquireSessionStats();
+    if (mPSManager->checkpointEnabled()) {
+        mDescriptor->controllerState =
+                std::make_shared<SessionCheckpoint::ControllerStateSlot>();
+    }
     mLastUpdatedTime.store(std::chrono::steady_clock::now());
-    mPSManager->addPowerSession(mIdString, mDescriptor, threadIds);
-    // init boost
     auto adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
-    mPSManager->voteSet(
-            mSessionId, AdpfHintType::ADPF_CPU_LOAD_RESET, adpfConfig->mUclampMinHigh, kUclampMax,
-            std::chrono::steady_clock::now(),
-            duration_cast<nanoseconds>(mDescriptor->targetNs * adpfConfig->mStaleTimeFactor / 2.0));
-
-    mPSManager->voteSet(mSessionId, AdpfHintType::ADPF_VOTE_DEFAULT, adpfConfig->mUclampMinInit,
-                        kUclampMax, std::chrono::steady_clock::now(), mDescriptor->targetNs);
+    auto restored = mPSManager->takeCheckpoint(tgid, uid, threadIds);
+    if (restored) {
+        // Resume where the previous power HAL instance left the controller,
+        // the accumulated error only applies to the same target. The set point
+        // is capped like the controller output, the device may be hotter now.
+        mDescriptor->pidSetPoint =
+                std::clamp(restored->state.setPoint, static_cast<int>(adpfConfig->mUclampMinLow),
+                           thermalScaledUclampMinHigh(*adpfConfig));
+        if (restored->state.clientTargetNs == durationNs) {
+            mDescriptor->integral_error = restored->state.integralError;
+            mDescriptor->previous_error = restored->state.previousError;
+        }
+        if (mDescriptor->controllerState) {
+            mDescriptor->controllerState->store(
+                    {mDescriptor->clientTargetNs.count(), mDescriptor->pidSetPoint,
+                     mDescriptor->integral_error, mDescriptor->previous_error});
+        }
+        mPSManager->addPowerSession(mIdString, mDescriptor, threadIds,
+                                    {{AdpfHintType::ADPF_VOTE_DEFAULT, mDescriptor->pidSetPoint,
+                                      kUclampMax, mDescriptor->targetNs}});
+        const auto timeNow = std::chrono::steady_clock::now();
+        const int64_t timeNowNs =
+                duration_cast<nanoseconds>(timeNow.time_since_epoch()).count();
+        for (const auto &vote : restored->votes) {
+            // The default vote follows the restored set point
+            if (vote.voteId <= static_cast<int32_t>(AdpfHintType::ADPF_VOTE_DEFAULT) ||
+                vote.voteId > static_cast<int32_t>(AdpfHintType::ADPF_VOTE_POWER_EFFICIENCY)) {
+                continue;
+            }
+            mPSManager->voteSet(mSessionId, static_cast<AdpfHintType>(vote.voteId),
+                                vote.uclampMin, vote.uclampMax, timeNow,
+                                nanoseconds(vote.deadlineNs - timeNowNs));
+        }
+        ALOGI("PowerHintSession %s restored set point %d and %zu votes", mIdString.c_str(),
+              mDescriptor->pidSetPoint, restored->votes.size());
+    } else {
+        // Add the session together with its init boost votes
+        mPSManager->addPowerSession(
+                mIdString, mDescriptor, threadIds,
+                {{AdpfHintType::ADPF_CPU_LOAD_RESET, static_cast<int>(adpfConfig->mUclampMinHigh),
+                  kUclampMax,
+                  frameAlignedDuration(duration_cast<nanoseconds>(
+                          mDescriptor->targetNs * adpfConfig->mStaleTimeFactor / 2.0))},
+                 {AdpfHintType::ADPF_VOTE_DEFAULT, static_cast<int>(adpfConfig->mUclampMinInit),
+                  kUclampMax, mDescriptor->targetNs}});
+    }
     ALOGV("PowerHintSession created: %s", mDescriptor->toString().c_str());
 }
 
@@ -162,12 +214,76 @@ void PowerHintSession::updatePidSetPoint(int pidSetPoint, bool updateVote) {
     mDescriptor->pidSetPoint = pidSetPoint;
     if (updateVote) {
         auto adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
-        mPSManager->voteSet(
-                mSessionId, AdpfHintType::ADPF_VOTE_DEFAULT, pidSetPoint, kUclampMax,
-                std::chrono::steady_clock::now(),
-                duration_cast<nanoseconds>(mDescriptor->targetNs * adpfConfig->mStaleTimeFactor));
+        mPSManager->voteSet(mSessionId, AdpfHintType::ADPF_VOTE_DEFAULT, pidSetPoint, kUclampMax,
+                            std::chrono::steady_clock::now(),
+                            frameAlignedDuration(duration_cast<nanoseconds>(
+                                    mDescriptor->targetNs * adpfConfig->mStaleTimeFactor)));
     }
     ATRACE_INT(mAppDescriptorTrace.trace_min.c_str(), pidSetPoint);
+    mDescriptor->stats->uclampMin.record(pidSetPoint);
+    if (mDescriptor->controllerState) {
+        // Only this session's slot is touched here, the checkpoint worker
+        // picks the state up on its next run
+        mDescriptor->controllerState->store({mDescriptor->clientTargetNs.count(), pidSetPoint,
+                                             mDescriptor->integral_error,
+                                             mDescriptor->previous_error});
+        mPSManager->scheduleCheckpoint(std::chrono::steady_clock::now());
+    }
+    updatePlacementBand(mPSManager->nextPlacementBand(mDescriptor->placementBand, pidSetPoint));
+}
+
+void PowerHintSession::updatePlacementBand(int band) {
+    if (band != mDescriptor->placementBand) {
+        mDescriptor->placementBand = band;
+        mPSManager->movePlacementBand(mSessionId, band);
+    }
+}
+
+nanoseconds PowerHintSession::frameAlignedDuration(nanoseconds duration) {
+    const int vsyncMultiple = mPSManager->getVsyncMultiple(mDescriptor->clientTargetNs);
+    if (vsyncMultiple != mTracedVsyncMultiple) {
+        mTracedVsyncMultiple = vsyncMultiple;
+        ATRACE_INT(mAppDescriptorTrace.trace_vsync_multiple.c_str(), vsyncMultiple);
+    }
+    if (vsyncMultiple == 0) {
+        return duration;
+    }
+    return mPSManager->snapToVsync(duration);
+}
+
+int PowerHintSession::thermalScaledUclampMinHigh(const AdpfConfig &adpfConfig,
+                                                 std::optional<double> thermalScale) {
+    const double scale =
+            thermalScale.value_or(mPSManager->getThermalScale(std::chrono::steady_clock::now()));
+    ATRACE_INT(mAppDescriptorTrace.trace_thermal_scale.c_str(), static_cast<int>(scale * 100));
+    const int scaled = static_cast<int>(adpfConfig.mUclampMinHigh * scale);
+    return std::max(static_cast<int>(adpfConfig.mUclampMinLow), scaled);
+}
+
+int64_t PowerHintSession::gateBoostByCpuBusy(int64_t output,
+                                             const std::vector<WorkDuration> &actualDurations) {
+    if (!kSchedStatGating) {
+        return output;
+    }
+    int64_t workNs = 0;
+    for (const auto &duration : actualDurations) {
+        workNs += std::max<int64_t>(duration.durationNanos, 0);
+    }
+    mPSManager->getTaskIds(mSessionId, &mTaskIdsBuffer);
+    const auto busyFraction = mSchedStatSampler.sampleBusyFraction(mTaskIdsBuffer, workNs);
+    if (!busyFraction.has_value()) {
+        return output;
+    }
+    ATRACE_INT(mAppDescriptorTrace.trace_cpu_busy.c_str(),
+               static_cast<int>(busyFraction.value() * 100));
+    // Raising uclamp.min does not help frames that were waiting on I/O or fences
+    if (output > 0 && busyFraction.value() * 100 < kCpuBusyThresholdPct) {
+        mDescriptor->suppressed_boost_count++;
+        ATRACE_INT(mAppDescriptorTrace.trace_boost_suppressed.c_str(),
+                   mDescriptor->suppressed_boost_count);
+        return 0;
+    }
+    return output;
 }
 
 void PowerHintSession::tryToSendPowerHint(std::string hint) {
@@ -179,48 +295,50 @@ void PowerHintSession::tryToSendPowerHint(std::string hint) {
     }
 }
 
-void PowerHintSession::dumpToStream(std::ostream &stream) {
-    stream << "ID.Min.Act.Timeout(" << mIdString;
-    stream << ", " << mDescriptor->pidSetPoint;
-    stream << ", " << mDescriptor->is_active;
-    stream << ", " << isTimeout() << ")";
-}
-
 ndk::ScopedAStatus PowerHintSession::pause() {
+    ScopedApiLatency apiLatency(ApiId::SESSION_PAUSE);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (!mDescriptor->is_active.load())
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     // Reset to default uclamp value.
     mDescriptor->is_active.store(false);
     mPSManager->pause(mSessionId);
+    // A paused session keeps no cluster placement
+    updatePlacementBand(0);
     ATRACE_INT(mAppDescriptorTrace.trace_active.c_str(), false);
     ATRACE_INT(mAppDescriptorTrace.trace_min.c_str(), 0);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus PowerHintSession::resume() {
+    ScopedApiLatency apiLatency(ApiId::SESSION_RESUME);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (mDescriptor->is_active.load())
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     mDescriptor->is_active.store(true);
     // resume boost
     mPSManager->resume(mSessionId);
+    updatePlacementBand(mPSManager->nextPlacementBand(0, mDescriptor->pidSetPoint));
     ATRACE_INT(mAppDescriptorTrace.trace_active.c_str(), true);
     ATRACE_INT(mAppDescriptorTrace.trace_min.c_str(), mDescriptor->pidSetPoint);
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus PowerHintSession::close() {
+    ScopedApiLatency apiLatency(ApiId::SESSION_CLOSE);
     bool sessionClosedExpectedToBe = false;
     if (!mSessionClosed.compare_exchange_strong(sessionClosedExpectedToBe, true)) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     // Remove the session from PowerSessionManager first to avoid racing.
     mPSManager->removePowerSession(mSessionId);
     mDescriptor->is_active.store(false);
@@ -229,14 +347,17 @@ ndk::ScopedAStatus PowerHintSession::close() {
 }
 
 ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDurationNanos) {
+    ScopedApiLatency apiLatency(ApiId::SESSION_UPDATE_TARGET_WORK_DURATION);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (targetDurationNanos <= 0) {
         ALOGE("Error: targetDurationNanos(%" PRId64 ") should bigger than 0", targetDurationNanos);
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
+    mDescriptor->clientTargetNs = std::chrono::nanoseconds(targetDurationNanos);
     targetDurationNanos =
             targetDurationNanos * HintManager::GetInstance()->GetAdpfProfile()->mTargetTimeFactor;
 
@@ -250,10 +371,12 @@ ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDura
 
 ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         const std::vector<WorkDuration> &actualDurations) {
+    ScopedApiLatency apiLatency(ApiId::SESSION_REPORT_ACTUAL_WORK_DURATION);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (mDescriptor->targetNs.count() == 0LL) {
         ALOGE("Expect to call updateTargetWorkDuration() first.");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
@@ -268,7 +391,7 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
     }
     auto adpfConfig = HintManager::GetInstance()->GetAdpfProfile();
     mDescriptor->update_count++;
-    bool isFirstFrame = isTimeout();
+    bool isFirstFrame = isTimeoutLocked();
     ATRACE_INT(mAppDescriptorTrace.trace_batch_size.c_str(), actualDurations.size());
     ATRACE_INT(mAppDescriptorTrace.trace_actl_last.c_str(), actualDurations.back().durationNanos);
     ATRACE_INT(mAppDescriptorTrace.trace_target.c_str(), mDescriptor->targetNs.count());
@@ -277,8 +400,21 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
                actualDurations.back().durationNanos - mDescriptor->targetNs.count() > 0);
     ATRACE_INT(mAppDescriptorTrace.trace_is_first_frame.c_str(), (isFirstFrame) ? (1) : (0));
 
-    mLastUpdatedTime.store(std::chrono::steady_clock::now());
+    const auto timeNow = std::chrono::steady_clock::now();
+    mDescriptor->stats->recordReport(actualDurations.size(), timeNow);
+    const int64_t clientTargetNs = mDescriptor->clientTargetNs.count();
+    for (const auto &duration : actualDurations) {
+        if (duration.durationNanos > 0) {
+            mDescriptor->stats->actualToTargetPct.record(duration.durationNanos * 100 /
+                                                         clientTargetNs);
+        }
+    }
+
+    mLastUpdatedTime.store(timeNow);
     if (isFirstFrame) {
+        // The stale timeout moved the session to band 0, the set point below
+        // picks its band again from there
+        updatePlacementBand(0);
         if (isAppSession()) {
             tryToSendPowerHint("ADPF_FIRST_FRAME");
         }
@@ -288,16 +424,22 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
 
     mPSManager->disableBoosts(mSessionId);
 
+    const double thermalScale = mPSManager->getThermalScale(std::chrono::steady_clock::now());
+    const int uclampMinHigh = thermalScaledUclampMinHigh(*adpfConfig, thermalScale);
     if (!adpfConfig->mPidOn) {
-        updatePidSetPoint(adpfConfig->mUclampMinHigh);
+        updatePidSetPoint(uclampMinHigh);
         return ndk::ScopedAStatus::ok();
     }
 
-    int64_t output = convertWorkDurationToBoostByPid(actualDurations);
+    int64_t output =
+            gateBoostByCpuBusy(convertWorkDurationToBoostByPid(actualDurations), actualDurations);
+    // Near throttling, grow the boost more slowly
+    if (output > 0) {
+        output = static_cast<int64_t>(output * thermalScale);
+    }
 
     // Apply to all the threads in the group
-    int next_min = std::min(static_cast<int>(adpfConfig->mUclampMinHigh),
-                            mDescriptor->pidSetPoint + static_cast<int>(output));
+    int next_min = std::min(uclampMinHigh, mDescriptor->pidSetPoint + static_cast<int>(output));
     next_min = std::max(static_cast<int>(adpfConfig->mUclampMinLow), next_min);
 
     updatePidSetPoint(next_min);
@@ -305,10 +447,12 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
 }
 
 ndk::ScopedAStatus PowerHintSession::sendHint(SessionHint hint) {
+    ScopedApiLatency apiLatency(ApiId::SESSION_SEND_HINT);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (mDescriptor->targetNs.count() == 0LL) {
         ALOGE("Expect to call updateTargetWorkDuration() first.");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
@@ -319,8 +463,9 @@ ndk::ScopedAStatus PowerHintSession::sendHint(SessionHint hint) {
         case SessionHint::CPU_LOAD_UP:
             updatePidSetPoint(mDescriptor->pidSetPoint);
             mPSManager->voteSet(mSessionId, AdpfHintType::ADPF_CPU_LOAD_UP,
-                                adpfConfig->mUclampMinHigh, kUclampMax,
-                                std::chrono::steady_clock::now(), mDescriptor->targetNs * 2);
+                                thermalScaledUclampMinHigh(*adpfConfig), kUclampMax,
+                                std::chrono::steady_clock::now(),
+                                frameAlignedDuration(mDescriptor->targetNs * 2));
             break;
         case SessionHint::CPU_LOAD_DOWN:
             updatePidSetPoint(adpfConfig->mUclampMinLow);
@@ -330,17 +475,19 @@ ndk::ScopedAStatus PowerHintSession::sendHint(SessionHint hint) {
                                        static_cast<uint32_t>(mDescriptor->pidSetPoint)),
                               false);
             mPSManager->voteSet(mSessionId, AdpfHintType::ADPF_CPU_LOAD_RESET,
-                                adpfConfig->mUclampMinHigh, kUclampMax,
+                                thermalScaledUclampMinHigh(*adpfConfig), kUclampMax,
                                 std::chrono::steady_clock::now(),
-                                duration_cast<nanoseconds>(mDescriptor->targetNs *
-                                                           adpfConfig->mStaleTimeFactor / 2.0));
+                                frameAlignedDuration(duration_cast<nanoseconds>(
+                                        mDescriptor->targetNs * adpfConfig->mStaleTimeFactor /
+                                        2.0)));
             break;
         case SessionHint::CPU_LOAD_RESUME:
             mPSManager->voteSet(mSessionId, AdpfHintType::ADPF_CPU_LOAD_RESUME,
                                 mDescriptor->pidSetPoint, kUclampMax,
                                 std::chrono::steady_clock::now(),
-                                duration_cast<nanoseconds>(mDescriptor->targetNs *
-                                                           adpfConfig->mStaleTimeFactor / 2.0));
+                                frameAlignedDuration(duration_cast<nanoseconds>(
+                                        mDescriptor->targetNs * adpfConfig->mStaleTimeFactor /
+                                        2.0)));
             break;
         default:
             ALOGE("Error: hint is invalid");
@@ -354,10 +501,12 @@ ndk::ScopedAStatus PowerHintSession::sendHint(SessionHint hint) {
 }
 
 ndk::ScopedAStatus PowerHintSession::setMode(SessionMode mode, bool enabled) {
+    ScopedApiLatency apiLatency(ApiId::SESSION_SET_MODE);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
 
     switch (mode) {
         case SessionMode::POWER_EFFICIENCY:
@@ -374,10 +523,12 @@ ndk::ScopedAStatus PowerHintSession::setMode(SessionMode mode, bool enabled) {
 }
 
 ndk::ScopedAStatus PowerHintSession::setThreads(const std::vector<int32_t> &threadIds) {
+    ScopedApiLatency apiLatency(ApiId::SESSION_SET_THREADS);
     if (mSessionClosed) {
         ALOGE("Error: session is dead");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
     if (threadIds.empty()) {
         ALOGE("Error: threadIds should not be empty");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
@@ -394,7 +545,10 @@ std::string AppHintDesc::toString() const {
     out.append(
             StringPrintf("  duration: %" PRId64 " ns\n", static_cast<int64_t>(targetNs.count())));
     out.append(StringPrintf("  uclamp.min: %d \n", pidSetPoint));
+    out.append(StringPrintf("  client duration: %" PRId64 " ns\n",
+                            static_cast<int64_t>(clientTargetNs.count())));
     out.append(StringPrintf("  uid: %d, tgid: %d\n", uid, tgid));
+    out.append(StringPrintf("  suppressed boosts: %" PRIu64 "\n", suppressed_boost_count));
     return out;
 }
 
@@ -403,12 +557,17 @@ bool PowerHintSession::isActive() {
 }
 
 bool PowerHintSession::isTimeout() {
+    std::lock_guard<std::mutex> lock(mPowerHintSessionLock);
+    return isTimeoutLocked();
+}
+
+bool PowerHintSession::isTimeoutLocked() {
     auto now = std::chrono::steady_clock::now();
     time_point<steady_clock> staleTime =
             mLastUpdatedTime.load() +
-            nanoseconds(static_cast<int64_t>(
+            frameAlignedDuration(nanoseconds(static_cast<int64_t>(
                     mDescriptor->targetNs.count() *
-                    HintManager::GetInstance()->GetAdpfProfile()->mStaleTimeFactor));
+                    HintManager::GetInstance()->GetAdpfProfile()->mStaleTimeFactor)));
     return now >= staleTime;
 }
 
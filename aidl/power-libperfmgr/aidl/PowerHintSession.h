@@ -10,13 +10,20 @@
 #include <aidl/android/hardware/power/SessionHint.h>
 #include <aidl/android/hardware/power/SessionMode.h>
 #include <aidl/android/hardware/power/WorkDuration.h>
+#include <perfmgr/AdpfConfig.h>
 #include <utils/Looper.h>
 #include <utils/Thread.h>
 
 #include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 
 #include "AppDescriptorTrace.h"
+#include "SchedStatSampler.h"
+#include "SessionCheckpoint.h"
+#include "SessionStats.h"
 
 namespace aidl {
 namespace google {
@@ -50,6 +57,8 @@ struct AppHintDesc {
     const int32_t tgid;
     const int32_t uid;
     nanoseconds targetNs;
+    // Target as reported by the client, before mTargetTimeFactor
+    nanoseconds clientTargetNs;
     int pidSetPoint;
     // status
     std::atomic<bool> is_active;
@@ -57,12 +66,22 @@ struct AppHintDesc {
     uint64_t update_count;
     int64_t integral_error;
     int64_t previous_error;
+    // schedstat gating
+    uint64_t suppressed_boost_count;
+    // Cluster placement band of the last set point
+    int placementBand{0};
+    // Last PID state for checkpointing, null when not checkpointing
+    std::shared_ptr<SessionCheckpoint::ControllerStateSlot> controllerState;
+    // Distributions shown in dumpsys, shared with PowerSessionManager
+    std::shared_ptr<SessionStats> stats;
 };
 
 // The Power Hint Session is responsible for providing an
 // interface for creating, updating, and closing power hints
 // for a Session. Each sesion that is mapped to multiple
 // threads (or task ids).
+// Binder calls may arrive concurrently from the binder thread pool, all
+// mutable per-session state is guarded by mPowerHintSessionLock.
 class PowerHintSession : public BnPowerHintSession {
   public:
     explicit PowerHintSession(int32_t tgid, int32_t uid, const std::vector<int32_t> &threadIds,
@@ -81,14 +100,26 @@ class PowerHintSession : public BnPowerHintSession {
     bool isTimeout();
     // Is hint session for a user application
     bool isAppSession();
-    void dumpToStream(std::ostream &stream);
 
   private:
+    // Helpers below must be called with mPowerHintSessionLock held
     void tryToSendPowerHint(std::string hint);
     void updatePidSetPoint(int pidSetPoint, bool updateVote = true);
+    // Move the session threads to band if the session is not already there
+    void updatePlacementBand(int band);
     int64_t convertWorkDurationToBoostByPid(const std::vector<WorkDuration> &actualDurations);
+    bool isTimeoutLocked();
+    // Snap a timeout to whole frames when the session target is frame paced
+    nanoseconds frameAlignedDuration(nanoseconds duration);
+    // Drop a positive PID output when the session threads were not CPU bound
+    int64_t gateBoostByCpuBusy(int64_t output, const std::vector<WorkDuration> &actualDurations);
+    // mUclampMinHigh scaled down by the thermal headroom, never below mUclampMinLow
+    int thermalScaledUclampMinHigh(const ::android::perfmgr::AdpfConfig &adpfConfig,
+                                   std::optional<double> thermalScale = std::nullopt);
     // Data
     sp<PowerSessionManager> mPSManager;
+    // Serialize concurrent binder calls on this session
+    std::mutex mPowerHintSessionLock;
     int64_t mSessionId = 0;
     std::string mIdString;
     std::shared_ptr<AppHintDesc> mDescriptor;
@@ -100,8 +131,13 @@ class PowerHintSession : public BnPowerHintSession {
     std::unordered_map<std::string, std::optional<bool>> mSupportedHints;
     // Last session hint sent, used for logging
     int mLastHintSent = -1;
+    // Last vsync multiple traced, frameAlignedDuration runs on every stale check
+    int mTracedVsyncMultiple = -1;
     // Use the value of the last enum in enum_range +1 as array size
     std::array<bool, enum_size<SessionMode>()> mModes{};
+    // CPU busy sampling of the session threads
+    SchedStatSampler mSchedStatSampler;
+    std::vector<pid_t> mTaskIdsBuffer;
 };
 
 }  // namespace pixel
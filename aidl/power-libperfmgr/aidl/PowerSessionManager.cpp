@@ -10,6 +10,7 @@
 #include "PowerSessionManager.h"
 
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <log/log.h>
 #include <perfmgr/HintManager.h>
@@ -18,6 +19,8 @@
 #include <sys/syscall.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
+
 #include "AdpfTypes.h"
 
 namespace aidl {
@@ -27,11 +30,18 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+using ::android::base::StringAppendF;
 using ::android::base::StringPrintf;
 using ::android::perfmgr::AdpfConfig;
 using ::android::perfmgr::HintManager;
 
 namespace {
+static const std::chrono::milliseconds kAutoDiscoverInterval(::android::base::GetUintProperty(
+        "vendor.powerhal.adpf.autodiscover.interval_ms", /*default*/ 1000U));
+// Batches the PID updates of all sessions into one checkpoint write
+static const std::chrono::milliseconds kCheckpointInterval(::android::base::GetUintProperty(
+        "vendor.powerhal.adpf.checkpoint.interval_ms", /*default*/ 1000U));
+
 /* there is no glibc or bionic wrapper */
 struct sched_attr {
     __u32 size;
@@ -58,7 +68,7 @@ static int set_uclamp_min(int tid, int min) {
     attr.sched_flags = (SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP_MIN);
     attr.sched_util_min = min;
 
-    const int ret = syscall(__NR_sched_setattr, tid, attr, 0);
+    const int ret = syscall(__NR_sched_setattr, tid, &attr, 0);
     if (ret) {
         ALOGW("sched_setattr failed for thread %d, err=%d", tid, errno);
         return errno;
@@ -68,15 +78,7 @@ static int set_uclamp_min(int tid, int min) {
 }  // namespace
 
 void PowerSessionManager::updateHintMode(const std::string &mode, bool enabled) {
-    if (enabled && mode.compare(0, 8, "REFRESH_") == 0) {
-        if (mode.compare("REFRESH_120FPS") == 0) {
-            mDisplayRefreshRate = 120;
-        } else if (mode.compare("REFRESH_90FPS") == 0) {
-            mDisplayRefreshRate = 90;
-        } else if (mode.compare("REFRESH_60FPS") == 0) {
-            mDisplayRefreshRate = 60;
-        }
-    }
+    ALOGV("PowerSessionManager::updateHintMode: mode: %s, enabled: %d", mode.c_str(), enabled);
     if (HintManager::GetInstance()->GetAdpfProfile()) {
         HintManager::GetInstance()->SetAdpfProfile(mode);
     }
@@ -88,13 +90,69 @@ void PowerSessionManager::updateHintBoost(const std::string &boost, int32_t dura
           durationMs);
 }
 
+void PowerSessionManager::updateRefreshRate(AdpfRefreshRate refreshRate) {
+    const int hz = static_cast<int>(refreshRate);
+    if (hz <= 0) {
+        return;
+    }
+    mDisplayRefreshRate = hz;
+    mVsyncPeriodNs = std::nano::den / hz;
+    ATRACE_INT("adpf.refresh_rate", hz);
+}
+
 int PowerSessionManager::getDisplayRefreshRate() {
     return mDisplayRefreshRate;
 }
 
+std::chrono::nanoseconds PowerSessionManager::snapToVsync(
+        std::chrono::nanoseconds duration) const {
+    const int64_t periodNs = mVsyncPeriodNs;
+    if (periodNs <= 0 || duration.count() <= 0) {
+        return duration;
+    }
+    const int64_t frames = (duration.count() + periodNs - 1) / periodNs;
+    return std::chrono::nanoseconds(frames * periodNs);
+}
+
+double PowerSessionManager::getThermalScale(std::chrono::steady_clock::time_point timePoint) {
+    return mThermalHeadroomMonitor.getScale(timePoint);
+}
+
+ThermalHeadroomMonitor::Config PowerSessionManager::getThermalConfig() {
+    ThermalHeadroomMonitor::Config config;
+    const std::string zones =
+            ::android::base::GetProperty("vendor.powerhal.adpf.thermal.zones", "");
+    if (!zones.empty()) {
+        config.zoneTypes = ::android::base::Split(zones, ",");
+    }
+    config.throttleMc =
+            ::android::base::GetIntProperty("vendor.powerhal.adpf.thermal.throttle_mc", 0);
+    config.windowMc =
+            ::android::base::GetIntProperty("vendor.powerhal.adpf.thermal.window_mc", 10000);
+    config.minScale =
+            ::android::base::GetUintProperty("vendor.powerhal.adpf.thermal.min_pct", 50U, 100U) /
+            100.0;
+    return config;
+}
+
+int PowerSessionManager::getVsyncMultiple(std::chrono::nanoseconds duration) const {
+    // Client targets are derived from the vsync period but carry rounding,
+    // accept 1% of a frame period as jitter
+    const int64_t periodNs = mVsyncPeriodNs;
+    if (periodNs <= 0 || duration.count() <= 0) {
+        return 0;
+    }
+    const int64_t frames = (duration.count() + periodNs / 2) / periodNs;
+    if (frames == 0 || std::abs(duration.count() - frames * periodNs) > periodNs / 100) {
+        return 0;
+    }
+    return static_cast<int>(frames);
+}
+
 void PowerSessionManager::addPowerSession(const std::string &idString,
                                           const std::shared_ptr<AppHintDesc> &sessionDescriptor,
-                                          const std::vector<int32_t> &threadIds) {
+                                          const std::vector<int32_t> &threadIds,
+                                          std::initializer_list<InitialVote> initialVotes) {
     if (!sessionDescriptor) {
         ALOGE("sessionDescriptor is null. PowerSessionManager failed to add power session: %s",
               idString.c_str());
@@ -110,54 +168,97 @@ void PowerSessionManager::addPowerSession(const std::string &idString,
     sve.isActive = sessionDescriptor->is_active;
     sve.isAppSession = sessionDescriptor->uid >= AID_APP_START;
     sve.lastUpdatedTime = timeNow;
+    sve.stats = sessionDescriptor->stats;
+    sve.controllerState = sessionDescriptor->controllerState;
+    sve.clientTaskIds = threadIds;
     sve.votes = std::make_shared<Votes>();
     sve.votes->add(
             static_cast<std::underlying_type_t<AdpfHintType>>(AdpfHintType::ADPF_VOTE_DEFAULT),
             pidVoteRange);
+    for (const auto &vote : initialVotes) {
+        sve.votes->add(static_cast<std::underlying_type_t<AdpfHintType>>(vote.voteId),
+                       VoteRange(true, vote.uclampMin, vote.uclampMax, timeNow, vote.durationNs));
+    }
+
+    // All threads are new to the session, mark them before their uclamp is set
+    const size_t failed = applyTaskProfile(threadIds, "ResetUclampGrp");
+    ALOGE_IF(failed > 0, "Failed to set ResetUclampGrp task profile for %zu threads", failed);
 
+    std::vector<pid_t> addedThreads;
+    std::vector<pid_t> removedThreads;
     bool addedRes = false;
+    std::optional<std::chrono::steady_clock::time_point> nextEvaluation;
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         addedRes = mSessionTaskMap.add(sessionDescriptor->sessionId, sve, {});
+        if (addedRes) {
+            mSessionTaskMap.replace(sessionDescriptor->sessionId, threadIds, &addedThreads,
+                                    &removedThreads);
+            applyUclampAndRebalanceLocked(sessionDescriptor->sessionId, timeNow);
+            mVoteUpdates += initialVotes.size();
+            nextEvaluation = updateNextEvaluationLocked(
+                    mSessionTaskMap.findSession(sessionDescriptor->sessionId), timeNow);
+        }
     }
     if (!addedRes) {
         ALOGE("sessionTaskMap failed to add power session: %" PRId64, sessionDescriptor->sessionId);
+        return;
     }
 
-    setThreadsFromPowerSession(sessionDescriptor->sessionId, threadIds);
+    queueEvaluation(sessionDescriptor->sessionId, nextEvaluation);
+    updateUniversalBoostMode();
+
+    if (mTaskDiscovery.enabled() && sve.isAppSession) {
+        EventSessionDiscovery eDiscovery;
+        eDiscovery.sessionId = sessionDescriptor->sessionId;
+        mEventSessionDiscoveryWorker.schedule(eDiscovery, timeNow + kAutoDiscoverInterval,
+                                              eDiscovery.sessionId);
+    }
+    scheduleCheckpoint(timeNow);
 }
 
 void PowerSessionManager::removePowerSession(int64_t sessionId) {
-    // To remove a session we also need to undo the effects the session
-    // has on currently enabled votes which means setting vote to inactive
-    // and then forceing a uclamp update to occur
-    forceSessionActive(sessionId, false);
-
     std::vector<pid_t> addedThreads;
     std::vector<pid_t> removedThreads;
+    int placementBand = 0;
 
     {
-        // Wait till end to remove session because it needs to be around for apply U clamp
-        // to work above since applying the uclamp needs a valid session id
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+        if (nullptr == sessValPtr) {
+            return;
+        }
+        // Undo the effects of the session votes while its tasks are still
+        // linked, then drop the session
+        sessValPtr->isActive = false;
+        placementBand = sessValPtr->placementBand;
+        applyUclampAndRebalanceLocked(sessionId, std::chrono::steady_clock::now());
         mSessionTaskMap.replace(sessionId, {}, &addedThreads, &removedThreads);
         mSessionTaskMap.remove(sessionId);
     }
 
-    for (auto tid : removedThreads) {
-        if (!SetTaskProfiles(tid, {"NoResetUclampGrp"})) {
-            ALOGE("Failed to set NoResetUclampGrp task profile for tid:%d", tid);
-        }
+    const size_t failed = applyTaskProfile(removedThreads, "NoResetUclampGrp");
+    ALOGE_IF(failed > 0, "Failed to set NoResetUclampGrp task profile for %zu threads", failed);
+    if (placementBand > 0) {
+        applyTaskProfile(removedThreads, mClusterPlacement.getProfile(0));
     }
+    updateUniversalBoostMode();
+    scheduleCheckpoint(std::chrono::steady_clock::now());
 }
 
 void PowerSessionManager::setThreadsFromPowerSession(int64_t sessionId,
                                                      const std::vector<int32_t> &threadIds) {
     std::vector<pid_t> addedThreads;
     std::vector<pid_t> removedThreads;
+    int placementBand = 0;
     forceSessionActive(sessionId, false);
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+        if (nullptr != sessValPtr) {
+            sessValPtr->clientTaskIds = threadIds;
+            placementBand = sessValPtr->placementBand;
+        }
         mSessionTaskMap.replace(sessionId, threadIds, &addedThreads, &removedThreads);
     }
     for (auto tid : addedThreads) {
@@ -170,13 +271,160 @@ void PowerSessionManager::setThreadsFromPowerSession(int64_t sessionId,
             ALOGE("Failed to set NoResetUclampGrp task profile for tid:%d", tid);
         }
     }
+    if (placementBand > 0) {
+        applyTaskProfile(addedThreads, mClusterPlacement.getProfile(placementBand));
+        applyTaskProfile(removedThreads, mClusterPlacement.getProfile(0));
+    }
     forceSessionActive(sessionId, true);
 }
 
+void PowerSessionManager::movePlacementBand(int64_t sessionId, int band) {
+    std::vector<pid_t> taskIds;
+    int prevBand = 0;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+        if (nullptr == sessValPtr || sessValPtr->placementBand == band) {
+            return;
+        }
+        prevBand = sessValPtr->placementBand;
+        sessValPtr->placementBand = band;
+        const auto &linkedTasks = mSessionTaskMap.getTaskIds(sessionId);
+        taskIds.assign(linkedTasks.begin(), linkedTasks.end());
+    }
+    ATRACE_NAME(StringPrintf("placement %d->%d", prevBand, band).c_str());
+    const size_t failed = applyTaskProfile(taskIds, mClusterPlacement.getProfile(band));
+    std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+    mClusterPlacement.recordTransition(prevBand, band, taskIds.size(), failed);
+}
+
+std::optional<SessionCheckpoint::Record> PowerSessionManager::takeCheckpoint(
+        int32_t tgid, int32_t uid, const std::vector<int32_t> &threadIds) {
+    if (!mSessionCheckpoint.enabled()) {
+        return std::nullopt;
+    }
+    return mSessionCheckpoint.take(tgid, uid, threadIds, std::chrono::steady_clock::now());
+}
+
+void PowerSessionManager::scheduleCheckpoint(std::chrono::steady_clock::time_point timePoint) {
+    if (!mSessionCheckpoint.enabled() || mCheckpointScheduled.exchange(true)) {
+        return;
+    }
+    mEventCheckpointWorker.schedule(EventCheckpoint{}, timePoint + kCheckpointInterval);
+}
+
+void PowerSessionManager::handleEvent(const EventCheckpoint &) {
+    ATRACE_CALL();
+    // Changes from now on need another checkpoint
+    mCheckpointScheduled.store(false);
+    const auto timeNow = std::chrono::steady_clock::now();
+    std::vector<SessionCheckpoint::Record> records;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        mSessionTaskMap.forEachSessionValTasks(
+                [&](auto, const auto &sessionVal, const auto &tasks) {
+                    SessionCheckpoint::Record record;
+                    record.tgid = sessionVal.tgid;
+                    record.uid = sessionVal.uid;
+                    if (sessionVal.controllerState) {
+                        record.state = sessionVal.controllerState->load();
+                    }
+                    record.tids.assign(tasks.begin(), tasks.end());
+                    if (sessionVal.votes) {
+                        sessionVal.votes->forEachInRange(
+                                timeNow, [&](int voteId, const VoteRange &vote) {
+                                    record.votes.push_back(
+                                            {voteId, vote.uclampMin(), vote.uclampMax(),
+                                             std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                     (vote.startTime() + vote.durationNs())
+                                                             .time_since_epoch())
+                                                     .count()});
+                                });
+                    }
+                    records.push_back(std::move(record));
+                });
+    }
+    mSessionCheckpoint.write(records);
+}
+
+SessionCheckpoint::Config PowerSessionManager::getCheckpointConfig() {
+    SessionCheckpoint::Config config;
+    config.path = ::android::base::GetProperty(kPowerHalAdpfCheckpointPath, "");
+    config.maxAge = std::chrono::milliseconds(::android::base::GetUintProperty(
+            "vendor.powerhal.adpf.checkpoint.max_age_ms", 5000U));
+    return config;
+}
+
+size_t PowerSessionManager::applyTaskProfile(const std::vector<pid_t> &taskIds,
+                                             const std::string &profile) {
+    size_t failed = 0;
+    for (auto tid : taskIds) {
+        if (!SetTaskProfiles(tid, {profile}, true)) {
+            ALOGV("Failed to set %s task profile for tid:%d", profile.c_str(), tid);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+ClusterPlacement PowerSessionManager::makeClusterPlacement() {
+    const std::string profiles =
+            ::android::base::GetProperty("vendor.powerhal.adpf.placement.profiles", "");
+    const std::string thresholds =
+            ::android::base::GetProperty("vendor.powerhal.adpf.placement.thresholds", "");
+    std::vector<int> bandThresholds;
+    if (!profiles.empty() && !thresholds.empty()) {
+        for (const auto &threshold : ::android::base::Split(thresholds, ",")) {
+            int value = 0;
+            if (!::android::base::ParseInt(::android::base::Trim(threshold), &value, kUclampMin,
+                                           kUclampMax)) {
+                ALOGE("Invalid placement threshold: %s", threshold.c_str());
+                bandThresholds.clear();
+                break;
+            }
+            bandThresholds.push_back(value);
+        }
+    }
+    return ClusterPlacement(
+            ::android::base::Split(profiles, ","), bandThresholds,
+            ::android::base::GetIntProperty("vendor.powerhal.adpf.placement.hysteresis", 64));
+}
+
+std::shared_ptr<SessionStats> PowerSessionManager::acquireSessionStats() {
+    constexpr size_t kMaxPooledSessionStats = 16;
+    std::unique_ptr<SessionStats> stats;
+    {
+        std::lock_guard<std::mutex> lock(mSessionStatsPoolMutex);
+        if (!mSessionStatsPool.empty()) {
+            stats = std::move(mSessionStatsPool.back());
+            mSessionStatsPool.pop_back();
+        }
+    }
+    if (!stats) {
+        stats = std::make_unique<SessionStats>();
+    }
+    // Singleton is never destroyed, the deleter can safely refer to it
+    return std::shared_ptr<SessionStats>(stats.release(), [this](SessionStats *released) {
+        released->reset();
+        std::lock_guard<std::mutex> lock(mSessionStatsPoolMutex);
+        if (mSessionStatsPool.size() < kMaxPooledSessionStats) {
+            mSessionStatsPool.emplace_back(released);
+        } else {
+            delete released;
+        }
+    });
+}
+
+void PowerSessionManager::getTaskIds(int64_t sessionId, std::vector<pid_t> *taskIds) {
+    std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+    const auto &linkedTasks = mSessionTaskMap.getTaskIds(sessionId);
+    taskIds->assign(linkedTasks.begin(), linkedTasks.end());
+}
+
 std::optional<bool> PowerSessionManager::isAnyAppSessionActive() {
     bool isAnyAppSessionActive = false;
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         isAnyAppSessionActive =
                 mSessionTaskMap.isAnyAppSessionActive(std::chrono::steady_clock::now());
     }
@@ -184,6 +432,7 @@ std::optional<bool> PowerSessionManager::isAnyAppSessionActive() {
 }
 
 void PowerSessionManager::updateUniversalBoostMode() {
+    std::lock_guard<std::mutex> lock(mUniversalBoostMutex);
     const auto active = isAnyAppSessionActive();
     if (!active.has_value()) {
         return;
@@ -195,38 +444,188 @@ void PowerSessionManager::updateUniversalBoostMode() {
     }
 }
 
-void PowerSessionManager::dumpToFd(int fd) {
-    std::ostringstream dump_buf;
-    dump_buf << "========== Begin PowerSessionManager ADPF list ==========\n";
-    std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
-    mSessionTaskMap.forEachSessionValTasks(
-            [&](auto /* sessionId */, const auto &sessionVal, const auto &tasks) {
-                sessionVal.dump(dump_buf);
-                dump_buf << " Tid:Ref[";
+void PowerSessionManager::dumpStatsBinaryToFd(int fd) {
+    struct SessionStatsRef {
+        int64_t tgid;
+        uid_t uid;
+        std::shared_ptr<SessionStats> stats;
+    };
+    // Only take references under the lock, encoding happens after releasing it
+    std::vector<SessionStatsRef> sessions;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        mSessionTaskMap.forEachSessionValTasks([&](auto, const auto &sessionVal, const auto &) {
+            if (sessionVal.stats) {
+                sessions.push_back({sessionVal.tgid, sessionVal.uid, sessionVal.stats});
+            }
+        });
+    }
 
-                size_t tasksLen = tasks.size();
-                for (auto taskId : tasks) {
-                    dump_buf << taskId << ":";
-                    const auto &sessionIds = mSessionTaskMap.getSessionIds(taskId);
-                    if (!sessionIds.empty()) {
-                        dump_buf << sessionIds.size();
+    // "ADPS", version, session count, then per session tgid, uid and its histograms
+    std::string out("ADPS");
+    out.push_back(static_cast<char>(SessionStats::kBinaryVersion & 0xff));
+    out.push_back(static_cast<char>(SessionStats::kBinaryVersion >> 8));
+    appendVarint(&out, sessions.size());
+    for (const auto &session : sessions) {
+        appendFixed32(&out, static_cast<uint32_t>(session.tgid));
+        appendFixed32(&out, static_cast<uint32_t>(session.uid));
+        session.stats->appendBinary(&out);
+    }
+    if (!::android::base::WriteStringToFd(out, fd)) {
+        ALOGE("Failed to dump session stats to fd:%d", fd);
+    }
+}
+
+void PowerSessionManager::dumpToFd(int fd, bool json) {
+    std::lock_guard<std::mutex> dumpLock(mDumpMutex);
+    ClusterPlacement::Counters placement;
+    uint64_t voteUpdates = 0;
+    uint64_t evaluationsQueued = 0;
+    uint64_t evaluationsRun = 0;
+    uint64_t evaluationsSuperseded = 0;
+    const auto snapshotStart = std::chrono::steady_clock::now();
+    {
+        ATRACE_NAME("PowerSessionManager::dumpSnapshot");
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        voteUpdates = mVoteUpdates;
+        evaluationsQueued = mEvaluationsQueued;
+        evaluationsRun = mEvaluationsRun;
+        evaluationsSuperseded = mEvaluationsSuperseded;
+        mDumpSessions.clear();
+        mDumpTasks.clear();
+        mDumpStats.clear();
+        placement = mClusterPlacement.counters();
+        mSessionTaskMap.forEachSessionValTasks(
+                [&](auto sessionId, const auto &sessionVal, const auto &tasks) {
+                    SessionSnapshot snapshot{};
+                    snapshot.sessionId = sessionId;
+                    snapshot.tgid = sessionVal.tgid;
+                    snapshot.uid = sessionVal.uid;
+                    snapshot.isActive = sessionVal.isActive;
+                    snapshot.isAppSession = sessionVal.isAppSession;
+                    snapshot.hasVotes = sessionVal.votes != nullptr;
+                    if (snapshot.hasVotes) {
+                        UclampRange uclampRange;
+                        sessionVal.votes->getUclampRange(&uclampRange, snapshotStart);
+                        snapshot.uclampMin = uclampRange.uclampMin;
+                        snapshot.uclampMax = uclampRange.uclampMax;
                     }
-                    if (tasksLen > 0) {
-                        dump_buf << ", ";
-                        --tasksLen;
+                    snapshot.requestedUclampMin = sessionVal.requestedUclampMin;
+                    snapshot.grantedUclampMin = sessionVal.grantedUclampMin;
+                    snapshot.placementBand = sessionVal.placementBand;
+                    snapshot.taskOffset = mDumpTasks.size();
+                    snapshot.taskCount = tasks.size();
+                    for (auto taskId : tasks) {
+                        mDumpTasks.push_back(
+                                {taskId, static_cast<uint32_t>(
+                                                 mSessionTaskMap.getSessionCount(taskId))});
                     }
-                }
-                dump_buf << "]\n";
-            });
-    dump_buf << "========== End PowerSessionManager ADPF list ==========\n";
-    if (!::android::base::WriteStringToFd(dump_buf.str(), fd)) {
+                    mDumpSessions.push_back(snapshot);
+                    mDumpStats.push_back(sessionVal.stats);
+                });
+    }
+    const int64_t snapshotNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - snapshotStart)
+                                       .count();
+
+    std::string out;
+    if (json) {
+        formatDumpJson(&out, snapshotNs);
+    } else {
+        out.append("========== Begin PowerSessionManager ADPF list ==========\n");
+        if (mUclampBudget.enabled()) {
+            out.append(mUclampBudget.toString()).append("\n");
+        }
+        if (mClusterPlacement.enabled()) {
+            out.append(mClusterPlacement.toString(placement)).append("\n");
+        }
+        StringAppendF(&out,
+                      "Vote timeline: votes %" PRIu64 ", evaluations queued %" PRIu64
+                      " run %" PRIu64 " superseded %" PRIu64 "\n",
+                      voteUpdates, evaluationsQueued, evaluationsRun, evaluationsSuperseded);
+        formatDumpText(&out, snapshotNs);
+        out.append("========== End PowerSessionManager ADPF list ==========\n");
+    }
+    // Release the stats references before the next dump
+    mDumpStats.clear();
+    if (!::android::base::WriteStringToFd(out, fd)) {
         ALOGE("Failed to dump one of session list to fd:%d", fd);
     }
+    if (!json) {
+        mPriorityQueueWorkerPool->dumpToFd(fd);
+        mThermalHeadroomMonitor.dumpToFd(fd);
+        mSessionCheckpoint.dumpToFd(fd);
+    }
+}
+
+void PowerSessionManager::formatDumpText(std::string *out, int64_t snapshotNs) {
+    for (size_t i = 0; i < mDumpSessions.size(); ++i) {
+        const auto &session = mDumpSessions[i];
+        StringAppendF(out, "ID.Min.Act(%" PRId64 "-%d-%" PRId64, session.tgid,
+                      static_cast<int>(session.uid), session.sessionId);
+        if (session.hasVotes) {
+            StringAppendF(out, ", %d-%d", session.uclampMin, session.uclampMax);
+        } else {
+            out->append(", votes nullptr");
+        }
+        StringAppendF(out, ", %d", session.isActive);
+        if (session.grantedUclampMin < session.requestedUclampMin) {
+            StringAppendF(out, ", budget %d/%d", session.grantedUclampMin,
+                          session.requestedUclampMin);
+        }
+        if (session.placementBand > 0) {
+            StringAppendF(out, ", band %d", session.placementBand);
+        }
+        out->append(" Tid:Ref[");
+        for (uint32_t t = 0; t < session.taskCount; ++t) {
+            const auto &task = mDumpTasks[session.taskOffset + t];
+            StringAppendF(out, "%d:%u%s", task.taskId, task.sessionCount,
+                          t + 1 < session.taskCount ? ", " : "");
+        }
+        out->append("]\n");
+        if (mDumpStats[i]) {
+            out->append(mDumpStats[i]->toString("  "));
+        }
+    }
+    StringAppendF(out, "Snapshot: %zu sessions, %zu tasks, lock held %" PRId64 " us\n",
+                  mDumpSessions.size(), mDumpTasks.size(), snapshotNs / 1000);
+}
+
+void PowerSessionManager::formatDumpJson(std::string *out, int64_t snapshotNs) {
+    StringAppendF(out, "{\"snapshot_ns\":%" PRId64 ",\"sessions\":[", snapshotNs);
+    for (size_t i = 0; i < mDumpSessions.size(); ++i) {
+        const auto &session = mDumpSessions[i];
+        StringAppendF(out,
+                      "%s{\"id\":%" PRId64 ",\"tgid\":%" PRId64
+                      ",\"uid\":%d,\"active\":%s,\"app\":%s",
+                      i > 0 ? "," : "", session.sessionId, session.tgid,
+                      static_cast<int>(session.uid), session.isActive ? "true" : "false",
+                      session.isAppSession ? "true" : "false");
+        if (session.hasVotes) {
+            StringAppendF(out, ",\"uclamp_min\":%d,\"uclamp_max\":%d", session.uclampMin,
+                          session.uclampMax);
+        }
+        StringAppendF(out, ",\"requested_min\":%d,\"granted_min\":%d,\"band\":%d,\"tasks\":[",
+                      session.requestedUclampMin, session.grantedUclampMin,
+                      session.placementBand);
+        for (uint32_t t = 0; t < session.taskCount; ++t) {
+            const auto &task = mDumpTasks[session.taskOffset + t];
+            StringAppendF(out, "%s{\"tid\":%d,\"sessions\":%u}", t > 0 ? "," : "", task.taskId,
+                          task.sessionCount);
+        }
+        out->append("]");
+        if (mDumpStats[i]) {
+            out->append(",\"stats\":");
+            mDumpStats[i]->appendJson(out);
+        }
+        out->append("}");
+    }
+    out->append("]}\n");
 }
 
 void PowerSessionManager::pause(int64_t sessionId) {
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(sessionId);
         if (nullptr == sessValPtr) {
             ALOGW("Pause failed, session is null %" PRId64, sessionId);
@@ -245,7 +644,7 @@ void PowerSessionManager::pause(int64_t sessionId) {
 
 void PowerSessionManager::resume(int64_t sessionId) {
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(sessionId);
         if (nullptr == sessValPtr) {
             ALOGW("Resume failed, session is null %" PRId64, sessionId);
@@ -265,29 +664,34 @@ void PowerSessionManager::resume(int64_t sessionId) {
 void PowerSessionManager::updateTargetWorkDuration(int64_t sessionId, AdpfHintType voteId,
                                                    std::chrono::nanoseconds durationNs) {
     int voteIdInt = static_cast<std::underlying_type_t<AdpfHintType>>(voteId);
-    std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
-    auto sessValPtr = mSessionTaskMap.findSession(sessionId);
-    if (nullptr == sessValPtr) {
-        ALOGE("Failed to updateTargetWorkDuration, session val is null id: %" PRId64, sessionId);
-        return;
-    }
+    std::optional<std::chrono::steady_clock::time_point> nextEvaluation;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+        if (nullptr == sessValPtr) {
+            ALOGE("Failed to updateTargetWorkDuration, session val is null id: %" PRId64,
+                  sessionId);
+            return;
+        }
 
-    sessValPtr->votes->updateDuration(voteIdInt, durationNs);
-    // Note, for now we are not recalculating and applying uclamp because
-    // that maintains behavior from before.  In the future we may want to
-    // revisit that decision.
+        sessValPtr->votes->updateDuration(voteIdInt, durationNs);
+        // Note, for now we are not recalculating and applying uclamp because
+        // that maintains behavior from before.  In the future we may want to
+        // revisit that decision. The vote may now end earlier though.
+        nextEvaluation = updateNextEvaluationLocked(sessValPtr, std::chrono::steady_clock::now());
+    }
+    queueEvaluation(sessionId, nextEvaluation);
 }
 
 void PowerSessionManager::voteSet(int64_t sessionId, AdpfHintType voteId, int uclampMin,
                                   int uclampMax, std::chrono::steady_clock::time_point startTime,
                                   std::chrono::nanoseconds durationNs) {
     const int voteIdInt = static_cast<std::underlying_type_t<AdpfHintType>>(voteId);
-    const auto timeoutDeadline = startTime + durationNs;
     const VoteRange vr(true, uclampMin, uclampMax, startTime, durationNs);
-    bool scheduleTimeout = false;
+    std::optional<std::chrono::steady_clock::time_point> nextEvaluation;
 
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(sessionId);
         if (nullptr == sessValPtr) {
             // Because of the async nature of some events an event for a session
@@ -296,31 +700,47 @@ void PowerSessionManager::voteSet(int64_t sessionId, AdpfHintType voteId, int uc
             return;
         }
 
-        if (!sessValPtr->votes->voteIsActive(voteIdInt)) {
-            scheduleTimeout = true;
-        }
-        if (timeoutDeadline < sessValPtr->votes->voteTimeout(voteIdInt)) {
-            scheduleTimeout = true;
-        }
         sessValPtr->votes->add(voteIdInt, vr);
         sessValPtr->lastUpdatedTime = startTime;
+        mVoteUpdates++;
+        nextEvaluation = updateNextEvaluationLocked(sessValPtr, startTime);
     }
 
     applyUclamp(sessionId, startTime);  // std::chrono::steady_clock::now());
 
-    if (scheduleTimeout) {
-        // Sent event to handle stale-vote/timeout in the future
-        EventSessionTimeout eTimeout;
-        eTimeout.timeStamp = startTime;  // eSet.timeStamp;
-        eTimeout.sessionId = sessionId;
-        eTimeout.voteId = voteIdInt;
-        mEventSessionTimeoutWorker.schedule(eTimeout, timeoutDeadline);
+    // Re-evaluate exactly when the vote range of the session changes next
+    queueEvaluation(sessionId, nextEvaluation);
+}
+
+void PowerSessionManager::queueEvaluation(
+        int64_t sessionId, std::optional<std::chrono::steady_clock::time_point> timePoint) {
+    if (timePoint) {
+        // Keyed by session so the events of a session stay ordered on one thread
+        mEventSessionTimeoutWorker.schedule({*timePoint, sessionId}, *timePoint, sessionId);
     }
 }
 
+std::optional<std::chrono::steady_clock::time_point>
+PowerSessionManager::updateNextEvaluationLocked(
+        const std::shared_ptr<SessionValueEntry> &sessValPtr,
+        std::chrono::steady_clock::time_point timePoint) {
+    if (nullptr == sessValPtr) {
+        return std::nullopt;
+    }
+    const auto next = sessValPtr->votes->nextChangeTime(timePoint);
+    // A pending evaluation at or before the change computes the next one itself
+    if (next == std::chrono::steady_clock::time_point::max() ||
+        sessValPtr->nextEvaluation <= next) {
+        return std::nullopt;
+    }
+    sessValPtr->nextEvaluation = next;
+    mEvaluationsQueued++;
+    return next;
+}
+
 void PowerSessionManager::disableBoosts(int64_t sessionId) {
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(sessionId);
         if (nullptr == sessValPtr) {
             // Because of the async nature of some events an event for a session
@@ -354,10 +774,11 @@ void PowerSessionManager::disableSystemTopAppBoost() {
 }
 
 void PowerSessionManager::handleEvent(const EventSessionTimeout &eventTimeout) {
-    bool recalcUclamp = false;
     const auto tNow = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> nextEvaluation;
+    bool stale = false;
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(eventTimeout.sessionId);
         if (nullptr == sessValPtr) {
             // It is ok for session timeouts to fire after a session has been
@@ -365,31 +786,22 @@ void PowerSessionManager::handleEvent(const EventSessionTimeout &eventTimeout) {
             return;
         }
 
-        // To minimize the number of events pushed into the queue, we are using
-        // the following logic to make use of a single timeout event which will
-        // requeue itself if the timeout has been changed since it was added to
-        // the work queue.  Requeue Logic:
-        // if vote active and vote timeout <= sched time
-        //    then deactivate vote and recalc uclamp (near end of function)
-        // if vote active and vote timeout > sched time
-        //    then requeue timeout event for new deadline (which is vote timeout)
-        const bool voteIsActive = sessValPtr->votes->voteIsActive(eventTimeout.voteId);
-        const auto voteTimeout = sessValPtr->votes->voteTimeout(eventTimeout.voteId);
-
-        if (voteIsActive) {
-            if (voteTimeout <= tNow) {
-                sessValPtr->votes->setUseVote(eventTimeout.voteId, false);
-                recalcUclamp = true;
-            } else {
-                // Can unlock sooner than we do
-                auto eventTimeout2 = eventTimeout;
-                mEventSessionTimeoutWorker.schedule(eventTimeout2, voteTimeout);
-            }
+        // Only the latest scheduled evaluation of a session is live, the
+        // others were superseded by an earlier change of its vote range
+        if (eventTimeout.timeStamp != sessValPtr->nextEvaluation) {
+            mEvaluationsSuperseded++;
+            return;
         }
+        sessValPtr->nextEvaluation = std::chrono::steady_clock::time_point::max();
+        mEvaluationsRun++;
+        sessValPtr->votes->deactivateExpired(tNow);
+        nextEvaluation = updateNextEvaluationLocked(sessValPtr, tNow);
+        stale = sessValPtr->placementBand != 0 && sessValPtr->votes->allTimedOut(tNow);
     }
-
-    if (!recalcUclamp) {
-        return;
+    queueEvaluation(eventTimeout.sessionId, nextEvaluation);
+    if (stale) {
+        // No work reported for the stale time, give up the cluster placement
+        movePlacementBand(eventTimeout.sessionId, 0);
     }
 
     // It is important to use the correct time here, time now is more reasonable
@@ -399,47 +811,194 @@ void PowerSessionManager::handleEvent(const EventSessionTimeout &eventTimeout) {
     updateUniversalBoostMode();
 }
 
-void PowerSessionManager::applyUclamp(int64_t sessionId,
-                                      std::chrono::steady_clock::time_point timePoint) {
-    const bool uclampMinOn = HintManager::GetInstance()->GetAdpfProfile()->mUclampMinOn;
+void PowerSessionManager::handleEvent(const EventSessionDiscovery &eventDiscovery) {
+    pid_t tgid;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(eventDiscovery.sessionId);
+        if (nullptr == sessValPtr) {
+            // Session closed, stop rescheduling
+            return;
+        }
+        tgid = sessValPtr->tgid;
+    }
 
+    // Walk procfs without holding the session lock
+    std::vector<pid_t> discoveredTasks;
+    mTaskDiscovery.findMatchingTasks(tgid, &discoveredTasks);
+
+    std::vector<pid_t> addedThreads;
+    std::vector<pid_t> removedThreads;
+    int placementBand = 0;
+    bool changed = false;
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
-        auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+        auto sessValPtr = mSessionTaskMap.findSession(eventDiscovery.sessionId);
         if (nullptr == sessValPtr) {
             return;
         }
+        // The client may have called setThreads while procfs was walked
+        std::vector<pid_t> taskIds = sessValPtr->clientTaskIds;
+        taskIds.insert(taskIds.end(), discoveredTasks.begin(), discoveredTasks.end());
+        std::sort(taskIds.begin(), taskIds.end());
+        taskIds.erase(std::unique(taskIds.begin(), taskIds.end()), taskIds.end());
+        placementBand = sessValPtr->placementBand;
+        auto linkedTasks = mSessionTaskMap.getTaskIds(eventDiscovery.sessionId);
+        std::sort(linkedTasks.begin(), linkedTasks.end());
+        if (linkedTasks != taskIds) {
+            mSessionTaskMap.replace(eventDiscovery.sessionId, taskIds, &addedThreads,
+                                    &removedThreads);
+            changed = true;
+        }
+    }
 
-        if (!uclampMinOn) {
-            ALOGV("PowerSessionManager::set_uclamp_min: skip");
-        } else {
-            auto &threadList = mSessionTaskMap.getTaskIds(sessionId);
-            auto tidIter = threadList.begin();
-            while (tidIter != threadList.end()) {
-                UclampRange uclampRange;
-                mSessionTaskMap.getTaskVoteRange(*tidIter, timePoint, &uclampRange.uclampMin,
-                                                 &uclampRange.uclampMax);
-                int stat = set_uclamp_min(*tidIter, uclampRange.uclampMin);
-                if (stat == ESRCH) {
-                    ALOGV("Removing dead thread %d from hint session %s.", *tidIter,
-                          sessValPtr->idString.c_str());
-                    if (mSessionTaskMap.removeDeadTaskSessionMap(sessionId, *tidIter)) {
-                        ALOGV("Removed dead thread-session map.");
-                    }
-                    tidIter = threadList.erase(tidIter);
-                } else {
-                    tidIter++;
-                }
+    if (changed) {
+        ATRACE_NAME("adpf_autodiscover");
+        ALOGV("Session %" PRId64 " auto-discovery: %zu added, %zu removed",
+              eventDiscovery.sessionId, addedThreads.size(), removedThreads.size());
+        for (auto tid : addedThreads) {
+            if (!SetTaskProfiles(tid, {"ResetUclampGrp"})) {
+                ALOGE("Failed to set ResetUclampGrp task profile for tid:%d", tid);
             }
         }
+        for (auto tid : removedThreads) {
+            if (!SetTaskProfiles(tid, {"NoResetUclampGrp"})) {
+                ALOGE("Failed to set NoResetUclampGrp task profile for tid:%d", tid);
+            }
+        }
+        if (placementBand > 0) {
+            applyTaskProfile(addedThreads, mClusterPlacement.getProfile(placementBand));
+            applyTaskProfile(removedThreads, mClusterPlacement.getProfile(0));
+        }
+        const auto tNow = std::chrono::steady_clock::now();
+        applyUclampToTasks(removedThreads, tNow);
+        applyUclamp(eventDiscovery.sessionId, tNow);
+    }
+
+    mEventSessionDiscoveryWorker.schedule(eventDiscovery,
+                                          std::chrono::steady_clock::now() + kAutoDiscoverInterval,
+                                          eventDiscovery.sessionId);
+}
+
+void PowerSessionManager::applyUclampToTasks(const std::vector<pid_t> &taskIds,
+                                             std::chrono::steady_clock::time_point timePoint) {
+    if (taskIds.empty() || !HintManager::GetInstance()->GetAdpfProfile()->mUclampMinOn) {
+        return;
+    }
+    std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+    for (auto tid : taskIds) {
+        UclampRange uclampRange;
+        mSessionTaskMap.getTaskVoteRange(tid, timePoint, &uclampRange.uclampMin,
+                                         &uclampRange.uclampMax);
+        set_uclamp_min(tid, uclampRange.uclampMin);
+    }
+}
 
-        sessValPtr->lastUpdatedTime = timePoint;
+void PowerSessionManager::applyUclamp(int64_t sessionId,
+                                      std::chrono::steady_clock::time_point timePoint) {
+    std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
+    applyUclampAndRebalanceLocked(sessionId, timePoint);
+}
+
+void PowerSessionManager::applyUclampAndRebalanceLocked(
+        int64_t sessionId, std::chrono::steady_clock::time_point timePoint) {
+    if (!mUclampBudget.enabled()) {
+        applyUclampLocked(sessionId, timePoint);
+        return;
+    }
+    mBudgetChangedSessions.clear();
+    rebalanceBudgetLocked(sessionId, timePoint, &mBudgetChangedSessions);
+    applyUclampLocked(sessionId, timePoint);
+    for (auto changedSessionId : mBudgetChangedSessions) {
+        applyUclampLocked(changedSessionId, timePoint);
     }
 }
 
+void PowerSessionManager::rebalanceBudgetLocked(int64_t sessionId,
+                                                std::chrono::steady_clock::time_point timePoint,
+                                                std::vector<int64_t> *changedSessions) {
+    // The app session which reported work most recently is treated as the top
+    // app, votes and uclamp updates do not count as activity
+    int64_t foregroundTgid = -1;
+    std::chrono::steady_clock::time_point foregroundTime{};
+    mBudgetRequests.clear();
+    mSessionTaskMap.forEachSessionValTasks([&](auto id, const auto &sessionVal, const auto &) {
+        UclampBudget::Request request;
+        request.sessionId = id;
+        request.tgid = sessionVal.tgid;
+        if (sessionVal.isActive && sessionVal.votes) {
+            UclampRange uclampRange;
+            sessionVal.votes->getUclampRange(&uclampRange, timePoint);
+            request.requestedMin = uclampRange.uclampMin;
+        }
+        const auto lastReportTime =
+                sessionVal.stats ? sessionVal.stats->lastReportTime()
+                                 : std::chrono::steady_clock::time_point{};
+        if (sessionVal.isAppSession && lastReportTime > foregroundTime) {
+            foregroundTime = lastReportTime;
+            foregroundTgid = sessionVal.tgid;
+        }
+        mBudgetRequests.push_back(request);
+    });
+    for (auto &request : mBudgetRequests) {
+        request.foreground = request.tgid == foregroundTgid;
+    }
+
+    mUclampBudget.arbitrate(&mBudgetRequests);
+
+    for (const auto &request : mBudgetRequests) {
+        auto sessValPtr = mSessionTaskMap.findSession(request.sessionId);
+        if (nullptr == sessValPtr) {
+            continue;
+        }
+        sessValPtr->requestedUclampMin = request.requestedMin;
+        if (sessValPtr->grantedUclampMin != request.grantedMin) {
+            sessValPtr->grantedUclampMin = request.grantedMin;
+            if (request.sessionId != sessionId) {
+                changedSessions->push_back(request.sessionId);
+            }
+        }
+    }
+}
+
+void PowerSessionManager::applyUclampLocked(int64_t sessionId,
+                                            std::chrono::steady_clock::time_point timePoint) {
+    const bool uclampMinOn = HintManager::GetInstance()->GetAdpfProfile()->mUclampMinOn;
+
+    auto sessValPtr = mSessionTaskMap.findSession(sessionId);
+    if (nullptr == sessValPtr) {
+        return;
+    }
+
+    if (!uclampMinOn) {
+        ALOGV("PowerSessionManager::set_uclamp_min: skip");
+    } else {
+        auto &threadList = mSessionTaskMap.getTaskIds(sessionId);
+        auto tidIter = threadList.begin();
+        while (tidIter != threadList.end()) {
+            UclampRange uclampRange;
+            mSessionTaskMap.getTaskVoteRange(*tidIter, timePoint, &uclampRange.uclampMin,
+                                             &uclampRange.uclampMax);
+            int stat = set_uclamp_min(*tidIter, uclampRange.uclampMin);
+            if (stat == ESRCH) {
+                ALOGV("Removing dead thread %d from hint session %s.", *tidIter,
+                      sessValPtr->idString.c_str());
+                if (mSessionTaskMap.removeDeadTaskSessionMap(sessionId, *tidIter)) {
+                    ALOGV("Removed dead thread-session map.");
+                }
+                tidIter = threadList.erase(tidIter);
+            } else {
+                tidIter++;
+            }
+        }
+    }
+
+    sessValPtr->lastUpdatedTime = timePoint;
+}
+
 void PowerSessionManager::forceSessionActive(int64_t sessionId, bool isActive) {
     {
-        std::lock_guard<std::mutex> lock(mSessionTaskMapMutex);
+        std::lock_guard<InstrumentedMutex> lock(mSessionTaskMapMutex);
         auto sessValPtr = mSessionTaskMap.findSession(sessionId);
         if (nullptr == sessValPtr) {
             return;
@@ -7,16 +7,25 @@
 #pragma once
 
 #include <android-base/properties.h>
+#include <android-base/strings.h>
 #include <perfmgr/HintManager.h>
 #include <utils/Looper.h>
 
+#include <atomic>
+#include <initializer_list>
 #include <mutex>
 #include <optional>
 #include <unordered_set>
 
 #include "BackgroundWorker.h"
+#include "ClusterPlacement.h"
 #include "PowerHintSession.h"
+#include "SessionCheckpoint.h"
 #include "SessionTaskMap.h"
+#include "TaskDiscovery.h"
+#include "ThermalHeadroomMonitor.h"
+#include "UclampBudget.h"
+#include "disp-power/InstrumentedMutex.h"
 
 namespace aidl {
 namespace google {
@@ -31,26 +40,52 @@ using ::android::Thread;
 using ::android::perfmgr::HintManager;
 
 constexpr char kPowerHalAdpfDisableTopAppBoost[] = "vendor.powerhal.adpf.disable.hint";
+constexpr char kPowerHalAdpfAutoDiscoverComm[] = "vendor.powerhal.adpf.autodiscover.comm";
+constexpr char kPowerHalAdpfBudgetTgid[] = "vendor.powerhal.adpf.budget.tgid";
+constexpr char kPowerHalAdpfBudgetGlobal[] = "vendor.powerhal.adpf.budget.global";
+constexpr char kPowerHalAdpfBudgetMode[] = "vendor.powerhal.adpf.budget.mode";
+constexpr char kPowerHalAdpfCheckpointPath[] = "vendor.powerhal.adpf.checkpoint.path";
+constexpr char kPowerHalAdpfWorkerThreads[] = "vendor.powerhal.adpf.worker_threads";
 
 class PowerSessionManager : public ::android::RefBase {
   public:
     // Update the current hint info
     void updateHintMode(const std::string &mode, bool enabled);
     void updateHintBoost(const std::string &boost, int32_t durationMs);
+    void updateRefreshRate(AdpfRefreshRate refreshRate);
     int getDisplayRefreshRate();
-    // Add and remove power hint session
+    // Round a duration up to a whole number of vsync periods
+    std::chrono::nanoseconds snapToVsync(std::chrono::nanoseconds duration) const;
+    // Return n if the duration is n frame periods of the current refresh rate, 0 otherwise
+    int getVsyncMultiple(std::chrono::nanoseconds duration) const;
+    // Scale in (0, 1] to apply to ADPF boosts based on thermal headroom
+    double getThermalScale(std::chrono::steady_clock::time_point timePoint);
+    // Vote set together with the creation of a session
+    struct InitialVote {
+        AdpfHintType voteId;
+        int uclampMin;
+        int uclampMax;
+        std::chrono::nanoseconds durationNs;
+    };
+    // Add and remove power hint session, both take the session lock once
     void addPowerSession(const std::string &idString,
                          const std::shared_ptr<AppHintDesc> &sessionDescriptor,
-                         const std::vector<int32_t> &threadIds);
+                         const std::vector<int32_t> &threadIds,
+                         std::initializer_list<InitialVote> initialVotes = {});
     void removePowerSession(int64_t sessionId);
     // Replace current threads in session with threadIds
     void setThreadsFromPowerSession(int64_t sessionId, const std::vector<int32_t> &threadIds);
+    // Copy the threads currently linked to the session into taskIds
+    void getTaskIds(int64_t sessionId, std::vector<pid_t> *taskIds);
     // Pause and resume power hint session
     void pause(int64_t sessionId);
     void resume(int64_t sessionId);
 
     void updateUniversalBoostMode();
-    void dumpToFd(int fd);
+    // Text dump, or JSON when json is set, formatted without holding the session lock
+    void dumpToFd(int fd, bool json = false);
+    // Compact binary export of the per-session histograms for fleet collection
+    void dumpStatsBinaryToFd(int fd);
 
     void updateTargetWorkDuration(int64_t sessionId, AdpfHintType voteId,
                                   std::chrono::nanoseconds durationNs);
@@ -62,6 +97,25 @@ class PowerSessionManager : public ::android::RefBase {
 
     void disableBoosts(int64_t sessionId);
 
+    // Session stats recycled from closed sessions to avoid large allocations
+    std::shared_ptr<SessionStats> acquireSessionStats();
+
+    // Placement band for setPoint when currently in band, band itself when
+    // placement is disabled
+    int nextPlacementBand(int band, int setPoint) const {
+        return mClusterPlacement.enabled() ? mClusterPlacement.nextBand(band, setPoint) : band;
+    }
+    // Move the session threads to the task profile of band
+    void movePlacementBand(int64_t sessionId, int band);
+
+    bool checkpointEnabled() const { return mSessionCheckpoint.enabled(); }
+    // Queue a checkpoint of all sessions unless one is already pending
+    void scheduleCheckpoint(std::chrono::steady_clock::time_point timePoint);
+
+    // State left by a previous power HAL instance for a session being recreated
+    std::optional<SessionCheckpoint::Record> takeCheckpoint(int32_t tgid, int32_t uid,
+                                                            const std::vector<int32_t> &threadIds);
+
     // Singleton
     static sp<PowerSessionManager> getInstance() {
         static sp<PowerSessionManager> instance = new PowerSessionManager();
@@ -74,24 +128,113 @@ class PowerSessionManager : public ::android::RefBase {
     void enableSystemTopAppBoost();
     const std::string kDisableBoostHintName;
 
-    int mDisplayRefreshRate;
+    std::atomic<int> mDisplayRefreshRate;
+    std::atomic<int64_t> mVsyncPeriodNs;
+    // Serialize the top-app boost toggling done from concurrent binder calls
+    std::mutex mUniversalBoostMutex;
 
     // Rewrite specific
-    mutable std::mutex mSessionTaskMapMutex;
+    mutable InstrumentedMutex mSessionTaskMapMutex{"PowerSessionManager::mSessionTaskMapMutex"};
     SessionTaskMap mSessionTaskMap;
     std::shared_ptr<PriorityQueueWorkerPool> mPriorityQueueWorkerPool;
 
-    // Session timeout
+    // Re-evaluation of a session when its vote range changes, a session has
+    // at most one live event, the one matching its nextEvaluation
     struct EventSessionTimeout {
         std::chrono::steady_clock::time_point timeStamp;
         int64_t sessionId{0};
-        int voteId{0};
     };
     void handleEvent(const EventSessionTimeout &e);
     TemplatePriorityQueueWorker<EventSessionTimeout> mEventSessionTimeoutWorker;
+    // Move the session evaluation to the next change of its vote range after
+    // timePoint, returns the time to queue an event for if one is needed
+    std::optional<std::chrono::steady_clock::time_point> updateNextEvaluationLocked(
+            const std::shared_ptr<SessionValueEntry> &sessValPtr,
+            std::chrono::steady_clock::time_point timePoint);
+    // Queue the evaluation returned by updateNextEvaluationLocked, if any
+    void queueEvaluation(int64_t sessionId,
+                         std::optional<std::chrono::steady_clock::time_point> timePoint);
+    // Vote timeline counters, guarded by mSessionTaskMapMutex
+    uint64_t mVoteUpdates{0};
+    uint64_t mEvaluationsQueued{0};
+    uint64_t mEvaluationsRun{0};
+    uint64_t mEvaluationsSuperseded{0};
+
+    // Periodic thread auto-discovery within the session's thread group
+    struct EventSessionDiscovery {
+        int64_t sessionId{0};
+    };
+    void handleEvent(const EventSessionDiscovery &e);
+    TemplatePriorityQueueWorker<EventSessionDiscovery> mEventSessionDiscoveryWorker;
+    TaskDiscovery mTaskDiscovery;
+
+    // Deferred checkpoint of all sessions, at most one is scheduled at a time
+    struct EventCheckpoint {};
+    void handleEvent(const EventCheckpoint &e);
+    TemplatePriorityQueueWorker<EventCheckpoint> mEventCheckpointWorker;
+    SessionCheckpoint mSessionCheckpoint;
+    std::atomic<bool> mCheckpointScheduled{false};
+    static SessionCheckpoint::Config getCheckpointConfig();
+
+    // Per-tgid and system wide uclamp.min budget, guarded by mSessionTaskMapMutex
+    UclampBudget mUclampBudget;
+    std::vector<UclampBudget::Request> mBudgetRequests;
+    std::vector<int64_t> mBudgetChangedSessions;
+
+    // Plain copy of the session map taken under mSessionTaskMapMutex for dumping
+    struct SessionSnapshot {
+        int64_t sessionId;
+        int64_t tgid;
+        uid_t uid;
+        bool isActive;
+        bool isAppSession;
+        bool hasVotes;
+        int uclampMin;
+        int uclampMax;
+        int requestedUclampMin;
+        int grantedUclampMin;
+        int placementBand;
+        // Range of the session's tasks in mDumpTasks
+        uint32_t taskOffset;
+        uint32_t taskCount;
+    };
+    struct TaskSnapshot {
+        pid_t taskId;
+        uint32_t sessionCount;
+    };
+    // Serializes dumps, buffers are reused to keep the locked copy allocation free
+    std::mutex mDumpMutex;
+    std::vector<SessionSnapshot> mDumpSessions;
+    std::vector<TaskSnapshot> mDumpTasks;
+    std::vector<std::shared_ptr<SessionStats>> mDumpStats;
+    void formatDumpText(std::string *out, int64_t snapshotNs);
+    void formatDumpJson(std::string *out, int64_t snapshotNs);
+
+    std::mutex mSessionStatsPoolMutex;
+    std::vector<std::unique_ptr<SessionStats>> mSessionStatsPool;
+
+    ThermalHeadroomMonitor mThermalHeadroomMonitor;
+    static ThermalHeadroomMonitor::Config getThermalConfig();
+
+    // PID band driven task profiles, guarded by mSessionTaskMapMutex
+    ClusterPlacement mClusterPlacement;
+    static ClusterPlacement makeClusterPlacement();
+    // Returns the number of tasks the profile failed to apply to
+    static size_t applyTaskProfile(const std::vector<pid_t> &taskIds, const std::string &profile);
 
     // Calculate uclamp range
     void applyUclamp(int64_t sessionId, std::chrono::steady_clock::time_point timePoint);
+    // applyUclamp with the lock held, rebalances the budget of other sessions when enabled
+    void applyUclampAndRebalanceLocked(int64_t sessionId,
+                                       std::chrono::steady_clock::time_point timePoint);
+    void applyUclampLocked(int64_t sessionId, std::chrono::steady_clock::time_point timePoint);
+    // Re-run budget arbitration over all sessions, collect sessions other
+    // than sessionId whose granted uclamp.min changed
+    void rebalanceBudgetLocked(int64_t sessionId, std::chrono::steady_clock::time_point timePoint,
+                               std::vector<int64_t> *changedSessions);
+    // Recalculate uclamp of tasks which are no longer linked to a session
+    void applyUclampToTasks(const std::vector<pid_t> &taskIds,
+                            std::chrono::steady_clock::time_point timePoint);
     // Force a session active or in-active, helper for other methods
     void forceSessionActive(int64_t sessionId, bool isActive);
 
@@ -100,8 +243,28 @@ class PowerSessionManager : public ::android::RefBase {
         : kDisableBoostHintName(::android::base::GetProperty(kPowerHalAdpfDisableTopAppBoost,
                                                              "ADPF_DISABLE_TA_BOOST")),
           mDisplayRefreshRate(60),
-          mPriorityQueueWorkerPool(new PriorityQueueWorkerPool(1, "adpf_handler")),
-          mEventSessionTimeoutWorker([&](auto e) { handleEvent(e); }, mPriorityQueueWorkerPool) {}
+          mVsyncPeriodNs(std::nano::den / 60),
+          mPriorityQueueWorkerPool(new PriorityQueueWorkerPool(
+                  ::android::base::GetUintProperty<size_t>(kPowerHalAdpfWorkerThreads, 2),
+                  "adpf_handler")),
+          mEventSessionTimeoutWorker([&](auto e) { handleEvent(e); }, mPriorityQueueWorkerPool),
+          mEventSessionDiscoveryWorker([&](auto e) { handleEvent(e); }, mPriorityQueueWorkerPool),
+          mTaskDiscovery("/proc",
+                         ::android::base::Split(
+                                 ::android::base::GetProperty(kPowerHalAdpfAutoDiscoverComm, ""),
+                                 ",")),
+          mEventCheckpointWorker([&](auto e) { handleEvent(e); }, mPriorityQueueWorkerPool),
+          mSessionCheckpoint(getCheckpointConfig()),
+          mUclampBudget(
+                  ::android::base::GetIntProperty(kPowerHalAdpfBudgetTgid, 0),
+                  ::android::base::GetIntProperty(kPowerHalAdpfBudgetGlobal, 0),
+                  ::android::base::GetProperty(kPowerHalAdpfBudgetMode, "sum") == "max"
+                          ? UclampBudget::Mode::MAX
+                          : UclampBudget::Mode::SUM),
+          mThermalHeadroomMonitor("/sys/class/thermal", getThermalConfig()),
+          mClusterPlacement(makeClusterPlacement()) {
+        mSessionCheckpoint.load(std::chrono::steady_clock::now());
+    }
     PowerSessionManager(PowerSessionManager const &) = delete;
     void operator=(PowerSessionManager const &) = delete;
 };
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "SchedStatSampler.h"
+
+#include <android-base/stringprintf.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+SchedStatSampler::SchedStatSampler(const std::string &procRoot) : mProcRoot(procRoot) {}
+
+bool SchedStatSampler::readSchedStat(TaskEntry *entry, uint64_t *runNs, uint64_t *waitNs) {
+    // Format: "<run ns> <wait ns> <timeslices>\n"
+    char buf[64];
+    const ssize_t len = TEMP_FAILURE_RETRY(pread(entry->fd.get(), buf, sizeof(buf) - 1, 0));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    char *end = nullptr;
+    *runNs = strtoull(buf, &end, 10);
+    if (end == buf) {
+        return false;
+    }
+    char *waitStart = end;
+    *waitNs = strtoull(waitStart, &end, 10);
+    return end != waitStart;
+}
+
+std::optional<double> SchedStatSampler::sampleBusyFraction(const std::vector<pid_t> &taskIds,
+                                                           int64_t workNs) {
+    ++mGeneration;
+
+    std::optional<double> busyFraction;
+    for (const auto tid : taskIds) {
+        auto &entry = mTasks[tid];
+        const bool isNewTask = entry.generation == 0;
+        if (!entry.fd.ok()) {
+            const std::string path =
+                    ::android::base::StringPrintf("%s/%d/schedstat", mProcRoot.c_str(), tid);
+            entry.fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+            if (!entry.fd.ok()) {
+                ALOGV("Failed to open %s (%s)", path.c_str(), strerror(errno));
+                mTasks.erase(tid);
+                continue;
+            }
+        }
+        uint64_t runNs = 0;
+        uint64_t waitNs = 0;
+        if (!readSchedStat(&entry, &runNs, &waitNs)) {
+            mTasks.erase(tid);
+            continue;
+        }
+        if (workNs > 0 && !isNewTask) {
+            const double busy =
+                    static_cast<double>((runNs - entry.runNs) + (waitNs - entry.waitNs)) / workNs;
+            busyFraction = std::max(busyFraction.value_or(0.0), std::min(busy, 1.0));
+        }
+        entry.runNs = runNs;
+        entry.waitNs = waitNs;
+        entry.generation = mGeneration;
+    }
+
+    // Drop tasks which are no longer part of the session
+    for (auto itr = mTasks.begin(); itr != mTasks.end();) {
+        if (itr->second.generation != mGeneration) {
+            itr = mTasks.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+    return busyFraction;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
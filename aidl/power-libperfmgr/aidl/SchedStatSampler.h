@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+#include <sys/types.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Samples per-task CPU runtime and runqueue wait time from
+// <procRoot>/<tid>/schedstat. The schedstat fds are kept open across samples
+// and read with pread so a sample costs one syscall per task.
+class SchedStatSampler {
+  public:
+    explicit SchedStatSampler(const std::string &procRoot = "/proc");
+
+    // Sample the tasks and return the largest fraction of the reported work
+    // duration any of them spent running or runnable since the previous
+    // sample. workNs is the sum of the durations reported in the batch.
+    // Returns nullopt on the first sample or if no task could be read.
+    std::optional<double> sampleBusyFraction(const std::vector<pid_t> &taskIds, int64_t workNs);
+
+  private:
+    struct TaskEntry {
+        ::android::base::unique_fd fd;
+        uint64_t runNs{0};
+        uint64_t waitNs{0};
+        uint64_t generation{0};
+    };
+
+    bool readSchedStat(TaskEntry *entry, uint64_t *runNs, uint64_t *waitNs);
+
+    const std::string mProcRoot;
+    std::unordered_map<pid_t, TaskEntry> mTasks;
+    // Used to evict tasks that left the session
+    uint64_t mGeneration{0};
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "SessionCheckpoint.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <log/log.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "SessionStats.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+
+namespace {
+constexpr char kMagic[] = "ADPC";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+// Upper bound of what a sane checkpoint holds, protects against corrupt counts
+constexpr uint64_t kMaxRecords = 1024;
+constexpr uint64_t kMaxEntriesPerRecord = 1024;
+
+int64_t toNs(std::chrono::steady_clock::time_point timePoint) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint.time_since_epoch())
+            .count();
+}
+
+uint32_t fnv1a(const char *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void appendSigned(std::string *out, int64_t value) {
+    appendVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+// Bounds checked cursor over the checkpoint payload, any overrun latches ok to false
+struct Reader {
+    const char *pos;
+    const char *end;
+    bool ok{true};
+
+    uint32_t fixed32() {
+        if (end - pos < 4) {
+            ok = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(*pos++)) << (8 * i);
+        }
+        return value;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == end) {
+                break;
+            }
+            const uint8_t byte = static_cast<uint8_t>(*pos++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t signedVarint() {
+        const uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+};
+}  // namespace
+
+SessionCheckpoint::SessionCheckpoint(Config config) : mConfig(std::move(config)) {}
+
+bool SessionCheckpoint::write(const std::vector<Record> &records) {
+    if (!enabled()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> writeLock(mWriteMutex);
+    const auto start = std::chrono::steady_clock::now();
+    mBuffer.assign(kMagic, kMagicSize);
+    appendFixed32(&mBuffer, kVersion);
+    appendVarint(&mBuffer, toNs(start));
+    appendVarint(&mBuffer, records.size());
+    for (const auto &r : records) {
+        appendVarint(&mBuffer, r.tgid);
+        appendVarint(&mBuffer, r.uid);
+        appendVarint(&mBuffer, r.state.clientTargetNs);
+        appendSigned(&mBuffer, r.state.setPoint);
+        appendSigned(&mBuffer, r.state.integralError);
+        appendSigned(&mBuffer, r.state.previousError);
+        appendVarint(&mBuffer, r.tids.size());
+        for (auto tid : r.tids) {
+            appendVarint(&mBuffer, tid);
+        }
+        appendVarint(&mBuffer, r.votes.size());
+        for (const auto &v : r.votes) {
+            appendSigned(&mBuffer, v.voteId);
+            appendVarint(&mBuffer, v.uclampMin);
+            appendVarint(&mBuffer, v.uclampMax);
+            appendVarint(&mBuffer, v.deadlineNs);
+        }
+    }
+    appendFixed32(&mBuffer, fnv1a(mBuffer.data(), mBuffer.size()));
+
+    // Readers only ever see a complete file
+    const std::string tmpPath = mConfig.path + ".tmp";
+    bool ok = ::android::base::WriteStringToFile(mBuffer, tmpPath);
+    if (ok && rename(tmpPath.c_str(), mConfig.path.c_str()) != 0) {
+        ALOGW("Failed to replace ADPF checkpoint %s: %s", mConfig.path.c_str(), strerror(errno));
+        ok = false;
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWrites++;
+    if (!ok) {
+        mWriteFailures++;
+    }
+    mLastWriteBytes = mBuffer.size();
+    mLastWriteDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+    return ok;
+}
+
+bool SessionCheckpoint::isLiveRecord(Record *record) const {
+    // The thread group must still be owned by the same uid, this also catches pid reuse
+    struct stat st;
+    const std::string tgidPath = mConfig.procRoot + "/" + std::to_string(record->tgid);
+    if (stat(tgidPath.c_str(), &st) != 0 || st.st_uid != static_cast<uid_t>(record->uid)) {
+        return false;
+    }
+    const std::string taskPrefix = tgidPath + "/task/";
+    record->tids.erase(std::remove_if(record->tids.begin(), record->tids.end(),
+                                      [&taskPrefix](int32_t tid) {
+                                          const std::string taskPath =
+                                                  taskPrefix + std::to_string(tid);
+                                          return access(taskPath.c_str(), F_OK) != 0;
+                                      }),
+                       record->tids.end());
+    return !record->tids.empty();
+}
+
+void SessionCheckpoint::load(std::chrono::steady_clock::time_point timePoint) {
+    if (!enabled()) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::string data;
+    if (!::android::base::ReadFileToString(mConfig.path, &data)) {
+        // No previous instance, nothing to restore
+        return;
+    }
+
+    std::vector<Record> records;
+    size_t discarded = 0;
+    const char *error = nullptr;
+    Reader reader{data.data(), data.data() + data.size()};
+    if (data.size() < kMagicSize + 8 || data.compare(0, kMagicSize, kMagic) != 0) {
+        error = "bad magic";
+    } else {
+        Reader checksum{data.data() + data.size() - 4, data.data() + data.size()};
+        reader.pos += kMagicSize;
+        reader.end -= 4;
+        if (checksum.fixed32() != fnv1a(data.data(), data.size() - 4)) {
+            error = "bad checksum";
+        } else if (reader.fixed32() != kVersion) {
+            error = "unsupported version";
+        }
+    }
+    int64_t checkpointNs = 0;
+    if (error == nullptr) {
+        checkpointNs = reader.varint();
+        if (toNs(timePoint) - checkpointNs >
+            std::chrono::duration_cast<std::chrono::nanoseconds>(mConfig.maxAge).count()) {
+            error = "stale";
+        }
+    }
+    if (error == nullptr) {
+        const uint64_t count = reader.varint();
+        if (count > kMaxRecords) {
+            reader.ok = false;
+        }
+        for (uint64_t i = 0; i < count && reader.ok; ++i) {
+            Record r;
+            r.tgid = static_cast<int32_t>(reader.varint());
+            r.uid = static_cast<int32_t>(reader.varint());
+            r.state.clientTargetNs = reader.varint();
+            r.state.setPoint = static_cast<int32_t>(reader.signedVarint());
+            r.state.integralError = reader.signedVarint();
+            r.state.previousError = reader.signedVarint();
+            const uint64_t tidCount = reader.varint();
+            if (tidCount > kMaxEntriesPerRecord) {
+                reader.ok = false;
+                break;
+            }
+            for (uint64_t t = 0; t < tidCount && reader.ok; ++t) {
+                r.tids.push_back(static_cast<int32_t>(reader.varint()));
+            }
+            const uint64_t voteCount = reader.varint();
+            if (voteCount > kMaxEntriesPerRecord) {
+                reader.ok = false;
+                break;
+            }
+            for (uint64_t v = 0; v < voteCount && reader.ok; ++v) {
+                Vote vote;
+                vote.voteId = static_cast<int32_t>(reader.signedVarint());
+                vote.uclampMin = static_cast<int32_t>(reader.varint());
+                vote.uclampMax = static_cast<int32_t>(reader.varint());
+                vote.deadlineNs = reader.varint();
+                r.votes.push_back(vote);
+            }
+            if (!reader.ok) {
+                break;
+            }
+            if (isLiveRecord(&r)) {
+                records.push_back(std::move(r));
+            } else {
+                discarded++;
+            }
+        }
+        if (!reader.ok) {
+            error = "truncated";
+        }
+    }
+    const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start);
+    if (error != nullptr) {
+        ALOGW("Ignoring ADPF checkpoint %s (%zu bytes): %s", mConfig.path.c_str(), data.size(),
+              error);
+        records.clear();
+        discarded = 0;
+    } else {
+        ALOGI("Loaded ADPF checkpoint %s: %zu records kept, %zu discarded in %" PRId64 "us",
+              mConfig.path.c_str(), records.size(), discarded,
+              static_cast<int64_t>(duration.count() / 1000));
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRestored = std::move(records);
+    mLoadTime = timePoint;
+    mRestoredCheckpointTime = std::chrono::steady_clock::time_point(
+            std::chrono::nanoseconds(checkpointNs));
+    mLoadDuration = duration;
+    mLoadedRecords = mRestored.size();
+    mDiscardedRecords = discarded;
+}
+
+std::optional<SessionCheckpoint::Record> SessionCheckpoint::take(
+        int32_t tgid, int32_t uid, const std::vector<int32_t> &tids,
+        std::chrono::steady_clock::time_point timePoint) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mRestored.empty()) {
+        return std::nullopt;
+    }
+    if (timePoint - mLoadTime > mConfig.maxAge) {
+        mExpiredRecords += mRestored.size();
+        mRestored.clear();
+        return std::nullopt;
+    }
+    auto itr = std::find_if(mRestored.begin(), mRestored.end(), [&](const Record &r) {
+        return r.tgid == tgid && r.uid == uid &&
+               std::any_of(tids.begin(), tids.end(), [&r](int32_t tid) {
+                   return std::find(r.tids.begin(), r.tids.end(), tid) != r.tids.end();
+               });
+    });
+    if (itr == mRestored.end()) {
+        return std::nullopt;
+    }
+    Record record = std::move(*itr);
+    mRestored.erase(itr);
+    const int64_t nowNs = toNs(timePoint);
+    record.votes.erase(std::remove_if(record.votes.begin(), record.votes.end(),
+                                      [nowNs](const Vote &v) { return v.deadlineNs <= nowNs; }),
+                       record.votes.end());
+    mRestoredSessions++;
+    return record;
+}
+
+void SessionCheckpoint::dumpToFd(int fd) const {
+    if (!enabled()) {
+        return;
+    }
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        StringAppendF(&out, "ADPF checkpoint %s:\n", mConfig.path.c_str());
+        StringAppendF(&out,
+                      "  load: %zu kept, %zu discarded, %" PRId64 "us, checkpoint age %" PRId64
+                      "ms\n",
+                      mLoadedRecords, mDiscardedRecords,
+                      static_cast<int64_t>(mLoadDuration.count() / 1000),
+                      mLoadedRecords + mDiscardedRecords == 0
+                              ? 0
+                              : static_cast<int64_t>(
+                                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                mLoadTime - mRestoredCheckpointTime)
+                                                .count()));
+        StringAppendF(&out, "  restore: %zu sessions, %zu pending, %zu expired\n",
+                      mRestoredSessions, mRestored.size(), mExpiredRecords);
+        StringAppendF(&out, "  write: %zu (%zu failed), last %zu bytes in %" PRId64 "us\n",
+                      mWrites, mWriteFailures, mLastWriteBytes,
+                      static_cast<int64_t>(mLastWriteDuration.count() / 1000));
+    }
+    ::android::base::WriteStringToFd(out, fd);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Keep a compact binary copy of the live ADPF sessions on tmpfs so that a
+// restarted power HAL can seed the PID controller of the sessions clients
+// recreate, instead of ramping up from the init boost again. Records are
+// only restored for thread groups and threads which still exist.
+class SessionCheckpoint {
+  public:
+    // Version of the file layout
+    static constexpr uint32_t kVersion = 1;
+
+    struct Config {
+        // Checkpoint file, empty disables checkpointing
+        std::string path;
+        std::string procRoot{"/proc"};
+        // Checkpoints older than this are ignored on load and restored
+        // records are dropped once no session claimed them for that long
+        std::chrono::milliseconds maxAge{5000};
+    };
+
+    // PID controller state of a session
+    struct ControllerState {
+        int64_t clientTargetNs{0};
+        int32_t setPoint{0};
+        int64_t integralError{0};
+        int64_t previousError{0};
+    };
+
+    // Latest ControllerState of a session, stored by the session on each
+    // report and loaded by the checkpoint writer without the session map lock
+    class ControllerStateSlot {
+      public:
+        void store(const ControllerState &state) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mState = state;
+        }
+        ControllerState load() const {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mState;
+        }
+
+      private:
+        mutable std::mutex mMutex;
+        ControllerState mState;
+    };
+
+    struct Vote {
+        int32_t voteId{0};
+        int32_t uclampMin{0};
+        int32_t uclampMax{0};
+        // steady_clock time the vote expires at, shared by processes
+        int64_t deadlineNs{0};
+    };
+
+    struct Record {
+        int32_t tgid{0};
+        int32_t uid{0};
+        ControllerState state;
+        std::vector<int32_t> tids;
+        std::vector<Vote> votes;
+    };
+
+    explicit SessionCheckpoint(Config config);
+
+    bool enabled() const { return !mConfig.path.empty(); }
+
+    // Serialize records and atomically replace the checkpoint file,
+    // concurrent writers are serialized
+    bool write(const std::vector<Record> &records);
+
+    // Read the checkpoint left by the previous instance, keep records whose
+    // thread group still belongs to the same uid and still has one of the tids
+    void load(std::chrono::steady_clock::time_point timePoint);
+
+    // Remove and return the restored record of the same tgid and uid which
+    // shares a thread with tids, votes already expired at timePoint are dropped
+    std::optional<Record> take(int32_t tgid, int32_t uid, const std::vector<int32_t> &tids,
+                               std::chrono::steady_clock::time_point timePoint);
+
+    void dumpToFd(int fd) const;
+
+  private:
+    bool isLiveRecord(Record *record) const;
+
+    const Config mConfig;
+
+    // Guards the restored records and the counters
+    mutable std::mutex mMutex;
+    std::vector<Record> mRestored;
+    std::chrono::steady_clock::time_point mLoadTime;
+    // Time the records were written at by the previous instance
+    std::chrono::steady_clock::time_point mRestoredCheckpointTime;
+    std::chrono::nanoseconds mLoadDuration{0};
+    size_t mLoadedRecords{0};
+    size_t mDiscardedRecords{0};
+    size_t mRestoredSessions{0};
+    size_t mExpiredRecords{0};
+    size_t mWrites{0};
+    size_t mWriteFailures{0};
+    size_t mLastWriteBytes{0};
+    std::chrono::nanoseconds mLastWriteDuration{0};
+
+    // Serializes writers, the buffer is reused between checkpoints
+    std::mutex mWriteMutex;
+    std::string mBuffer;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SessionStats.h"
+
+#include <android-base/stringprintf.h>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+void appendHistogram(std::string *out, const Histogram &histogram) {
+    size_t nonEmpty = 0;
+    for (size_t i = 0; i < Histogram::kBucketCount; ++i) {
+        if (histogram.bucket(i) != 0) {
+            nonEmpty++;
+        }
+    }
+    appendVarint(out, histogram.count());
+    appendVarint(out, nonEmpty);
+    for (size_t i = 0; i < Histogram::kBucketCount && nonEmpty > 0; ++i) {
+        const uint64_t count = histogram.bucket(i);
+        if (count != 0) {
+            appendVarint(out, i);
+            appendVarint(out, count);
+            nonEmpty--;
+        }
+    }
+}
+
+void appendHistogramJson(std::string *out, const char *name, const Histogram &histogram,
+                         bool last) {
+    ::android::base::StringAppendF(
+            out, "\"%s\":{\"n\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}%s",
+            name, static_cast<unsigned long long>(histogram.count()),
+            static_cast<unsigned long long>(histogram.percentile(50)),
+            static_cast<unsigned long long>(histogram.percentile(90)),
+            static_cast<unsigned long long>(histogram.percentile(99)),
+            static_cast<unsigned long long>(histogram.max()), last ? "" : ",");
+}
+
+}  // namespace
+
+void appendFixed32(std::string *out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void appendVarint(std::string *out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+void SessionStats::recordReport(size_t batch, std::chrono::steady_clock::time_point timePoint) {
+    batchSize.record(batch);
+    const int64_t nowNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint.time_since_epoch())
+                    .count();
+    const int64_t lastNs = mLastReportNs.exchange(nowNs, std::memory_order_relaxed);
+    if (lastNs != 0 && nowNs > lastNs) {
+        reportIntervalUs.record((nowNs - lastNs) / 1000);
+    }
+}
+
+std::chrono::steady_clock::time_point SessionStats::lastReportTime() const {
+    return std::chrono::steady_clock::time_point(
+            std::chrono::nanoseconds(mLastReportNs.load(std::memory_order_relaxed)));
+}
+
+void SessionStats::reset() {
+    actualToTargetPct.reset();
+    uclampMin.reset();
+    batchSize.reset();
+    reportIntervalUs.reset();
+    mLastReportNs.store(0, std::memory_order_relaxed);
+}
+
+std::string SessionStats::toString(const char *indent) const {
+    return ::android::base::StringPrintf(
+            "%sactual/target: %s\n%suclamp.min: %s\n%sbatch size: %s\n%sreport interval: %s\n",
+            indent, actualToTargetPct.toString(1.0, "%").c_str(), indent,
+            uclampMin.toString().c_str(), indent, batchSize.toString().c_str(), indent,
+            reportIntervalUs.toString(1000.0, "ms").c_str());
+}
+
+void SessionStats::appendJson(std::string *out) const {
+    out->append("{");
+    appendHistogramJson(out, "actual_to_target_pct", actualToTargetPct, false);
+    appendHistogramJson(out, "uclamp_min", uclampMin, false);
+    appendHistogramJson(out, "batch_size", batchSize, false);
+    appendHistogramJson(out, "report_interval_us", reportIntervalUs, true);
+    out->append("}");
+}
+
+void SessionStats::appendBinary(std::string *out) const {
+    appendHistogram(out, actualToTargetPct);
+    appendHistogram(out, uclampMin);
+    appendHistogram(out, batchSize);
+    appendHistogram(out, reportIntervalUs);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "disp-power/Histogram.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Per-session distributions updated on the reporting path, shared between the
+// PowerHintSession which records and PowerSessionManager which dumps them.
+struct SessionStats {
+    // Version of the binary export layout
+    static constexpr uint16_t kBinaryVersion = 1;
+
+    // Actual duration over target duration, in percent
+    Histogram actualToTargetPct;
+    // uclamp.min set point applied by the PID controller
+    Histogram uclampMin;
+    // Number of work durations per report
+    Histogram batchSize;
+    // Time between two reports, in microseconds
+    Histogram reportIntervalUs;
+
+    void recordReport(size_t batch, std::chrono::steady_clock::time_point timePoint);
+
+    // Time of the last reportActualWorkDuration, epoch if none yet
+    std::chrono::steady_clock::time_point lastReportTime() const;
+
+    // Clear all histograms so the object can be reused by another session
+    void reset();
+
+    // Multi-line percentile summary, each line prefixed by indent
+    std::string toString(const char *indent) const;
+
+    // Append the compact binary form: for each histogram in declaration order
+    // a varint total count, a varint count of non-empty buckets followed by
+    // (varint bucket index, varint bucket count) pairs.
+    void appendBinary(std::string *out) const;
+
+    // Append a JSON object with count and percentiles of each histogram
+    void appendJson(std::string *out) const;
+
+  private:
+    std::atomic<int64_t> mLastReportNs{0};
+};
+
+// Little-endian fixed width and LEB128 varint helpers for the binary export
+void appendFixed32(std::string *out, uint32_t value);
+void appendVarint(std::string *out, uint64_t value);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
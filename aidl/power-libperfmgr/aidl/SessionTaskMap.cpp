@@ -68,24 +68,20 @@ void SessionTaskMap::getTaskVoteRange(pid_t taskId, std::chrono::steady_clock::t
         if (!sessInTask->isActive) {
             continue;
         }
-        sessInTask->votes->getUclampRange(&uclampRange, timeNow);
+        UclampRange sessRange;
+        sessInTask->votes->getUclampRange(&sessRange, timeNow);
+        // Cap by the uclamp.min granted to the session by budget arbitration
+        sessRange.uclampMin = std::min(sessRange.uclampMin, sessInTask->grantedUclampMin);
+        uclampRange.uclampMin = std::max(uclampRange.uclampMin, sessRange.uclampMin);
+        uclampRange.uclampMax = std::min(uclampRange.uclampMax, sessRange.uclampMax);
     }
     *uclampMin = uclampRange.uclampMin;
     *uclampMax = uclampRange.uclampMax;
 }
 
-std::vector<int64_t> SessionTaskMap::getSessionIds(pid_t taskId) const {
+size_t SessionTaskMap::getSessionCount(pid_t taskId) const {
     auto itr = mTasks.find(taskId);
-    if (itr == mTasks.end()) {
-        static const std::vector<int64_t> emptySessionIdVec;
-        return emptySessionIdVec;
-    }
-    std::vector<int64_t> res;
-    res.reserve(itr->second.size());
-    for (const auto &i : itr->second) {
-        res.push_back(i->sessionId);
-    }
-    return res;
+    return itr == mTasks.end() ? 0 : itr->second.size();
 }
 
 std::vector<pid_t> &SessionTaskMap::getTaskIds(int64_t sessionId) {
@@ -155,6 +151,11 @@ bool SessionTaskMap::removeDeadTaskSessionMap(int64_t sessionId, pid_t taskId) {
         return false;
     }
 
+    // Auto-discovery merges the client threads back in, forget the dead one
+    auto &clientTaskIds = sessItr->second.val->clientTaskIds;
+    clientTaskIds.erase(std::remove(clientTaskIds.begin(), clientTaskIds.end(), taskId),
+                        clientTaskIds.end());
+
     auto taskItr = mTasks.find(taskId);
     if (taskItr == mTasks.end()) {
         // Inconsisent state
@@ -47,8 +47,8 @@ class SessionTaskMap {
     void getTaskVoteRange(pid_t taskId, std::chrono::steady_clock::time_point timeNow,
                           int *uclampMin, int *uclampmax) const;
 
-    // Find session ids given a task id if it exists
-    std::vector<int64_t> getSessionIds(pid_t taskId) const;
+    // Number of sessions linked to the task, does not allocate
+    size_t getSessionCount(pid_t taskId) const;
 
     // Get a vec of tasks associated with a session
     std::vector<pid_t> &getTaskIds(int64_t sessionId);
@@ -98,7 +98,7 @@ class SessionTaskMap {
     // Returns true if session id is an app session id
     bool isAppSession(int64_t sessionId) const;
 
-    // Remove dead task-session map entry
+    // Remove dead task-session map entry and the task from the client threads
     bool removeDeadTaskSessionMap(int64_t sessionId, pid_t taskId);
 
   private:
@@ -6,9 +6,14 @@
 
 #pragma once
 
-#include <ostream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "AdpfTypes.h"
+#include "SessionCheckpoint.h"
+#include "SessionStats.h"
 #include "UClampVoter.h"
 
 namespace aidl {
@@ -32,9 +37,21 @@ struct SessionValueEntry {
     bool isAppSession{false};
     std::chrono::steady_clock::time_point lastUpdatedTime;
     std::shared_ptr<Votes> votes;
-
-    // Write info about power session to ostream for logging and debugging
-    std::ostream &dump(std::ostream &os) const;
+    // Time of the queued vote range re-evaluation, max() if none
+    std::chrono::steady_clock::time_point nextEvaluation{
+            std::chrono::steady_clock::time_point::max()};
+    // Threads set by the client, auto-discovered threads are added on top
+    std::vector<pid_t> clientTaskIds;
+    // uclamp.min requested by the votes and granted by budget arbitration
+    int requestedUclampMin{kUclampMin};
+    int grantedUclampMin{kUclampMax};
+    // Cluster placement band the session threads are currently in
+    int placementBand{0};
+    // Last PID state reported by the session, shared with its AppHintDesc,
+    // null when not checkpointing
+    std::shared_ptr<SessionCheckpoint::ControllerStateSlot> controllerState;
+    // Shared with the AppHintDesc of the session
+    std::shared_ptr<SessionStats> stats;
 };
 
 }  // namespace pixel
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "TaskDiscovery.h"
+
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+TaskDiscovery::TaskDiscovery(const std::string &procRoot,
+                             const std::vector<std::string> &commPrefixes)
+    : mProcRoot(procRoot) {
+    for (const auto &prefix : commPrefixes) {
+        if (!prefix.empty()) {
+            mCommPrefixes.push_back(prefix);
+        }
+    }
+}
+
+bool TaskDiscovery::enabled() const {
+    return !mCommPrefixes.empty();
+}
+
+bool TaskDiscovery::commMatches(pid_t tgid, pid_t tid) const {
+    const std::string path = StringPrintf("%s/%d/task/%d/comm", mProcRoot.c_str(), tgid, tid);
+    const int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    // comm is at most 16 bytes including the terminator
+    char comm[32];
+    const ssize_t len = TEMP_FAILURE_RETRY(read(fd, comm, sizeof(comm) - 1));
+    close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    comm[len] = '\0';
+    for (const auto &prefix : mCommPrefixes) {
+        if (strncmp(comm, prefix.c_str(), prefix.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskDiscovery::findMatchingTasks(pid_t tgid, std::vector<pid_t> *taskIds) const {
+    if (!enabled()) {
+        return;
+    }
+    const std::string taskDir = StringPrintf("%s/%d/task", mProcRoot.c_str(), tgid);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(taskDir.c_str()), closedir);
+    if (!dir) {
+        ALOGV("Failed to open %s (%s)", taskDir.c_str(), strerror(errno));
+        return;
+    }
+    while (struct dirent *entry = readdir(dir.get())) {
+        pid_t tid;
+        if (!::android::base::ParseInt(entry->d_name, &tid, 1)) {
+            continue;
+        }
+        if (commMatches(tgid, tid)) {
+            taskIds->push_back(tid);
+        }
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
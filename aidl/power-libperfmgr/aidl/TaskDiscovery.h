@@ -0,0 +1,45 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Find the threads of a thread group whose name (comm) starts with one of
+// the configured prefixes by walking <procRoot>/<tgid>/task
+class TaskDiscovery {
+  public:
+    TaskDiscovery(const std::string &procRoot, const std::vector<std::string> &commPrefixes);
+
+    // Discovery is enabled when at least one comm prefix is configured
+    bool enabled() const;
+
+    // Append the matching threads of tgid to taskIds
+    void findMatchingTasks(pid_t tgid, std::vector<pid_t> *taskIds) const;
+
+  private:
+    bool commMatches(pid_t tgid, pid_t tid) const;
+
+    const std::string mProcRoot;
+    std::vector<std::string> mCommPrefixes;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "ThermalHeadroomMonitor.h"
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <memory>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+
+namespace {
+
+bool readMilliCelsius(int fd, int *tempMc) {
+    char buf[32];
+    const ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    char *end = nullptr;
+    const long value = strtol(buf, &end, 10);
+    if (end == buf) {
+        return false;
+    }
+    *tempMc = static_cast<int>(value);
+    return true;
+}
+
+}  // namespace
+
+ThermalHeadroomMonitor::ThermalHeadroomMonitor(const std::string &thermalRoot,
+                                               const Config &config)
+    : mConfig(config) {
+    if (mConfig.zoneTypes.empty()) {
+        return;
+    }
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(thermalRoot.c_str()), closedir);
+    if (!dir) {
+        ALOGW("Failed to open %s, thermal scaling disabled", thermalRoot.c_str());
+        return;
+    }
+    while (struct dirent *ent = readdir(dir.get())) {
+        if (!::android::base::StartsWith(ent->d_name, "thermal_zone")) {
+            continue;
+        }
+        const std::string zonePath = thermalRoot + "/" + ent->d_name;
+        std::string type;
+        if (!::android::base::ReadFileToString(zonePath + "/type", &type)) {
+            continue;
+        }
+        type = ::android::base::Trim(type);
+        if (std::find(mConfig.zoneTypes.begin(), mConfig.zoneTypes.end(), type) ==
+            mConfig.zoneTypes.end()) {
+            continue;
+        }
+        Zone zone;
+        zone.type = type;
+        zone.throttleMc = mConfig.throttleMc;
+        if (zone.throttleMc <= 0) {
+            std::string trip;
+            if (!::android::base::ReadFileToString(zonePath + "/trip_point_0_temp", &trip) ||
+                !::android::base::ParseInt(::android::base::Trim(trip), &zone.throttleMc) ||
+                zone.throttleMc <= 0) {
+                ALOGW("No throttling temperature for thermal zone %s", type.c_str());
+                continue;
+            }
+        }
+        const std::string tempPath = zonePath + "/temp";
+        zone.tempFd.reset(TEMP_FAILURE_RETRY(open(tempPath.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (!zone.tempFd.ok()) {
+            ALOGW("Failed to open %s (%s)", tempPath.c_str(), strerror(errno));
+            continue;
+        }
+        mZones.push_back(std::move(zone));
+    }
+    if (mZones.size() != mConfig.zoneTypes.size()) {
+        ALOGW("Watching %zu of %zu thermal zones", mZones.size(), mConfig.zoneTypes.size());
+    }
+}
+
+void ThermalHeadroomMonitor::poll() {
+    double scale = 1.0;
+    const double window = std::max(1, mConfig.windowMc);
+    for (auto &zone : mZones) {
+        if (!readMilliCelsius(zone.tempFd.get(), &zone.lastTempMc)) {
+            continue;
+        }
+        const double headroom =
+                std::clamp((zone.throttleMc - zone.lastTempMc) / window, 0.0, 1.0);
+        scale = std::min(scale, mConfig.minScale + (1.0 - mConfig.minScale) * headroom);
+    }
+    mScale.store(scale, std::memory_order_relaxed);
+    mPollCount++;
+}
+
+double ThermalHeadroomMonitor::getScale(std::chrono::steady_clock::time_point timePoint) {
+    if (!enabled()) {
+        return 1.0;
+    }
+    const int64_t nowNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint.time_since_epoch())
+                    .count();
+    const int64_t intervalNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(mConfig.pollInterval).count();
+    if (nowNs - mLastPollNs.load(std::memory_order_relaxed) >= intervalNs) {
+        std::unique_lock<std::mutex> lock(mPollLock, std::try_to_lock);
+        if (lock.owns_lock() && nowNs - mLastPollNs.load(std::memory_order_relaxed) >= intervalNs) {
+            poll();
+            mLastPollNs.store(nowNs, std::memory_order_relaxed);
+        }
+    }
+    const double scale = mScale.load(std::memory_order_relaxed);
+    if (scale < 1.0) {
+        mScaledCount++;
+    }
+    return scale;
+}
+
+void ThermalHeadroomMonitor::dumpToFd(int fd) {
+    std::string result = "========== Begin thermal headroom ==========\n";
+    if (!enabled()) {
+        result += "Disabled\n";
+    } else {
+        std::lock_guard<std::mutex> lock(mPollLock);
+        StringAppendF(&result, "Scale: %.2f (min %.2f), polls: %" PRIu64 ", scaled: %" PRIu64 "\n",
+                      mScale.load(), mConfig.minScale, mPollCount.load(), mScaledCount.load());
+        for (const auto &zone : mZones) {
+            StringAppendF(&result, "%s: %d mC, throttle %d mC\n", zone.type.c_str(),
+                          zone.lastTempMc, zone.throttleMc);
+        }
+    }
+    result += "========== End thermal headroom ==========\n";
+    if (!::android::base::WriteStringToFd(result, fd)) {
+        ALOGE("Failed to dump thermal headroom");
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Tracks the thermal headroom of the selected <thermalRoot>/thermal_zone*
+// nodes and turns it into a scale for ADPF boosts. The scale is 1.0 while all
+// zones are colder than (throttle - window) and drops linearly to minScale as
+// the hottest zone approaches its throttling temperature. Temperatures are
+// read through cached fds and at most once per poll interval.
+class ThermalHeadroomMonitor {
+  public:
+    struct Config {
+        // Types of the thermal zones to watch, monitor is disabled if empty
+        std::vector<std::string> zoneTypes;
+        // Throttling temperature in mC, 0 to use trip_point_0_temp of each zone
+        int throttleMc{0};
+        // Start scaling down this far below the throttling temperature
+        int windowMc{10000};
+        double minScale{0.5};
+        std::chrono::milliseconds pollInterval{500};
+    };
+
+    ThermalHeadroomMonitor(const std::string &thermalRoot, const Config &config);
+
+    bool enabled() const { return !mZones.empty(); }
+
+    // Current scale in [minScale, 1.0], refreshed if the poll interval elapsed
+    double getScale(std::chrono::steady_clock::time_point timePoint);
+
+    void dumpToFd(int fd);
+
+  private:
+    struct Zone {
+        std::string type;
+        ::android::base::unique_fd tempFd;
+        int throttleMc{0};
+        int lastTempMc{0};
+    };
+
+    void poll();
+
+    const Config mConfig;
+    std::vector<Zone> mZones;
+    // Serializes polls, readers which lose the race use the cached scale
+    std::mutex mPollLock;
+    std::atomic<int64_t> mLastPollNs{0};
+    std::atomic<double> mScale{1.0};
+    std::atomic<uint64_t> mPollCount{0};
+    std::atomic<uint64_t> mScaledCount{0};
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -56,6 +56,49 @@ void Votes::getUclampRange(UclampRange *uclampRange,
     }
 }
 
+std::chrono::steady_clock::time_point Votes::nextChangeTime(
+        std::chrono::steady_clock::time_point t) const {
+    UclampRange current;
+    getUclampRange(&current, t);
+    const bool timedOut = allTimedOut(t);
+    auto next = std::chrono::steady_clock::time_point::max();
+    // The range can only change where a vote enters or leaves its time range,
+    // check each such instant after t that is earlier than the best so far.
+    // The session going idle changes the universal boost mode even when the
+    // range stays the same.
+    auto check = [&](std::chrono::steady_clock::time_point candidate) {
+        if (candidate <= t || candidate >= next) {
+            return;
+        }
+        UclampRange range;
+        getUclampRange(&range, candidate);
+        if (range.uclampMin != current.uclampMin || range.uclampMax != current.uclampMax ||
+            allTimedOut(candidate) != timedOut) {
+            next = candidate;
+        }
+    };
+    for (const auto &v : mVotes) {
+        if (!v.second.active()) {
+            continue;
+        }
+        check(v.second.startTime());
+        // isTimeInRange includes the end of the vote
+        check(v.second.startTime() + v.second.durationNs() + std::chrono::nanoseconds(1));
+    }
+    return next;
+}
+
+size_t Votes::deactivateExpired(std::chrono::steady_clock::time_point t) {
+    size_t count = 0;
+    for (auto &v : mVotes) {
+        if (v.second.active() && v.second.startTime() + v.second.durationNs() < t) {
+            v.second.setActive(false);
+            count++;
+        }
+    }
+    return count;
+}
+
 bool Votes::anyTimedOut(std::chrono::steady_clock::time_point t) const {
     for (const auto &v : mVotes) {
         if (!v.second.isTimeInRange(t)) {
@@ -99,6 +99,14 @@ class Votes {
     // the largest min and the smallest max
     void getUclampRange(UclampRange *uclampRange, std::chrono::steady_clock::time_point t) const;
 
+    // Earliest time after t at which getUclampRange() returns a different
+    // range or allTimedOut() flips, time_point::max() if neither changes again
+    std::chrono::steady_clock::time_point nextChangeTime(
+            std::chrono::steady_clock::time_point t) const;
+
+    // Turn off the votes which ended before t, return how many were turned off
+    size_t deactivateExpired(std::chrono::steady_clock::time_point t);
+
     // Return true if any vote has timed out, otherwise return false
     bool anyTimedOut(std::chrono::steady_clock::time_point t) const;
 
@@ -119,6 +127,16 @@ class Votes {
 
     std::chrono::steady_clock::time_point voteTimeout(int voteId);
 
+    // Call fn(voteId, vote) for every vote in range at time point t
+    template <typename FN>
+    void forEachInRange(std::chrono::steady_clock::time_point t, FN fn) const {
+        for (const auto &v : mVotes) {
+            if (v.second.isTimeInRange(t)) {
+                fn(v.first, v.second);
+            }
+        }
+    }
+
   private:
     std::unordered_map<int, VoteRange> mVotes;
 };
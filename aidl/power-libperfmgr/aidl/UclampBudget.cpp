@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "UclampBudget.h"
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+UclampBudget::UclampBudget(int tgidBudget, int globalBudget, Mode mode)
+    : mTgidBudget(std::max(0, tgidBudget)), mGlobalBudget(std::max(0, globalBudget)), mMode(mode) {}
+
+bool UclampBudget::enabled() const {
+    return mTgidBudget > 0 || mGlobalBudget > 0;
+}
+
+template <typename PRED>
+void UclampBudget::fitToBudget(std::vector<Request> *requests, int budget, PRED pred) const {
+    int64_t usage = 0;
+    for (const auto &r : *requests) {
+        if (!pred(r)) {
+            continue;
+        }
+        usage = mMode == Mode::SUM ? usage + r.grantedMin : std::max<int64_t>(usage, r.grantedMin);
+    }
+    if (usage <= budget) {
+        return;
+    }
+    budget = std::max(0, budget);
+    for (auto &r : *requests) {
+        if (pred(r)) {
+            r.grantedMin = static_cast<int>(static_cast<int64_t>(r.grantedMin) * budget / usage);
+        }
+    }
+}
+
+void UclampBudget::arbitrate(std::vector<Request> *requests) {
+    for (auto &r : *requests) {
+        r.grantedMin = r.requestedMin;
+    }
+    if (!enabled()) {
+        return;
+    }
+
+    if (mTgidBudget > 0) {
+        mTgids.clear();
+        for (const auto &r : *requests) {
+            mTgids.push_back(r.tgid);
+        }
+        std::sort(mTgids.begin(), mTgids.end());
+        mTgids.erase(std::unique(mTgids.begin(), mTgids.end()), mTgids.end());
+        for (const int64_t tgid : mTgids) {
+            fitToBudget(requests, mTgidBudget,
+                        [tgid](const Request &req) { return req.tgid == tgid; });
+        }
+    }
+
+    if (mGlobalBudget > 0) {
+        // Foreground first, then the remainder is shared by everyone else
+        fitToBudget(requests, mGlobalBudget, [](const Request &req) { return req.foreground; });
+        int foregroundUsage = 0;
+        for (const auto &r : *requests) {
+            if (r.foreground) {
+                foregroundUsage = mMode == Mode::SUM ? foregroundUsage + r.grantedMin
+                                                     : std::max(foregroundUsage, r.grantedMin);
+            }
+        }
+        const int remaining = mMode == Mode::SUM ? mGlobalBudget - foregroundUsage : mGlobalBudget;
+        fitToBudget(requests, remaining, [](const Request &req) { return !req.foreground; });
+    }
+}
+
+std::string UclampBudget::toString() const {
+    return ::android::base::StringPrintf("UclampBudget(tgid: %d, global: %d, mode: %s)",
+                                         mTgidBudget, mGlobalBudget,
+                                         mMode == Mode::SUM ? "sum" : "max");
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
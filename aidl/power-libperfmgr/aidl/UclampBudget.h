@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Arbitrate the uclamp.min requested by concurrently active sessions against
+// a per thread group and a system wide budget. Sessions of the foreground
+// thread group are served first, the others share what is left and are
+// degraded proportionally when over budget.
+class UclampBudget {
+  public:
+    enum class Mode {
+        // Budget limits the sum of uclamp.min across sessions
+        SUM,
+        // Budget limits the largest uclamp.min across sessions
+        MAX,
+    };
+
+    struct Request {
+        int64_t sessionId{0};
+        int64_t tgid{0};
+        bool foreground{false};
+        int requestedMin{0};
+        // Output of arbitrate()
+        int grantedMin{0};
+    };
+
+    // A budget of 0 disables that level of arbitration
+    UclampBudget(int tgidBudget, int globalBudget, Mode mode);
+
+    bool enabled() const;
+
+    // Fill grantedMin of every request, callers serialize access
+    void arbitrate(std::vector<Request> *requests);
+
+    std::string toString() const;
+
+  private:
+    // Scale the granted values of requests selected by pred to fit in budget
+    template <typename PRED>
+    void fitToBudget(std::vector<Request> *requests, int budget, PRED pred) const;
+
+    const int mTgidBudget;
+    const int mGlobalBudget;
+    const Mode mMode;
+    // Thread groups of the requests, kept across calls so arbitrate does not allocate
+    std::vector<int64_t> mTgids;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -13,13 +13,17 @@
 #include <android/binder_process.h>
 #include <perfmgr/HintManager.h>
 
+#include <chrono>
 #include <thread>
 
+#include "ApiStats.h"
 #include "Power.h"
 #include "PowerExt.h"
 #include "PowerSessionManager.h"
 #include "disp-power/DisplayLowPower.h"
 
+using aidl::google::hardware::power::impl::pixel::ApiStats;
+using aidl::google::hardware::power::impl::pixel::CpuHeadroomEstimator;
 using aidl::google::hardware::power::impl::pixel::DisplayLowPower;
 using aidl::google::hardware::power::impl::pixel::Power;
 using aidl::google::hardware::power::impl::pixel::PowerExt;
@@ -27,22 +31,43 @@ using aidl::google::hardware::power::impl::pixel::PowerSessionManager;
 using ::android::perfmgr::HintManager;
 
 constexpr std::string_view kPowerHalInitProp("vendor.powerhal.init");
+constexpr std::string_view kPowerHalBinderThreadsProp("vendor.powerhal.binder.threads");
+constexpr uint32_t kDefaultBinderThreads = 4;
+constexpr std::string_view kPowerHalApiStatsResetProp("vendor.powerhal.apistats.reset");
+
+static int64_t MsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                 start)
+            .count();
+}
 
 int main() {
     android::base::SetDefaultTag(LOG_TAG);
+    const auto startTime = std::chrono::steady_clock::now();
     // Parse config but do not start the looper
     std::shared_ptr<HintManager> hm = HintManager::GetInstance();
     if (!hm) {
         LOG(FATAL) << "HintManager Init failed";
     }
+    const int64_t configParseMs = MsSince(startTime);
 
     std::shared_ptr<DisplayLowPower> dlpw = std::make_shared<DisplayLowPower>();
+    std::shared_ptr<CpuHeadroomEstimator> cpuHeadroom = std::make_shared<CpuHeadroomEstimator>(
+            "/proc/stat", "/sys/devices/system/cpu/cpufreq",
+            CpuHeadroomEstimator::Config{
+                    .minInterval = std::chrono::milliseconds(::android::base::GetUintProperty(
+                            "vendor.powerhal.cpu_headroom.interval_ms", 100U)),
+            });
+
+    // Binder thread pool, 0 keeps every call on the main thread
+    const uint32_t binderThreads = ::android::base::GetUintProperty<uint32_t>(
+            kPowerHalBinderThreadsProp.data(), kDefaultBinderThreads);
+    ABinderProcess_setThreadPoolMaxThreadCount(binderThreads);
 
-    // single thread
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    ApiStats::getInstance().startResetWatcher(kPowerHalApiStatsResetProp.data());
 
     // core service
-    std::shared_ptr<Power> pw = ndk::SharedRefBase::make<Power>(dlpw);
+    std::shared_ptr<Power> pw = ndk::SharedRefBase::make<Power>(dlpw, cpuHeadroom);
     ndk::SpAIBinder pwBinder = pw->asBinder();
     AIBinder_setMinSchedulerPolicy(pwBinder.get(), SCHED_NORMAL, -20);
 
@@ -58,14 +83,21 @@ int main() {
     binder_status_t status = AServiceManager_addService(pw->asBinder().get(), instance.c_str());
     CHECK(status == STATUS_OK);
     LOG(INFO) << "Sony Power HAL AIDL Service with Extension is started.";
+    const int64_t addServiceMs = MsSince(startTime);
 
     std::thread initThread([&]() {
         ::android::base::WaitForProperty(kPowerHalInitProp.data(), "1");
         HintManager::GetInstance()->Start();
         dlpw->Init();
+        LOG(INFO) << "Startup: config parsed in " << configParseMs << "ms, service added in "
+                  << addServiceMs << "ms, hints started in " << MsSince(startTime) << "ms";
     });
     initThread.detach();
 
+    if (binderThreads > 0) {
+        ABinderProcess_startThreadPool();
+    }
+    LOG(INFO) << "Binder thread pool max threads: " << binderThreads;
     ABinderProcess_joinThreadPool();
 
     // should not reach
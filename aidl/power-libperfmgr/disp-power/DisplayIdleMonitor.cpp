@@ -0,0 +1,279 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "DisplayIdleMonitor.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <set>
+#include <utility>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr const char *kDrmClassPath = "/sys/class/drm";
+constexpr const char *kGraphicsClassPath = "/sys/class/graphics";
+// Re-read interval of the files epoll refuses, only regular files in tests
+constexpr int kPollIntervalMs = 50;
+constexpr uint64_t kExitKey = UINT64_MAX;
+constexpr size_t kMaxEvents = 8;
+constexpr size_t kMaxLength = 64;
+
+std::vector<std::string> ListDir(const std::string &path, const char *prefix) {
+    std::vector<std::string> names;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return names;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0) {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+}  // namespace
+
+DisplayIdleMonitor::DisplayIdleMonitor(std::string sysfsRoot) : mSysfsRoot(std::move(sysfsRoot)) {}
+
+DisplayIdleMonitor::~DisplayIdleMonitor() {
+    if (mThread.joinable()) {
+        uint64_t val = 1;
+        if (write(mExitFd.get(), &val, sizeof(val)) != sizeof(val)) {
+            ALOGW("Unable to stop display idle monitor (%d)", errno);
+        }
+        mThread.join();
+    }
+}
+
+std::shared_ptr<DisplayIdleMonitor> DisplayIdleMonitor::GetDefault() {
+    // Never destroyed so the monitor thread outlives every user
+    static auto *instance =
+            new std::shared_ptr<DisplayIdleMonitor>(std::make_shared<DisplayIdleMonitor>());
+    return *instance;
+}
+
+void DisplayIdleMonitor::DiscoverLocked() {
+    std::vector<std::string> paths;
+    const std::string drmPath = mSysfsRoot + kDrmClassPath;
+    for (const auto &card : ListDir(drmPath, "card")) {
+        // Skip the connectors, e.g. card0-DSI-1
+        if (card.find('-') != std::string::npos) {
+            continue;
+        }
+        paths.emplace_back(drmPath + "/" + card + "/device/idle_state");
+    }
+    const std::string graphicsPath = mSysfsRoot + kGraphicsClassPath;
+    for (const auto &fb : ListDir(graphicsPath, "fb")) {
+        std::string path = graphicsPath + "/" + fb + "/idle_state";
+        if (access(path.c_str(), F_OK) != 0) {
+            path = graphicsPath + "/" + fb + "/device/idle_state";
+        }
+        paths.emplace_back(std::move(path));
+    }
+
+    // The drm card and the fb of one panel may expose the same node
+    std::set<std::pair<dev_t, ino_t>> seen;
+    for (const auto &path : paths) {
+        ::android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstat(fd.get(), &st) != 0 || !seen.emplace(st.st_dev, st.st_ino).second) {
+            continue;
+        }
+        Display display;
+        display.path = path;
+        display.fd = std::move(fd);
+        mDisplays.emplace_back(std::move(display));
+    }
+}
+
+bool DisplayIdleMonitor::Init() {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mInitialized) {
+        return !mDisplays.empty();
+    }
+    mInitialized = true;
+
+    DiscoverLocked();
+    if (mDisplays.empty()) {
+        ALOGE("Unable to open any display idle state path");
+        return false;
+    }
+
+    mEpollFd.reset(epoll_create1(EPOLL_CLOEXEC));
+    mExitFd.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (mEpollFd < 0 || mExitFd < 0) {
+        ALOGE("Unable to create display idle monitor fds (%d)", errno);
+        mDisplays.clear();
+        return false;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kExitKey;
+    if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mExitFd.get(), &ev) != 0) {
+        ALOGE("Unable to watch display idle monitor exit fd (%d)", errno);
+        mDisplays.clear();
+        return false;
+    }
+    for (size_t i = 0; i < mDisplays.size(); ++i) {
+        ev.events = EPOLLPRI | EPOLLERR;
+        ev.data.u64 = i;
+        if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mDisplays[i].fd.get(), &ev) != 0) {
+            // epoll accepts every sysfs node, even one never notified, only
+            // regular files (e.g. a fake sysfs in tests) end up here
+            ALOGW("%s cannot be waited on (%d), re-reading it every %dms",
+                  mDisplays[i].path.c_str(), errno, kPollIntervalMs);
+            mDisplays[i].polled = true;
+            mHasPolledDisplays = true;
+        }
+    }
+
+    // The first read also arms the sysfs notification
+    RefreshLocked();
+    ALOGI("Monitoring idle state of %zu display(s)", mDisplays.size());
+    mThread = std::thread(&DisplayIdleMonitor::Routine, this);
+    return true;
+}
+
+size_t DisplayIdleMonitor::GetDisplayCount() const {
+    std::lock_guard<std::mutex> lk(mLock);
+    return mDisplays.size();
+}
+
+bool DisplayIdleMonitor::ReadIdleLocked(Display *display) {
+    char data[kMaxLength];
+    ssize_t ret = pread(display->fd.get(), data, sizeof(data), 0);
+    // A display which cannot be read must not hold the boost forever
+    bool idle = ret <= 0 || !strncmp(data, "idle", 4);
+    if (idle && !display->idle) {
+        ++display->idleCount;
+    }
+    display->idle = idle;
+    return idle;
+}
+
+bool DisplayIdleMonitor::RefreshLocked() {
+    bool allIdle = true;
+    for (auto &display : mDisplays) {
+        allIdle &= ReadIdleLocked(&display);
+    }
+    if (allIdle && !mAllIdle) {
+        ++mAllIdleCount;
+        uint64_t val = 1;
+        for (int fd : mSubscribers) {
+            if (write(fd, &val, sizeof(val)) != sizeof(val)) {
+                ALOGW("Unable to signal display idle subscriber (%d)", errno);
+            }
+        }
+    }
+    mAllIdle = allIdle;
+    return allIdle;
+}
+
+bool DisplayIdleMonitor::AllIdle() {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mDisplays.empty()) {
+        return true;
+    }
+    return RefreshLocked();
+}
+
+int DisplayIdleMonitor::Subscribe() {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("Unable to create display idle event fd (%d)", errno);
+        return -1;
+    }
+    std::lock_guard<std::mutex> lk(mLock);
+    mSubscribers.push_back(fd);
+    return fd;
+}
+
+void DisplayIdleMonitor::Unsubscribe(int fd) {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        auto it = std::find(mSubscribers.begin(), mSubscribers.end(), fd);
+        if (it == mSubscribers.end()) {
+            return;
+        }
+        mSubscribers.erase(it);
+    }
+    close(fd);
+}
+
+void DisplayIdleMonitor::Routine() {
+    pthread_setname_np(pthread_self(), "DispIdleMon");
+    std::array<struct epoll_event, kMaxEvents> events;
+    const int timeoutMs = mHasPolledDisplays ? kPollIntervalMs : -1;
+
+    while (true) {
+        int n = epoll_wait(mEpollFd.get(), events.data(), events.size(), timeoutMs);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("Display idle monitor stopped on epoll error (%d)", errno);
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == kExitKey) {
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> lk(mLock);
+        ++mWakeups;
+        RefreshLocked();
+    }
+}
+
+void DisplayIdleMonitor::DumpToFd(int fd) const {
+    std::lock_guard<std::mutex> lk(mLock);
+    std::string buf(::android::base::StringPrintf(
+            "Display idle monitor: %zu display(s), all idle: %s, all idle count: %" PRIu64
+            ", wakeups: %" PRIu64 ", subscribers: %zu\n",
+            mDisplays.size(), mAllIdle ? "yes" : "no", mAllIdleCount, mWakeups,
+            mSubscribers.size()));
+    for (const auto &display : mDisplays) {
+        ::android::base::StringAppendF(&buf, "  %s: %s%s, idle count: %" PRIu64 "\n",
+                                       display.path.c_str(), display.idle ? "idle" : "active",
+                                       display.polled ? " (polled)" : "", display.idleCount);
+    }
+    ::android::base::WriteStringToFd(buf, fd);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
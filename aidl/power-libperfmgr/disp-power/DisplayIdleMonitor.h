@@ -0,0 +1,87 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Tracks the idle_state node of every display with a single epoll thread.
+// Components subscribe with an eventfd which is signalled each time all
+// displays have become idle.
+class DisplayIdleMonitor {
+  public:
+    // sysfsRoot is prepended to the sysfs paths, empty for the real sysfs
+    explicit DisplayIdleMonitor(std::string sysfsRoot = "");
+    ~DisplayIdleMonitor();
+
+    // Monitor of the real sysfs shared by the HAL components
+    static std::shared_ptr<DisplayIdleMonitor> GetDefault();
+
+    // Discover the displays and start monitoring, false if there is none
+    bool Init();
+    size_t GetDisplayCount() const;
+    // Re-read every display, true if all of them are idle
+    bool AllIdle();
+
+    // Return a non blocking eventfd owned by the caller which is incremented
+    // every time all displays become idle, -1 on error
+    int Subscribe();
+    // Stop signalling and close the eventfd returned by Subscribe()
+    void Unsubscribe(int fd);
+
+    void DumpToFd(int fd) const;
+
+  private:
+    struct Display {
+        std::string path;
+        ::android::base::unique_fd fd;
+        bool idle{false};
+        // Re-read periodically because epoll refused the file. Sysfs nodes
+        // are always accepted, so in practice this is the test seam which
+        // lets a fake sysfs of regular files drive the monitor.
+        bool polled{false};
+        uint64_t idleCount{0};
+    };
+
+    void DiscoverLocked();
+    bool ReadIdleLocked(Display *display);
+    bool RefreshLocked();
+    void Routine();
+
+    const std::string mSysfsRoot;
+    mutable std::mutex mLock;
+    bool mInitialized{false};
+    bool mAllIdle{false};
+    bool mHasPolledDisplays{false};
+    std::vector<Display> mDisplays;
+    std::vector<int> mSubscribers;
+    uint64_t mWakeups{0};
+    uint64_t mAllIdleCount{0};
+    ::android::base::unique_fd mEpollFd;
+    ::android::base::unique_fd mExitFd;
+    std::thread mThread;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -7,8 +7,18 @@
 #define LOG_TAG "powerhal-libperfmgr"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cinttypes>
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <cutils/sockets.h>
 #include <log/log.h>
 
@@ -21,51 +31,227 @@ namespace power {
 namespace impl {
 namespace pixel {
 
-DisplayLowPower::DisplayLowPower() : mFossStatus(false) {}
+namespace {
+constexpr std::chrono::milliseconds kMinBackoff{100};
+constexpr std::chrono::milliseconds kMaxBackoff{30000};
+// A daemon which does not drain a command within this time is considered stuck
+constexpr int kSendTimeoutMs = 500;
+}  // namespace
+
+DisplayLowPower::DisplayLowPower(std::string socketName)
+    : mSocketName(socketName.empty()
+                          ? ::android::base::GetProperty("vendor.powerhal.pps.socket", "pps")
+                          : std::move(socketName)),
+      mBackoff(kMinBackoff) {}
+
+DisplayLowPower::~DisplayLowPower() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRunning = false;
+        Wake();
+        mStopCv.notify_all();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
 
 void DisplayLowPower::Init() {
-    ConnectPpsDaemon();
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mRunning) {
+        return;
+    }
+    mWakeFd.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (mWakeFd.get() < 0) {
+        ALOGE("Unable to create PPS client event fd (%s)", strerror(errno));
+        return;
+    }
+    mRunning = true;
+    mNextConnect = std::chrono::steady_clock::now();
+    mThread = std::thread(&DisplayLowPower::Routine, this);
 }
 
 void DisplayLowPower::SetDisplayLowPower(bool enable) {
+    std::lock_guard<std::mutex> lock(mLock);
     SetFoss(enable);
+    Wake();
+}
+
+// should be called while locked
+void DisplayLowPower::SetFoss(bool enable) {
+    if (mFossDesired == enable) {
+        return;
+    }
+    // A pending command that was not sent yet is replaced, not queued
+    if (mFossDesired.has_value() && mFossDesired != mFossStatus) {
+        mCommandsCollapsed++;
+    }
+    mFossDesired = enable;
+}
+
+// should be called while locked
+void DisplayLowPower::Wake() {
+    if (mWakeFd.get() < 0) {
+        return;
+    }
+    uint64_t val = 1;
+    if (write(mWakeFd.get(), &val, sizeof(val)) != sizeof(val)) {
+        ALOGW("Unable to wake PPS client (%s)", strerror(errno));
+    }
 }
 
 void DisplayLowPower::ConnectPpsDaemon() {
-    constexpr const char kPpsDaemon[] = "pps";
+    const int ns = mSocketName[0] == '/' ? ANDROID_SOCKET_NAMESPACE_FILESYSTEM
+                                         : ANDROID_SOCKET_NAMESPACE_RESERVED;
+    ::android::base::unique_fd fd(socket_local_client(mSocketName.c_str(), ns, SOCK_STREAM));
+    std::lock_guard<std::mutex> lock(mLock);
+    if (fd.get() < 0 || fcntl(fd.get(), F_SETFL, O_NONBLOCK) < 0) {
+        // Only log the first failure of a series
+        ALOGW_IF(!mConnectFailed, "Connecting to PPS daemon %s failed (%s)", mSocketName.c_str(),
+                 strerror(errno));
+        mConnectFailed = true;
+        mNextConnect = std::chrono::steady_clock::now() + mBackoff;
+        mBackoff = std::min(mBackoff * 2, kMaxBackoff);
+        return;
+    }
+    ALOGI("Connected to PPS daemon %s", mSocketName.c_str());
+    mPpsSocket = std::move(fd);
+    mFossStatus.reset();
+    mConnectFailed = false;
+    mConnectTime = std::chrono::steady_clock::now();
+    mConnects++;
+}
 
-    mPpsSocket.reset(
-            socket_local_client(kPpsDaemon, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM));
-    if (mPpsSocket.get() < 0) {
-        ALOGW("Connecting to PPS daemon failed (%s)", strerror(errno));
+void DisplayLowPower::DisconnectPpsDaemon(const char *reason) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const auto now = std::chrono::steady_clock::now();
+    // Keep backing off while the daemon keeps dropping fresh connections
+    if (now - mConnectTime >= kMaxBackoff) {
+        mBackoff = kMinBackoff;
     }
+    ALOGW("Disconnected from PPS daemon (%s), retrying in %lldms", reason,
+          static_cast<long long>(mBackoff.count()));
+    mPpsSocket.reset();
+    mFossStatus.reset();
+    mNextConnect = now + mBackoff;
+    mBackoff = std::min(mBackoff * 2, kMaxBackoff);
+    mDisconnects++;
 }
 
 int DisplayLowPower::SendPpsCommand(const std::string_view cmd) {
-    if (TEMP_FAILURE_RETRY(write(mPpsSocket.get(), cmd.data(), cmd.size())) < 0) {
-        ALOGE("Failed to send pps command '%s' over socket (%s)", cmd.data(), strerror(errno));
-        return -1;
+    size_t sent = 0;
+    while (sent < cmd.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(send(mPpsSocket.get(), cmd.data() + sent,
+                                              cmd.size() - sent, MSG_NOSIGNAL));
+        if (ret >= 0) {
+            sent += ret;
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ALOGE("Failed to send pps command '%.*s' over socket (%s)",
+                  static_cast<int>(cmd.size()), cmd.data(), strerror(errno));
+            return -1;
+        }
+        struct pollfd pfd = {mPpsSocket.get(), POLLOUT, 0};
+        if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kSendTimeoutMs)) <= 0) {
+            ALOGE("Timed out sending pps command '%.*s'", static_cast<int>(cmd.size()),
+                  cmd.data());
+            return -1;
+        }
     }
 
     return 0;
 }
 
-void DisplayLowPower::SetFoss(bool enable) {
-    if (mPpsSocket.get() < 0 || mFossStatus == enable) {
-        return;
-    }
+void DisplayLowPower::Routine() {
+    pthread_setname_np(pthread_self(), "pps_client");
+    std::chrono::milliseconds pollBackoff = kMinBackoff;
 
-    ALOGI("%s foss", (enable) ? "Enable" : "Disable");
+    while (true) {
+        int timeoutMs = -1;
+        std::optional<bool> command;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mRunning) {
+                return;
+            }
+            if (mPpsSocket.get() >= 0 && mFossDesired.has_value() &&
+                mFossDesired != mFossStatus) {
+                command = mFossDesired;
+            }
+            if (mPpsSocket.get() < 0) {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+                        mNextConnect - std::chrono::steady_clock::now());
+                timeoutMs = std::max<int>(wait.count(), 0);
+            }
+        }
 
-    std::string_view foss_cmd;
-    if (enable) {
-        foss_cmd = "foss:on";
-    } else {
-        foss_cmd = "foss:off";
+        if (mPpsSocket.get() < 0 && timeoutMs == 0) {
+            ConnectPpsDaemon();
+            continue;
+        }
+
+        if (command.has_value()) {
+            ALOGI("%s foss", (*command) ? "Enable" : "Disable");
+            if (SendPpsCommand(*command ? "foss:on" : "foss:off")) {
+                {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mSendFailures++;
+                }
+                DisconnectPpsDaemon("send failed");
+            } else {
+                std::lock_guard<std::mutex> lock(mLock);
+                mFossStatus = command;
+                mCommandsSent++;
+            }
+            continue;
+        }
+
+        struct pollfd pfd[2] = {{mWakeFd.get(), POLLIN, 0}, {mPpsSocket.get(), POLLIN, 0}};
+        int ret = poll(pfd, mPpsSocket.get() >= 0 ? 2 : 1, timeoutMs);
+        if (ret < 0 && errno != EINTR) {
+            const int err = errno;
+            std::unique_lock<std::mutex> lock(mLock);
+            ALOGE("PPS client poll failed (%s), retrying in %lldms", strerror(err),
+                  static_cast<long long>(pollBackoff.count()));
+            mPollFailures++;
+            // Poll would fail again right away, sleep unless stopped
+            mStopCv.wait_for(lock, pollBackoff, [&]() { return !mRunning; });
+            pollBackoff = std::min(pollBackoff * 2, kMaxBackoff);
+            continue;
+        }
+        pollBackoff = kMinBackoff;
+        if (pfd[0].revents) {
+            uint64_t val;
+            ssize_t len = read(mWakeFd.get(), &val, sizeof(val));
+            ALOGW_IF(len < 0, "%s: failed to clear eventfd (%zd, %d)", __func__, len, errno);
+        }
+        if (mPpsSocket.get() >= 0 && pfd[1].revents) {
+            // The daemon does not reply, readable means closed or an error
+            char buf[64];
+            ssize_t len = TEMP_FAILURE_RETRY(read(mPpsSocket.get(), buf, sizeof(buf)));
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                DisconnectPpsDaemon(len == 0 ? "closed by daemon" : strerror(errno));
+            }
+        }
     }
+}
 
-    if (!SendPpsCommand(foss_cmd)) {
-        mFossStatus = enable;
+void DisplayLowPower::DumpToFd(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto fossString = [](const std::optional<bool> &foss) {
+        return foss.has_value() ? (*foss ? "on" : "off") : "unknown";
+    };
+    std::string buf(::android::base::StringPrintf(
+            "PPS client %s: %s, foss desired: %s, daemon: %s\n"
+            "  sent=%" PRIu64 " collapsed=%" PRIu64 " failures=%" PRIu64 " connects=%" PRIu64
+            " disconnects=%" PRIu64 " poll_failures=%" PRIu64 " backoff=%lldms\n",
+            mSocketName.c_str(), mPpsSocket.get() >= 0 ? "connected" : "disconnected",
+            fossString(mFossDesired), fossString(mFossStatus), mCommandsSent, mCommandsCollapsed,
+            mSendFailures, mConnects, mDisconnects, mPollFailures,
+            static_cast<long long>(mBackoff.count())));
+    if (!::android::base::WriteStringToFd(buf, fd)) {
+        ALOGE("Failed to dump PPS client to fd:%d", fd);
     }
 }
 
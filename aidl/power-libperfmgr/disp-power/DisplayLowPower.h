@@ -6,7 +6,14 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <thread>
 
 #include <android-base/unique_fd.h>
 
@@ -17,20 +24,50 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+// Client of the PPS daemon. Requests only update the desired foss state and
+// never block, a worker thread owns the non blocking socket, reconnects with
+// backoff when the daemon goes away and replays the last desired state.
 class DisplayLowPower {
   public:
-    DisplayLowPower();
-    ~DisplayLowPower() {}
+    // Reserved socket name, or an absolute path for a filesystem socket.
+    // Empty uses vendor.powerhal.pps.socket.
+    explicit DisplayLowPower(std::string socketName = "");
+    ~DisplayLowPower();
     void Init();
     void SetDisplayLowPower(bool enable);
+    void DumpToFd(int fd);
 
   private:
+    void Routine();
     void ConnectPpsDaemon();
+    void DisconnectPpsDaemon(const char *reason);
     int SendPpsCommand(const std::string_view cmd);
     void SetFoss(bool enable);
+    void Wake();
 
+    const std::string mSocketName;
+    // Guards the foss state and the stats against concurrent binder calls,
+    // the socket is only used by the worker thread
+    std::mutex mLock;
     ::android::base::unique_fd mPpsSocket;
-    bool mFossStatus;
+    ::android::base::unique_fd mWakeFd;
+    std::thread mThread;
+    bool mRunning{false};
+    // Cuts the backoff after a poll failure short when stopping
+    std::condition_variable mStopCv;
+    std::optional<bool> mFossDesired;
+    // State last accepted by the connected daemon, unknown after reconnecting
+    std::optional<bool> mFossStatus;
+    std::chrono::milliseconds mBackoff;
+    std::chrono::steady_clock::time_point mNextConnect;
+    std::chrono::steady_clock::time_point mConnectTime;
+    bool mConnectFailed{false};
+    uint64_t mCommandsSent{0};
+    uint64_t mCommandsCollapsed{0};
+    uint64_t mSendFailures{0};
+    uint64_t mConnects{0};
+    uint64_t mDisconnects{0};
+    uint64_t mPollFailures{0};
 };
 
 }  // namespace pixel
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Fixed memory log-linear histogram of unsigned values. Every power of two is
+// split into kSubBuckets linear buckets, so a bucket bounds its values within
+// 1/kSubBuckets (25%) relative error. Recording is a few relaxed atomic
+// increments and is safe from any thread; readers see an approximate snapshot.
+class Histogram {
+  public:
+    static constexpr size_t kSubBucketBits = 2;
+    static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) {
+        mBuckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prevMax = mMax.load(std::memory_order_relaxed);
+        while (value > prevMax &&
+               !mMax.compare_exchange_weak(prevMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return mSum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t index) const { return mBuckets[index].load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t percentile(double p) const {
+        uint64_t total = 0;
+        for (const auto &b : mBuckets) {
+            total += b.load(std::memory_order_relaxed);
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += mBuckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(bucketUpperBound(i), max());
+            }
+        }
+        return max();
+    }
+
+    // Accumulate another histogram, e.g. to combine per-thread shards for reading
+    void add(const Histogram &other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            mBuckets[i].fetch_add(other.bucket(i), std::memory_order_relaxed);
+        }
+        mCount.fetch_add(other.count(), std::memory_order_relaxed);
+        mSum.fetch_add(other.sum(), std::memory_order_relaxed);
+        const uint64_t otherMax = other.max();
+        uint64_t prevMax = mMax.load(std::memory_order_relaxed);
+        while (otherMax > prevMax &&
+               !mMax.compare_exchange_weak(prevMax, otherMax, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (auto &b : mBuckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+        mCount.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    // "n=<count> p50=<..> p90=<..> p99=<..> max=<..>" with values divided by divisor
+    std::string toString(double divisor = 1.0, const char *unit = "") const {
+        return ::android::base::StringPrintf(
+                "n=%llu p50=%.1f%s p90=%.1f%s p99=%.1f%s max=%.1f%s",
+                static_cast<unsigned long long>(count()), percentile(50) / divisor, unit,
+                percentile(90) / divisor, unit, percentile(99) / divisor, unit, max() / divisor,
+                unit);
+    }
+
+    static constexpr size_t bucketIndex(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        const size_t msb = 63 - __builtin_clzll(value);
+        const size_t shift = msb - kSubBucketBits;
+        const size_t sub = (value >> shift) & (kSubBuckets - 1);
+        return (shift + 1) * kSubBuckets + sub;
+    }
+
+    static constexpr uint64_t bucketUpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        const size_t shift = index / kSubBuckets - 1;
+        const uint64_t lower = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+        return lower + ((uint64_t{1} << shift) - 1);
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, kBucketCount> mBuckets{};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<uint64_t> mSum{0};
+    std::atomic<uint64_t> mMax{0};
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "InstrumentedMutex.h"
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <dlfcn.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+// Registry of live lock statistics, locks are long lived so a vector is enough
+std::mutex &registryLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+std::vector<LockStats *> &registry() {
+    static std::vector<LockStats *> stats;
+    return stats;
+}
+
+std::string describeCallSite(const void *callSite) {
+    if (callSite == nullptr) {
+        return "-";
+    }
+    Dl_info info;
+    if (dladdr(callSite, &info) == 0) {
+        return ::android::base::StringPrintf("%p", callSite);
+    }
+    if (info.dli_sname != nullptr) {
+        return ::android::base::StringPrintf(
+                "%s+0x%zx", info.dli_sname,
+                static_cast<size_t>(static_cast<const char *>(callSite) -
+                                    static_cast<const char *>(info.dli_saddr)));
+    }
+    // Not exported, module offset can be symbolized offline
+    if (info.dli_fname != nullptr) {
+        return ::android::base::StringPrintf(
+                "%s+0x%zx", info.dli_fname,
+                static_cast<size_t>(static_cast<const char *>(callSite) -
+                                    static_cast<const char *>(info.dli_fbase)));
+    }
+    return ::android::base::StringPrintf("%p", callSite);
+}
+
+}  // namespace
+
+LockStats::LockStats(const char *lockName) : name(lockName) {
+    std::lock_guard<std::mutex> lock(registryLock());
+    registry().push_back(this);
+}
+
+LockStats::~LockStats() {
+    std::lock_guard<std::mutex> lock(registryLock());
+    auto &stats = registry();
+    stats.erase(std::remove(stats.begin(), stats.end(), this), stats.end());
+}
+
+void LockStats::recordWait(int64_t waitTimeNs, const void *callSite) {
+    waitNs.record(waitTimeNs);
+    contendedCount.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mCallSiteLock);
+    auto end = mCallSites.begin() + mCallSiteCount;
+    auto itr = std::find_if(mCallSites.begin(), end,
+                            [&](const CallSite &c) { return c.address == callSite; });
+    if (itr == end) {
+        if (mCallSiteCount < kMaxCallSites) {
+            itr->address = callSite;
+            mCallSiteCount++;
+        } else {
+            // Callers which did not fit are added up in the last entry
+            itr = mCallSites.begin() + kMaxCallSites;
+        }
+    }
+    itr->count++;
+    itr->totalWaitNs += waitTimeNs;
+    itr->maxWaitNs = std::max(itr->maxWaitNs, waitTimeNs);
+}
+
+std::vector<LockStats::CallSite> LockStats::callSites() const {
+    std::lock_guard<std::mutex> lock(mCallSiteLock);
+    std::vector<CallSite> sites(mCallSites.begin(), mCallSites.begin() + mCallSiteCount);
+    if (mCallSites[kMaxCallSites].count > 0) {
+        sites.push_back(mCallSites[kMaxCallSites]);
+    }
+    return sites;
+}
+
+void LockStats::reset() {
+    waitNs.reset();
+    holdNs.reset();
+    contendedCount.store(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mCallSiteLock);
+    mCallSites.fill({});
+    mCallSiteCount = 0;
+}
+
+bool LockStatsEnabled() {
+    static const bool enabled =
+            ::android::base::GetBoolProperty("vendor.powerhal.lockstats", false);
+    return enabled;
+}
+
+void DumpLockStats(int fd) {
+    std::string result = "========== Begin lock stats ==========\n";
+    if (!LockStatsEnabled()) {
+        result += "Disabled, set vendor.powerhal.lockstats to enable\n";
+    } else {
+        std::lock_guard<std::mutex> lock(registryLock());
+        for (const auto *stats : registry()) {
+            ::android::base::StringAppendF(
+                    &result, "%s: contended %llu\n  wait %s\n  hold %s\n", stats->name,
+                    static_cast<unsigned long long>(stats->contendedCount.load()),
+                    stats->waitNs.toString(1000.0, "us").c_str(),
+                    stats->holdNs.toString(1000.0, "us").c_str());
+            auto sites = stats->callSites();
+            std::sort(sites.begin(), sites.end(), [](const auto &a, const auto &b) {
+                return a.totalWaitNs > b.totalWaitNs;
+            });
+            for (const auto &site : sites) {
+                ::android::base::StringAppendF(
+                        &result, "  from %s: %llu waits, total %.1fus, max %.1fus\n",
+                        site.address ? describeCallSite(site.address).c_str() : "other",
+                        static_cast<unsigned long long>(site.count), site.totalWaitNs / 1000.0,
+                        site.maxWaitNs / 1000.0);
+            }
+        }
+    }
+    result += "========== End lock stats ==========\n";
+    if (!::android::base::WriteStringToFd(result, fd)) {
+        ALOGE("Failed to dump lock stats");
+    }
+}
+
+void ResetLockStats() {
+    std::lock_guard<std::mutex> lock(registryLock());
+    for (auto *stats : registry()) {
+        stats->reset();
+    }
+}
+
+InstrumentedMutex::InstrumentedMutex(const char *name)
+    : InstrumentedMutex(name, LockStatsEnabled()) {}
+
+InstrumentedMutex::InstrumentedMutex(const char *name, bool enabled)
+    : mStats(enabled ? std::make_unique<LockStats>(name) : nullptr) {}
+
+InstrumentedSharedMutex::InstrumentedSharedMutex(const char *name)
+    : InstrumentedSharedMutex(name, LockStatsEnabled()) {}
+
+InstrumentedSharedMutex::InstrumentedSharedMutex(const char *name, bool enabled)
+    : mStats(enabled ? std::make_unique<LockStats>(name) : nullptr) {}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "Histogram.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Wait and hold time statistics of one named lock
+struct LockStats {
+    explicit LockStats(const char *lockName);
+    ~LockStats();
+
+    void recordWait(int64_t waitNs, const void *callSite);
+
+    // Contended waits of one caller
+    struct CallSite {
+        const void *address{nullptr};
+        uint64_t count{0};
+        int64_t totalWaitNs{0};
+        int64_t maxWaitNs{0};
+    };
+    static constexpr size_t kMaxCallSites = 8;
+    // Callers seen since the last reset, callers past kMaxCallSites are
+    // added up in the entry with a null address
+    std::vector<CallSite> callSites() const;
+    void reset();
+
+    const char *name;
+    Histogram waitNs;
+    Histogram holdNs;
+    std::atomic<uint64_t> contendedCount{0};
+
+  private:
+    // Only taken after a contended wait
+    mutable std::mutex mCallSiteLock;
+    std::array<CallSite, kMaxCallSites + 1> mCallSites;
+    size_t mCallSiteCount{0};
+};
+
+// Lock statistics are collected only when vendor.powerhal.lockstats is set at
+// start, otherwise the wrappers below cost one predictable branch per call.
+bool LockStatsEnabled();
+void DumpLockStats(int fd);
+void ResetLockStats();
+
+// Drop-in std::mutex replacement recording wait and hold times. Use it with
+// InstrumentedConditionVariable where a condition variable is needed.
+class InstrumentedMutex {
+  public:
+    explicit InstrumentedMutex(const char *name);
+    // Collect stats regardless of vendor.powerhal.lockstats
+    InstrumentedMutex(const char *name, bool enabled);
+    InstrumentedMutex(const InstrumentedMutex &) = delete;
+    InstrumentedMutex &operator=(const InstrumentedMutex &) = delete;
+
+    __attribute__((noinline)) void lock() {
+        if (!mStats) {
+            mMutex.lock();
+            return;
+        }
+        if (!mMutex.try_lock()) {
+            const auto start = std::chrono::steady_clock::now();
+            mMutex.lock();
+            mAcquiredAt = std::chrono::steady_clock::now();
+            mStats->recordWait((mAcquiredAt - start).count(), __builtin_return_address(0));
+            return;
+        }
+        mAcquiredAt = std::chrono::steady_clock::now();
+        mStats->waitNs.record(0);
+    }
+
+    bool try_lock() {
+        if (!mMutex.try_lock()) {
+            return false;
+        }
+        if (mStats) {
+            mAcquiredAt = std::chrono::steady_clock::now();
+        }
+        return true;
+    }
+
+    void unlock() {
+        if (mStats) {
+            mStats->holdNs.record((std::chrono::steady_clock::now() - mAcquiredAt).count());
+        }
+        mMutex.unlock();
+    }
+
+    // Null when stats are disabled
+    const LockStats *stats() const { return mStats.get(); }
+
+  private:
+    friend class InstrumentedConditionVariable;
+
+    std::mutex mMutex;
+    std::unique_ptr<LockStats> mStats;
+    std::chrono::steady_clock::time_point mAcquiredAt;
+};
+
+// std::condition_variable for an InstrumentedMutex. Time spent waiting for a
+// notification counts as neither wait nor hold time. Unlike
+// std::condition_variable_any it adds no internal lock to every wait.
+class InstrumentedConditionVariable {
+  public:
+    void notify_one() noexcept { mCv.notify_one(); }
+    void notify_all() noexcept { mCv.notify_all(); }
+
+    template <typename Predicate>
+    void wait(std::unique_lock<InstrumentedMutex> &lock, Predicate pred) {
+        while (!pred()) {
+            InstrumentedMutex &mutex = *lock.mutex();
+            endHold(mutex);
+            std::unique_lock<std::mutex> native(mutex.mMutex, std::adopt_lock);
+            mCv.wait(native);
+            native.release();
+            startHold(mutex);
+        }
+    }
+
+    template <typename Clock, typename Duration, typename Predicate>
+    bool wait_until(std::unique_lock<InstrumentedMutex> &lock,
+                    const std::chrono::time_point<Clock, Duration> &deadline, Predicate pred) {
+        while (!pred()) {
+            InstrumentedMutex &mutex = *lock.mutex();
+            endHold(mutex);
+            std::unique_lock<std::mutex> native(mutex.mMutex, std::adopt_lock);
+            const std::cv_status status = mCv.wait_until(native, deadline);
+            native.release();
+            startHold(mutex);
+            if (status == std::cv_status::timeout) {
+                return pred();
+            }
+        }
+        return true;
+    }
+
+  private:
+    static void endHold(InstrumentedMutex &mutex) {
+        if (mutex.mStats) {
+            mutex.mStats->holdNs.record(
+                    (std::chrono::steady_clock::now() - mutex.mAcquiredAt).count());
+        }
+    }
+
+    static void startHold(InstrumentedMutex &mutex) {
+        if (mutex.mStats) {
+            mutex.mAcquiredAt = std::chrono::steady_clock::now();
+        }
+    }
+
+    std::condition_variable mCv;
+};
+
+// std::shared_mutex replacement. Exclusive holds record wait and hold times,
+// shared holds record wait time only as readers do not own the lock alone.
+class InstrumentedSharedMutex {
+  public:
+    explicit InstrumentedSharedMutex(const char *name);
+    // Collect stats regardless of vendor.powerhal.lockstats
+    InstrumentedSharedMutex(const char *name, bool enabled);
+    InstrumentedSharedMutex(const InstrumentedSharedMutex &) = delete;
+    InstrumentedSharedMutex &operator=(const InstrumentedSharedMutex &) = delete;
+
+    __attribute__((noinline)) void lock() {
+        if (!mStats) {
+            mMutex.lock();
+            return;
+        }
+        if (!mMutex.try_lock()) {
+            const auto start = std::chrono::steady_clock::now();
+            mMutex.lock();
+            mAcquiredAt = std::chrono::steady_clock::now();
+            mStats->recordWait((mAcquiredAt - start).count(), __builtin_return_address(0));
+            return;
+        }
+        mAcquiredAt = std::chrono::steady_clock::now();
+        mStats->waitNs.record(0);
+    }
+
+    void unlock() {
+        if (mStats) {
+            mStats->holdNs.record((std::chrono::steady_clock::now() - mAcquiredAt).count());
+        }
+        mMutex.unlock();
+    }
+
+    __attribute__((noinline)) void lock_shared() {
+        if (!mStats) {
+            mMutex.lock_shared();
+            return;
+        }
+        if (!mMutex.try_lock_shared()) {
+            const auto start = std::chrono::steady_clock::now();
+            mMutex.lock_shared();
+            mStats->recordWait((std::chrono::steady_clock::now() - start).count(),
+                               __builtin_return_address(0));
+            return;
+        }
+        mStats->waitNs.record(0);
+    }
+
+    void unlock_shared() { mMutex.unlock_shared(); }
+
+    // Null when stats are disabled
+    const LockStats *stats() const { return mStats.get(); }
+
+  private:
+    std::shared_mutex mMutex;
+    std::unique_ptr<LockStats> mStats;
+    std::chrono::steady_clock::time_point mAcquiredAt;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
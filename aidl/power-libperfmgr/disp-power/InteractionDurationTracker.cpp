@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "InteractionDurationTracker.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <string>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+constexpr const char *kContextNames[InteractionDurationTracker::CONTEXT_COUNT] = {
+        "tap",
+        "short",
+        "long",
+};
+}  // namespace
+
+InteractionDurationTracker::InteractionDurationTracker(size_t window, uint32_t percentile,
+                                                       uint32_t headroomPct, size_t minSamples)
+    : mWindow(std::max<size_t>(window, 1)),
+      mPercentile(std::min<uint32_t>(percentile, 100)),
+      mHeadroomPct(headroomPct),
+      mMinSamples(std::clamp<size_t>(minSamples, 1, mWindow)) {
+    for (auto &stats : mContexts) {
+        stats.window.reserve(mWindow);
+    }
+}
+
+InteractionDurationTracker::Context InteractionDurationTracker::GetContext(
+        int32_t durationMs, uint32_t minDurationMs) {
+    if (durationMs <= 0)
+        return CONTEXT_TAP;
+    if (static_cast<uint32_t>(durationMs) < minDurationMs)
+        return CONTEXT_SHORT;
+    return CONTEXT_LONG;
+}
+
+void InteractionDurationTracker::Record(Context context, uint32_t idleMs, bool timedOut) {
+    ContextStats &stats = mContexts[context];
+    if (stats.window.size() < mWindow) {
+        stats.window.push_back(idleMs);
+    } else {
+        stats.window[stats.next] = idleMs;
+    }
+    stats.next = (stats.next + 1) % mWindow;
+    stats.idleMs.record(idleMs);
+    if (timedOut)
+        stats.timeouts++;
+    UpdateLearned(&stats);
+}
+
+void InteractionDurationTracker::UpdateLearned(ContextStats *stats) {
+    if (stats->window.size() < mMinSamples) {
+        stats->learnedMs = 0;
+        return;
+    }
+    // The window is small, a copy keeps it in insertion order
+    std::vector<uint32_t> sorted(stats->window);
+    const size_t rank = (sorted.size() - 1) * mPercentile / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    stats->learnedMs = static_cast<uint32_t>(static_cast<uint64_t>(sorted[rank]) * mHeadroomPct /
+                                             100);
+}
+
+void InteractionDurationTracker::DumpToFd(int fd) const {
+    std::string buf(::android::base::StringPrintf(
+            "Interaction idle latency (p%u of last %zu, %u%% headroom):\n", mPercentile, mWindow,
+            mHeadroomPct));
+    for (size_t i = 0; i < CONTEXT_COUNT; i++) {
+        const ContextStats &stats = mContexts[i];
+        ::android::base::StringAppendF(&buf, "  %s: learned=%ums timeouts=%" PRIu64 " %s\n",
+                                       kContextNames[i], stats.learnedMs, stats.timeouts,
+                                       stats.idleMs.toString(1.0, "ms").c_str());
+    }
+    ::android::base::WriteStringToFd(buf, fd);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
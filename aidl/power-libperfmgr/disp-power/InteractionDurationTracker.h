@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Histogram.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Learns how long the displays take to go idle after an interaction boost, per
+// kind of interaction, from a sliding window of the latest measurements. Not
+// thread safe, the owner serializes the calls.
+class InteractionDurationTracker {
+  public:
+    enum Context {
+        // Boost without duration, e.g. a tap
+        CONTEXT_TAP,
+        // Duration shorter than the static minimum
+        CONTEXT_SHORT,
+        // Duration of at least the static minimum, e.g. a fling
+        CONTEXT_LONG,
+        CONTEXT_COUNT,
+    };
+
+    // percentile of the last window samples, scaled by headroomPct, is learned
+    // once a context has at least minSamples samples
+    InteractionDurationTracker(size_t window, uint32_t percentile, uint32_t headroomPct,
+                               size_t minSamples);
+
+    static Context GetContext(int32_t durationMs, uint32_t minDurationMs);
+
+    // Record the time from the last boost to idle. Timed out boosts are
+    // recorded with the boost duration, which pushes the learned value up.
+    void Record(Context context, uint32_t idleMs, bool timedOut);
+
+    // Learned boost duration of the context, 0 until there are enough samples
+    uint32_t GetLearnedMs(Context context) const { return mContexts[context].learnedMs; }
+
+    void DumpToFd(int fd) const;
+
+  private:
+    struct ContextStats {
+        std::vector<uint32_t> window;
+        size_t next{0};
+        uint32_t learnedMs{0};
+        uint64_t timeouts{0};
+        Histogram idleMs;
+    };
+
+    void UpdateLearned(ContextStats *stats);
+
+    const size_t mWindow;
+    const uint32_t mPercentile;
+    const uint32_t mHeadroomPct;
+    const size_t mMinSamples;
+    std::array<ContextStats, CONTEXT_COUNT> mContexts;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -9,8 +9,9 @@
 
 #include "InteractionHandler.h"
 
+#include <android-base/file.h>
 #include <android-base/properties.h>
-#include <fcntl.h>
+#include <android-base/stringprintf.h>
 #include <perfmgr/HintManager.h>
 #include <poll.h>
 #include <sys/eventfd.h>
@@ -19,10 +20,11 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
-#include <array>
+#include <algorithm>
+#include <cinttypes>
 #include <memory>
-
-#define MAX_LENGTH 64
+#include <string>
+#include <utility>
 
 #define MSINSEC 1000L
 #define NSINMS 1000000L
@@ -38,9 +40,6 @@ namespace {
 
 static const bool kDisplayIdleSupport =
         ::android::base::GetBoolProperty("vendor.powerhal.disp.idle_support", true);
-static const std::array<const char *, 3> kDispIdlePath = {"/sys/class/drm/card0/device/idle_state",
-                                                          "/sys/class/graphics/fb0/idle_state",
-                                                          "/sys/class/graphics/fb0/device/idle_state"};
 static const uint32_t kWaitMs =
         ::android::base::GetUintProperty("vendor.powerhal.disp.idle_wait", /*default*/ 100U);
 static const uint32_t kMinDurationMs =
@@ -49,6 +48,16 @@ static const uint32_t kMaxDurationMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.max", /*default*/ 5650U);
 static const uint32_t kDurationOffsetMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.offset", /*default*/ 650U);
+static const bool kAdaptiveDuration =
+        ::android::base::GetBoolProperty("vendor.powerhal.interaction.adaptive", false);
+static const uint32_t kAdaptiveWindow = ::android::base::GetUintProperty(
+        "vendor.powerhal.interaction.adaptive.window", /*default*/ 64U);
+static const uint32_t kAdaptivePercentile = ::android::base::GetUintProperty(
+        "vendor.powerhal.interaction.adaptive.percentile", /*default*/ 90U);
+static const uint32_t kAdaptiveHeadroomPct = ::android::base::GetUintProperty(
+        "vendor.powerhal.interaction.adaptive.headroom", /*default*/ 125U);
+static const uint32_t kAdaptiveMinSamples = ::android::base::GetUintProperty(
+        "vendor.powerhal.interaction.adaptive.min_samples", /*default*/ 16U);
 
 static size_t CalcTimespecDiffMs(struct timespec start, struct timespec end) {
     size_t diff_in_ms = 0;
@@ -57,35 +66,39 @@ static size_t CalcTimespecDiffMs(struct timespec start, struct timespec end) {
     return diff_in_ms;
 }
 
-static int FbIdleOpen(void) {
-    int fd;
-    for (const auto &path : kDispIdlePath) {
-        fd = open(path, O_RDONLY);
-        if (fd >= 0)
-            return fd;
-    }
-    ALOGE("Unable to open fb idle state path (%d)", errno);
-    return -1;
-}
+constexpr const char *kWaitForIdleResultNames[WAIT_FOR_IDLE_RESULT_COUNT] = {
+        "error",
+        "aborted",
+        "already idle",
+        "idle",
+        "timeout",
+};
 
 }  // namespace
 
 using ::android::perfmgr::HintManager;
 
-InteractionHandler::InteractionHandler()
-    : mState(INTERACTION_STATE_UNINITIALIZED), mDurationMs(0) {}
+InteractionHandler::InteractionHandler(std::shared_ptr<DisplayIdleMonitor> idleMonitor)
+    : mState(INTERACTION_STATE_UNINITIALIZED),
+      mIdleMonitor(std::move(idleMonitor)),
+      mDurationMs(0),
+      mContext(InteractionDurationTracker::CONTEXT_TAP),
+      mDurationTracker(kAdaptiveWindow, kAdaptivePercentile, kAdaptiveHeadroomPct,
+                       kAdaptiveMinSamples) {}
 
 InteractionHandler::~InteractionHandler() {
     Exit();
 }
 
 bool InteractionHandler::Init() {
-    std::lock_guard<std::mutex> lk(mLock);
+    std::lock_guard<InstrumentedMutex> lk(mLock);
 
     if (mState != INTERACTION_STATE_UNINITIALIZED)
         return true;
 
-    int fd = FbIdleOpen();
+    if (!mIdleMonitor->Init())
+        return false;
+    int fd = mIdleMonitor->Subscribe();
     if (fd < 0)
         return false;
     mIdleFd = fd;
@@ -93,7 +106,7 @@ bool InteractionHandler::Init() {
     mEventFd = eventfd(0, EFD_NONBLOCK);
     if (mEventFd < 0) {
         ALOGE("Unable to create event fd (%d)", errno);
-        close(mIdleFd);
+        mIdleMonitor->Unsubscribe(mIdleFd);
         return false;
     }
 
@@ -104,7 +117,7 @@ bool InteractionHandler::Init() {
 }
 
 void InteractionHandler::Exit() {
-    std::unique_lock<std::mutex> lk(mLock);
+    std::unique_lock<InstrumentedMutex> lk(mLock);
     if (mState == INTERACTION_STATE_UNINITIALIZED)
         return;
 
@@ -116,7 +129,7 @@ void InteractionHandler::Exit() {
     mThread->join();
 
     close(mEventFd);
-    close(mIdleFd);
+    mIdleMonitor->Unsubscribe(mIdleFd);
 }
 
 void InteractionHandler::PerfLock() {
@@ -124,6 +137,8 @@ void InteractionHandler::PerfLock() {
     if (!HintManager::GetInstance()->DoHint("INTERACTION")) {
         ALOGE("%s: do hint INTERACTION failed", __func__);
     }
+    clock_gettime(CLOCK_MONOTONIC, &mHoldTimespec);
+    ATRACE_INT("INTERACTION held", 1);
 }
 
 void InteractionHandler::PerfRel() {
@@ -131,12 +146,16 @@ void InteractionHandler::PerfRel() {
     if (!HintManager::GetInstance()->EndHint("INTERACTION")) {
         ALOGE("%s: end hint INTERACTION failed", __func__);
     }
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    mHoldMs.record(CalcTimespecDiffMs(mHoldTimespec, cur_timespec));
+    ATRACE_INT("INTERACTION held", 0);
 }
 
 void InteractionHandler::Acquire(int32_t duration) {
     ATRACE_CALL();
 
-    std::lock_guard<std::mutex> lk(mLock);
+    std::lock_guard<InstrumentedMutex> lk(mLock);
 
     int inputDuration = duration + kDurationOffsetMs;
     int finalDuration;
@@ -147,11 +166,25 @@ void InteractionHandler::Acquire(int32_t duration) {
     else
         finalDuration = kMinDurationMs;
 
+    // Once enough idle latencies were measured for this kind of interaction,
+    // boost for the learned duration but never shorter than the static path
+    // above would for the same request
+    InteractionDurationTracker::Context context =
+            InteractionDurationTracker::GetContext(duration, kMinDurationMs);
+    uint32_t learnedMs = mDurationTracker.GetLearnedMs(context);
+    if (kAdaptiveDuration && learnedMs > 0) {
+        int adaptiveDuration = std::max<int>(learnedMs, inputDuration);
+        finalDuration = std::clamp<int>(adaptiveDuration,
+                                        std::min(kMinDurationMs, kMaxDurationMs),
+                                        kMaxDurationMs);
+    }
+
     // Fallback to do boost directly
     // 1) override property is set OR
     // 2) InteractionHandler not initialized
     if (!kDisplayIdleSupport || mState == INTERACTION_STATE_UNINITIALIZED) {
         HintManager::GetInstance()->DoHint("INTERACTION", std::chrono::milliseconds(finalDuration));
+        mAcquireDirect++;
         return;
     }
 
@@ -164,11 +197,13 @@ void InteractionHandler::Acquire(int32_t duration) {
             ALOGV("%s: Previous duration (%d) cover this (%d) elapsed: %lld", __func__,
                   static_cast<int>(mDurationMs), static_cast<int>(finalDuration),
                   static_cast<long long>(elapsed_time));
+            mAcquireCoalesced++;
             return;
         }
     }
     mLastTimespec = cur_timespec;
     mDurationMs = finalDuration;
+    mContext = context;
 
     ALOGV("%s: input: %d final duration: %d", __func__, duration, finalDuration);
 
@@ -176,15 +211,29 @@ void InteractionHandler::Acquire(int32_t duration) {
         AbortWaitLocked();
     else if (mState == INTERACTION_STATE_IDLE)
         PerfLock();
+    if (mState == INTERACTION_STATE_IDLE)
+        mAcquireStarted++;
+    else
+        mAcquireExtended++;
 
     mState = INTERACTION_STATE_INTERACTION;
     mCond.notify_one();
 }
 
-void InteractionHandler::Release() {
-    std::lock_guard<std::mutex> lk(mLock);
+void InteractionHandler::Release(enum WaitForIdleResult result, struct timespec boost_timespec) {
+    std::lock_guard<InstrumentedMutex> lk(mLock);
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    size_t wait_ms = CalcTimespecDiffMs(boost_timespec, cur_timespec);
+    mWaitResultCount[result]++;
+    mWaitMs[result].record(wait_ms);
+
     if (mState == INTERACTION_STATE_WAITING) {
         ATRACE_CALL();
+        if (result == WAIT_FOR_IDLE_IDLE || result == WAIT_FOR_IDLE_ALREADY_IDLE ||
+            result == WAIT_FOR_IDLE_TIMEOUT) {
+            mDurationTracker.Record(mContext, wait_ms, result == WAIT_FOR_IDLE_TIMEOUT);
+        }
         PerfRel();
         mState = INTERACTION_STATE_IDLE;
     } else {
@@ -204,9 +253,9 @@ void InteractionHandler::AbortWaitLocked() {
         ALOGW("Unable to write to event fd (%zd)", ret);
 }
 
-void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
-    char data[MAX_LENGTH];
+enum WaitForIdleResult InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
     ssize_t ret;
+    uint64_t val;
     struct pollfd pfd[2];
 
     ATRACE_CALL();
@@ -216,42 +265,60 @@ void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
     pfd[0].fd = mEventFd;
     pfd[0].events = POLLIN;
     pfd[1].fd = mIdleFd;
-    pfd[1].events = POLLPRI | POLLERR;
+    pfd[1].events = POLLIN;
 
     ret = poll(pfd, 1, wait_ms);
     if (ret > 0) {
         ALOGV("%s: wait aborted", __func__);
-        return;
+        return WAIT_FOR_IDLE_ABORTED;
     } else if (ret < 0) {
         ALOGE("%s: error in poll while waiting", __func__);
-        return;
+        return WAIT_FOR_IDLE_ERROR;
     }
 
-    ret = pread(mIdleFd, data, sizeof(data), 0);
-    if (!ret) {
-        ALOGE("%s: Unexpected EOF!", __func__);
-        return;
+    // drop the idle notifications of the previous interactions
+    while (read(mIdleFd, &val, sizeof(val)) > 0) {
     }
 
-    if (!strncmp(data, "idle", 4)) {
+    if (mIdleMonitor->AllIdle()) {
         ALOGV("%s: already idle", __func__);
-        return;
+        return WAIT_FOR_IDLE_ALREADY_IDLE;
     }
 
     ret = poll(pfd, 2, timeout_ms);
-    if (ret < 0)
+    if (ret < 0) {
         ALOGE("%s: Error on waiting for idle (%zd)", __func__, ret);
-    else if (ret == 0)
+        return WAIT_FOR_IDLE_ERROR;
+    } else if (ret == 0) {
         ALOGV("%s: timed out waiting for idle", __func__);
-    else if (pfd[0].revents)
+        return WAIT_FOR_IDLE_TIMEOUT;
+    } else if (pfd[0].revents) {
         ALOGV("%s: wait for idle aborted", __func__);
-    else if (pfd[1].revents)
-        ALOGV("%s: idle detected", __func__);
+        return WAIT_FOR_IDLE_ABORTED;
+    }
+    ALOGV("%s: idle detected", __func__);
+    return WAIT_FOR_IDLE_IDLE;
+}
+
+void InteractionHandler::DumpToFd(int fd) {
+    std::lock_guard<InstrumentedMutex> lk(mLock);
+    std::string buf(::android::base::StringPrintf(
+            "Interaction boost: started=%" PRIu64 " extended=%" PRIu64 " coalesced=%" PRIu64
+            " direct=%" PRIu64 "\n  held: %s\n",
+            mAcquireStarted, mAcquireExtended, mAcquireCoalesced, mAcquireDirect,
+            mHoldMs.toString(1.0, "ms").c_str()));
+    for (size_t i = 0; i < WAIT_FOR_IDLE_RESULT_COUNT; i++) {
+        ::android::base::StringAppendF(&buf, "  wait %s: %" PRIu64 " %s\n",
+                                       kWaitForIdleResultNames[i], mWaitResultCount[i],
+                                       mWaitMs[i].toString(1.0, "ms").c_str());
+    }
+    ::android::base::WriteStringToFd(buf, fd);
+    mDurationTracker.DumpToFd(fd);
 }
 
 void InteractionHandler::Routine() {
     pthread_setname_np(pthread_self(), "DispIdle");
-    std::unique_lock<std::mutex> lk(mLock, std::defer_lock);
+    std::unique_lock<InstrumentedMutex> lk(mLock, std::defer_lock);
 
     while (true) {
         lk.lock();
@@ -259,10 +326,11 @@ void InteractionHandler::Routine() {
         if (mState == INTERACTION_STATE_UNINITIALIZED)
             return;
         mState = INTERACTION_STATE_WAITING;
+        struct timespec boost_timespec = mLastTimespec;
         lk.unlock();
 
-        WaitForIdle(kWaitMs, mDurationMs);
-        Release();
+        enum WaitForIdleResult result = WaitForIdle(kWaitMs, mDurationMs);
+        Release(result, boost_timespec);
     }
 }
 
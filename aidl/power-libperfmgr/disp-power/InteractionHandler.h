@@ -6,12 +6,17 @@
 
 #pragma once
 
-#include <condition_variable>
+#include <array>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 
+#include "DisplayIdleMonitor.h"
+#include "Histogram.h"
+#include "InstrumentedMutex.h"
+#include "InteractionDurationTracker.h"
+
 namespace aidl {
 namespace google {
 namespace hardware {
@@ -26,17 +31,28 @@ enum InteractionState {
     INTERACTION_STATE_WAITING,
 };
 
+enum WaitForIdleResult {
+    WAIT_FOR_IDLE_ERROR,
+    WAIT_FOR_IDLE_ABORTED,
+    WAIT_FOR_IDLE_ALREADY_IDLE,
+    WAIT_FOR_IDLE_IDLE,
+    WAIT_FOR_IDLE_TIMEOUT,
+    WAIT_FOR_IDLE_RESULT_COUNT,
+};
+
 class InteractionHandler {
   public:
-    InteractionHandler();
+    explicit InteractionHandler(
+            std::shared_ptr<DisplayIdleMonitor> idleMonitor = DisplayIdleMonitor::GetDefault());
     ~InteractionHandler();
     bool Init();
     void Exit();
     void Acquire(int32_t duration);
+    void DumpToFd(int fd);
 
   private:
-    void Release();
-    void WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
+    void Release(enum WaitForIdleResult result, struct timespec boost_timespec);
+    enum WaitForIdleResult WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
     void AbortWaitLocked();
     void Routine();
 
@@ -44,13 +60,27 @@ class InteractionHandler {
     void PerfRel();
 
     enum InteractionState mState;
+    std::shared_ptr<DisplayIdleMonitor> mIdleMonitor;
     int mIdleFd;
     int mEventFd;
     int32_t mDurationMs;
     struct timespec mLastTimespec;
+    InteractionDurationTracker::Context mContext;
+    InteractionDurationTracker mDurationTracker;
+    // Telemetry, counters are guarded by mLock
+    uint64_t mAcquireStarted{0};
+    uint64_t mAcquireExtended{0};
+    uint64_t mAcquireCoalesced{0};
+    uint64_t mAcquireDirect{0};
+    std::array<uint64_t, WAIT_FOR_IDLE_RESULT_COUNT> mWaitResultCount{};
+    // Time from the last boost to the end of the wait, per result
+    std::array<Histogram, WAIT_FOR_IDLE_RESULT_COUNT> mWaitMs;
+    // Time INTERACTION was held, from PerfLock() to PerfRel()
+    Histogram mHoldMs;
+    struct timespec mHoldTimespec;
     std::unique_ptr<std::thread> mThread;
-    std::mutex mLock;
-    std::condition_variable mCond;
+    InstrumentedMutex mLock{"InteractionHandler::mLock"};
+    InstrumentedConditionVariable mCond;
 };
 
 }  // namespace pixel
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aidl/ApiStats.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::microseconds;
+
+namespace {
+
+// The watcher resets from its own thread, wait for the count to follow
+bool WaitForCount(ApiId id, uint64_t expected) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (ApiStats::getInstance().count(id) != expected) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST(ApiStatsTest, ShardsAddUp) {
+    constexpr size_t kThreads = ApiStats::kShards * 2;
+    constexpr int kCalls = 100;
+    ApiStats &stats = ApiStats::getInstance();
+    stats.reset();
+    // More threads than shards, some of them share one
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&stats, t]() {
+            for (int i = 0; i < kCalls; i++) {
+                stats.record(ApiId::SESSION_SEND_HINT, microseconds(t + 1));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(stats.count(ApiId::SESSION_SEND_HINT), kThreads * kCalls);
+    EXPECT_EQ(stats.count(ApiId::SESSION_CLOSE), 0);
+
+    TemporaryFile dump;
+    stats.dumpToFd(dump.fd);
+    std::string out;
+    ASSERT_TRUE(::android::base::ReadFileToString(dump.path, &out));
+    EXPECT_NE(out.find("PowerHintSession::sendHint: n=" + std::to_string(kThreads * kCalls) +
+                       " "),
+              std::string::npos)
+            << out;
+    // Calls never made are left out
+    EXPECT_EQ(out.find("PowerHintSession::close"), std::string::npos) << out;
+}
+
+TEST(ApiStatsTest, PropertyChangeResets) {
+    const std::string property = "debug.powerhal.apistats.test_reset";
+    ApiStats &stats = ApiStats::getInstance();
+    stats.reset();
+    stats.startResetWatcher(property.c_str());
+    // Creating the property or changing it both reset, use a new value each time
+    const auto base = std::chrono::steady_clock::now().time_since_epoch().count();
+    for (int round = 0; round < 2; round++) {
+        stats.record(ApiId::POWER_SET_BOOST, microseconds(10));
+        ASSERT_EQ(stats.count(ApiId::POWER_SET_BOOST), 1);
+        ASSERT_TRUE(::android::base::SetProperty(property, std::to_string(base + round)));
+        EXPECT_TRUE(WaitForCount(ApiId::POWER_SET_BOOST, 0)) << "round " << round;
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "aidl/AsyncIoExecutor.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+class AsyncIoExecutorTest : public TempDirFixture {
+  protected:
+    void SetUp() override {
+        ASSERT_NO_FATAL_FAILURE(TempDirFixture::SetUp());
+        mExecutor = std::make_unique<AsyncIoExecutor>(mRoot);
+    }
+
+    void TearDown() override {
+        mExecutor.reset();
+        TempDirFixture::TearDown();
+    }
+
+    std::string Read(const std::string &path) {
+        std::string value;
+        ::android::base::ReadFileToString(mRoot + path, &value);
+        return value;
+    }
+
+    // Opening the write end of a FIFO blocks the worker until the test opens
+    // the read end, which lets the test hold the queue
+    void MakeFifo(const std::string &path) { ASSERT_EQ(mkfifo((mRoot + path).c_str(), 0600), 0); }
+
+    std::string DrainFifo(const std::string &path) {
+        ::android::base::unique_fd fd(open((mRoot + path).c_str(), O_RDONLY));
+        std::string value;
+        ::android::base::ReadFdToString(fd.get(), &value);
+        return value;
+    }
+
+    bool Exists(const std::string &path) { return access((mRoot + path).c_str(), F_OK) == 0; }
+
+    std::unique_ptr<AsyncIoExecutor> mExecutor;
+};
+
+TEST_F(AsyncIoExecutorTest, WritesReachTheFakeSysfs) {
+    mExecutor->writeFile("/cmd", "sod_enable,1");
+    mExecutor->writeFile("/mode", "1");
+    mExecutor.reset();
+    EXPECT_EQ(Read("/cmd"), "sod_enable,1");
+    EXPECT_EQ(Read("/mode"), "1");
+}
+
+TEST_F(AsyncIoExecutorTest, SupersededWriteIsCollapsed) {
+    MakeFifo("/block");
+    mExecutor->writeFile("/block", "x");
+    mExecutor->writeFile("/mode", "1");
+    mExecutor->writeFile("/mode", "0");
+    mExecutor->writeFile("/mode", "1");
+    EXPECT_EQ(DrainFifo("/block"), "x");
+    mExecutor.reset();
+    EXPECT_EQ(Read("/mode"), "1");
+}
+
+TEST_F(AsyncIoExecutorTest, CollapsedWriteKeepsSubmissionOrder) {
+    MakeFifo("/block");
+    MakeFifo("/cmd");
+    mExecutor->writeFile("/block", "x");
+    // pre_sod_mode is queued first but rewritten after cmd, it must not be
+    // written before cmd
+    mExecutor->writeFile("/mode", "0");
+    mExecutor->writeFile("/cmd", "sod_enable,1");
+    mExecutor->writeFile("/mode", "1");
+    EXPECT_EQ(DrainFifo("/block"), "x");
+
+    // The worker is now blocked writing cmd
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(Exists("/mode"));
+    EXPECT_EQ(DrainFifo("/cmd"), "sod_enable,1");
+    mExecutor.reset();
+    EXPECT_EQ(Read("/mode"), "1");
+}
+
+TEST_F(AsyncIoExecutorTest, FailedWriteDoesNotStopTheQueue) {
+    mExecutor->writeFile("/missing/dir/node", "1");
+    mExecutor->writeFile("/mode", "1");
+    mExecutor.reset();
+    EXPECT_EQ(Read("/mode"), "1");
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
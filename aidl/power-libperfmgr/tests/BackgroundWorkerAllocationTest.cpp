@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Built as its own test binary, the operator new below counts every
+// allocation of the process and must not see other tests' threads.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <latch>
+#include <memory>
+#include <new>
+
+#include "aidl/BackgroundWorker.h"
+#include "tests/RunCounter.h"
+
+namespace {
+
+// Heap allocations made by any thread while counting is on
+std::atomic<bool> gCountAllocations{false};
+std::atomic<uint64_t> gAllocations{0};
+
+}  // namespace
+
+void *operator new(size_t size) {
+    if (gCountAllocations.load(std::memory_order_relaxed)) {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        std::abort();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+struct Package {
+    int64_t sessionId{0};
+    int64_t value{0};
+};
+
+}  // namespace
+
+// Once the slab and the queues have grown to the burst size, scheduling and
+// running packages does not touch the heap from any thread
+TEST(BackgroundWorkerAllocationTest, SteadyStateDoesNotAllocate) {
+    constexpr int kThreads = 2;
+    constexpr int kBurst = 48;
+    constexpr int kRounds = 200;
+    auto pool = std::make_shared<PriorityQueueWorkerPool>(kThreads, "test");
+    RunCounter processed;
+    std::latch blocked(kThreads);
+    std::latch gate(1);
+    struct Context {
+        RunCounter *processed;
+        std::latch *blocked;
+        std::latch *gate;
+    } context{&processed, &blocked, &gate};
+    // A negative value holds its thread until the gate opens
+    TemplatePriorityQueueWorker<Package> worker(
+            [ctx = &context](const Package &p) {
+                if (p.value < 0) {
+                    ctx->blocked->count_down();
+                    ctx->gate->wait();
+                    return;
+                }
+                ctx->processed->add();
+            },
+            pool);
+    uint64_t expected = 0;
+    auto scheduleBurst = [&]() {
+        const auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < kBurst; i++) {
+            worker.schedule({i, i}, now, i);
+        }
+        expected += kBurst;
+    };
+    // Warm up with every thread held, so the whole burst is pending at once
+    // and the slab and the queues grow to their steady state size
+    for (int i = 0; i < kThreads; i++) {
+        worker.schedule({i, -1}, std::chrono::steady_clock::now(), i);
+    }
+    blocked.wait();
+    scheduleBurst();
+    gate.count_down();
+    ASSERT_TRUE(processed.waitFor(expected));
+    const size_t capacity = worker.capacity();
+
+    gAllocations.store(0);
+    gCountAllocations.store(true);
+    bool done = true;
+    for (int round = 0; round < kRounds && done; round++) {
+        scheduleBurst();
+        done = processed.waitFor(expected);
+    }
+    gCountAllocations.store(false);
+
+    ASSERT_TRUE(done);
+    EXPECT_EQ(processed.count(), expected);
+    EXPECT_EQ(worker.capacity(), capacity);
+    RecordProperty("allocations", std::to_string(gAllocations.load()));
+    RecordProperty("packages", std::to_string(kBurst * kRounds));
+    EXPECT_EQ(gAllocations.load(), 0);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
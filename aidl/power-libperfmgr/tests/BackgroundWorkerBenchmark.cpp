@@ -0,0 +1,121 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "aidl/BackgroundWorker.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int kSessions = 16;
+constexpr int kBurst = 64;
+
+// Lag between the deadline of a package and its callback starting
+struct LagRecorder {
+    std::vector<int64_t> lagNs;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+};
+
+struct LagPackage {
+    std::chrono::steady_clock::time_point deadline;
+};
+
+void SpinFor(std::chrono::nanoseconds duration) {
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+void WaitForCount(const std::atomic<size_t> &count, size_t expected) {
+    while (count.load(std::memory_order_acquire) < expected) {
+        std::this_thread::yield();
+    }
+}
+
+}  // namespace
+
+// Bursts of due events from many sessions, each callback doing a little
+// work like a session re-evaluation. The counters report the dispatch lag
+// percentiles for each pool size.
+static void BM_PriorityQueueWorkerPool_DispatchLag(benchmark::State &state) {
+    auto pool = std::make_shared<PriorityQueueWorkerPool>(state.range(0), "bench");
+    LagRecorder recorder;
+    recorder.lagNs.resize(kBurst * 2048);
+    TemplatePriorityQueueWorker<LagPackage> worker(
+            [rec = &recorder](const LagPackage &package) {
+                const auto lag = std::chrono::steady_clock::now() - package.deadline;
+                const size_t i = rec->next.fetch_add(1, std::memory_order_relaxed);
+                rec->lagNs[i % rec->lagNs.size()] = lag.count();
+                SpinFor(std::chrono::microseconds(20));
+                rec->done.fetch_add(1, std::memory_order_release);
+            },
+            pool, kBurst);
+    size_t expected = 0;
+    for (auto _ : state) {
+        const auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < kBurst; i++) {
+            worker.schedule({now}, now, i % kSessions);
+        }
+        expected += kBurst;
+        WaitForCount(recorder.done, expected);
+    }
+    std::vector<int64_t> lags(recorder.lagNs.begin(),
+                              recorder.lagNs.begin() + std::min(expected, recorder.lagNs.size()));
+    std::sort(lags.begin(), lags.end());
+    if (!lags.empty()) {
+        state.counters["lag_p50_us"] = lags[lags.size() / 2] / 1000.0;
+        state.counters["lag_p99_us"] = lags[lags.size() * 99 / 100] / 1000.0;
+        state.counters["lag_max_us"] = lags.back() / 1000.0;
+    }
+    state.SetItemsProcessed(expected);
+}
+BENCHMARK(BM_PriorityQueueWorkerPool_DispatchLag)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+// Cost of scheduling and running a package once the slab has grown to the
+// burst size, the path which no longer allocates
+static void BM_TemplatePriorityQueueWorker_Schedule(benchmark::State &state) {
+    auto pool = std::make_shared<PriorityQueueWorkerPool>(1, "bench");
+    std::atomic<size_t> done{0};
+    TemplatePriorityQueueWorker<LagPackage> worker(
+            [count = &done](const LagPackage &) {
+                count->fetch_add(1, std::memory_order_release);
+            },
+            pool, kBurst);
+    size_t expected = 0;
+    for (auto _ : state) {
+        const auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < kBurst; i++) {
+            worker.schedule({now}, now, i % kSessions);
+        }
+        expected += kBurst;
+        WaitForCount(done, expected);
+    }
+    state.counters["capacity"] = worker.capacity();
+    state.SetItemsProcessed(expected);
+}
+BENCHMARK(BM_TemplatePriorityQueueWorker_Schedule)->UseRealTime();
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
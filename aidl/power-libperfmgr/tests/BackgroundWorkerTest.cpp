@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "aidl/BackgroundWorker.h"
+#include "tests/RunCounter.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+struct Package {
+    int64_t sessionId{0};
+    int64_t value{0};
+};
+
+}  // namespace
+
+TEST(BackgroundWorkerTest, RunsPackagesInDeadlineOrderPerKey) {
+    auto pool = std::make_shared<PriorityQueueWorkerPool>(2, "test");
+    RunCounter processed;
+    std::atomic<int64_t> lastValue[2] = {-1, -1};
+    std::atomic<bool> ordered{true};
+    struct Context {
+        RunCounter *processed;
+        std::atomic<int64_t> *lastValue;
+        std::atomic<bool> *ordered;
+    } context{&processed, lastValue, &ordered};
+    TemplatePriorityQueueWorker<Package> worker(
+            [ctx = &context](const Package &p) {
+                if (ctx->lastValue[p.sessionId].exchange(p.value) > p.value) {
+                    ctx->ordered->store(false);
+                }
+                ctx->processed->add();
+            },
+            pool);
+    const auto now = std::chrono::steady_clock::now();
+    // Scheduled out of order, each key runs by deadline
+    for (int64_t v = 9; v >= 0; v--) {
+        for (int64_t s = 0; s < 2; s++) {
+            worker.schedule({s, v}, now + std::chrono::milliseconds(5 + v), s);
+        }
+    }
+    ASSERT_TRUE(processed.waitFor(20));
+    EXPECT_EQ(processed.count(), 20);
+    EXPECT_TRUE(ordered.load());
+}
+
+TEST(BackgroundWorkerTest, RemovedCallbackDropsPendingPackages) {
+    auto pool = std::make_shared<PriorityQueueWorkerPool>(1, "test");
+    RunCounter processed;
+    std::atomic<int64_t> lastValue{0};
+    struct Context {
+        RunCounter *processed;
+        std::atomic<int64_t> *lastValue;
+    } context{&processed, &lastValue};
+    auto callback = [ctx = &context](const Package &p) {
+        ctx->lastValue->store(p.value);
+        ctx->processed->add();
+    };
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    {
+        TemplatePriorityQueueWorker<Package> worker(callback, pool);
+        worker.schedule({1, 1}, deadline);
+    }
+    // A new callback may reuse the slot, the stale package must not reach it.
+    // The single thread runs by deadline, so once the later package ran the
+    // stale one has been dropped.
+    TemplatePriorityQueueWorker<Package> worker(callback, pool);
+    worker.schedule({1, 2}, deadline + std::chrono::milliseconds(1));
+    ASSERT_TRUE(processed.waitFor(1));
+    EXPECT_EQ(lastValue.load(), 2);
+    EXPECT_EQ(processed.count(), 1);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
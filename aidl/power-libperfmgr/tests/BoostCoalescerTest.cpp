@@ -0,0 +1,91 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "aidl/BoostCoalescer.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+class BoostCoalescerTest : public ::testing::Test {
+  protected:
+    bool Issue(int32_t durationMs, steady_clock::time_point t) {
+        return mCoalescer.issue(0, durationMs, t, [&]() { mHints.push_back(durationMs); });
+    }
+
+    BoostCoalescer mCoalescer{2};
+    std::vector<int32_t> mHints;
+    const steady_clock::time_point mStart = steady_clock::now();
+};
+
+TEST_F(BoostCoalescerTest, CoveredTimedBoostIsCoalesced) {
+    EXPECT_TRUE(Issue(100, mStart));
+    EXPECT_FALSE(Issue(50, mStart + milliseconds(10)));
+    EXPECT_FALSE(Issue(90, mStart + milliseconds(10)));
+    EXPECT_EQ(mHints, std::vector<int32_t>({100}));
+    EXPECT_EQ(mCoalescer.issuedCount(0), 1u);
+    EXPECT_EQ(mCoalescer.coalescedCount(0), 2u);
+}
+
+TEST_F(BoostCoalescerTest, ExtendingBoostIsIssued) {
+    EXPECT_TRUE(Issue(100, mStart));
+    EXPECT_TRUE(Issue(100, mStart + milliseconds(50)));
+    EXPECT_TRUE(Issue(10, mStart + milliseconds(200)));
+    EXPECT_EQ(mHints.size(), 3u);
+}
+
+TEST_F(BoostCoalescerTest, UntimedBoostIsNeverCoalesced) {
+    // e.g. DISPLAY_UPDATE_IMMINENT sent with duration 0 every frame, the
+    // powerhint config decides how long each one lasts
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(Issue(0, mStart + milliseconds(i * 16)));
+    }
+    // Nothing is known to cover a timed request after an untimed one
+    EXPECT_TRUE(Issue(10, mStart + milliseconds(170)));
+    EXPECT_EQ(mHints.size(), 11u);
+    EXPECT_EQ(mCoalescer.coalescedCount(0), 0u);
+}
+
+TEST_F(BoostCoalescerTest, EndResetsCoverage) {
+    EXPECT_TRUE(Issue(1000, mStart));
+    EXPECT_TRUE(Issue(-1, mStart + milliseconds(10)));
+    EXPECT_TRUE(Issue(100, mStart + milliseconds(20)));
+    EXPECT_EQ(mHints, std::vector<int32_t>({1000, -1, 100}));
+}
+
+TEST_F(BoostCoalescerTest, ResetForgetsActiveWindows) {
+    EXPECT_TRUE(Issue(1000, mStart));
+    mCoalescer.reset();
+    EXPECT_TRUE(Issue(100, mStart + milliseconds(10)));
+}
+
+TEST_F(BoostCoalescerTest, BoostsAreIndependent) {
+    EXPECT_TRUE(Issue(1000, mStart));
+    EXPECT_TRUE(mCoalescer.issue(1, 100, mStart, []() {}));
+    EXPECT_EQ(mCoalescer.issuedCount(1), 1u);
+    // Out of range boosts are always issued
+    bool called = false;
+    EXPECT_TRUE(mCoalescer.issue(5, 100, mStart, [&]() { called = true; }));
+    EXPECT_TRUE(called);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
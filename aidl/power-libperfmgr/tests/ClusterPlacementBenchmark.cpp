@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "aidl/ClusterPlacement.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr size_t kTasksPerSession = 4;
+constexpr int kFrames = 3600;
+
+// PID set points of a session over a minute at 60 fps: a slow load swing
+// across both thresholds with frame to frame jitter on top
+const std::vector<int> &GetSetPointTrace() {
+    static const std::vector<int> trace = []() {
+        std::vector<int> setPoints;
+        std::mt19937 rng(7);
+        std::normal_distribution<double> jitter(0.0, 40.0);
+        for (int frame = 0; frame < kFrames; frame++) {
+            const double load = 450 + 300 * std::sin(frame * 2 * M_PI / 600);
+            setPoints.push_back(std::clamp(static_cast<int>(load + jitter(rng)), 0, 1024));
+        }
+        return setPoints;
+    }();
+    return trace;
+}
+
+}  // namespace
+
+// Replays the trace through the placement bands, the counters report the
+// profile transitions and per-task migrations for each hysteresis
+static void BM_ClusterPlacement_Replay(benchmark::State &state) {
+    const int hysteresis = state.range(0);
+    const auto &trace = GetSetPointTrace();
+    uint64_t transitions = 0;
+    uint64_t migrations = 0;
+    for (auto _ : state) {
+        ClusterPlacement placement({"SCHED_SP_DEFAULT", "CPUSET_SP_FOREGROUND",
+                                    "CPUSET_SP_TOP_APP"},
+                                   {300, 600}, hysteresis);
+        int band = 0;
+        transitions = 0;
+        for (const int setPoint : trace) {
+            const int next = placement.nextBand(band, setPoint);
+            if (next != band) {
+                placement.recordTransition(band, next, kTasksPerSession, 0);
+                band = next;
+                transitions++;
+            }
+        }
+        migrations = transitions * kTasksPerSession;
+        benchmark::DoNotOptimize(band);
+    }
+    state.counters["transitions"] = transitions;
+    state.counters["migrations"] = migrations;
+    state.counters["frames"] = kFrames;
+}
+BENCHMARK(BM_ClusterPlacement_Replay)->Arg(0)->Arg(25)->Arg(50)->Arg(100);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
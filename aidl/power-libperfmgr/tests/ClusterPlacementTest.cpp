@@ -0,0 +1,87 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "aidl/ClusterPlacement.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+ClusterPlacement MakePlacement(int hysteresis) {
+    return ClusterPlacement({"SCHED_SP_DEFAULT", "CPUSET_SP_FOREGROUND", "CPUSET_SP_TOP_APP"},
+                            {300, 600}, hysteresis);
+}
+
+}  // namespace
+
+TEST(ClusterPlacementTest, InvalidConfigIsDisabled) {
+    EXPECT_FALSE(ClusterPlacement({}, {}, 0).enabled());
+    EXPECT_FALSE(ClusterPlacement({"A", "B"}, {300, 600}, 0).enabled());
+    EXPECT_FALSE(ClusterPlacement({"A", "B", "C"}, {600, 300}, 0).enabled());
+    EXPECT_FALSE(ClusterPlacement(std::vector<std::string>(ClusterPlacement::kMaxBands + 1, "A"),
+                                  std::vector<int>(ClusterPlacement::kMaxBands, 300), 0)
+                         .enabled());
+    EXPECT_TRUE(MakePlacement(0).enabled());
+}
+
+TEST(ClusterPlacementTest, MovesUpAtThresholds) {
+    const auto placement = MakePlacement(50);
+    EXPECT_EQ(placement.nextBand(0, 299), 0);
+    EXPECT_EQ(placement.nextBand(0, 300), 1);
+    EXPECT_EQ(placement.nextBand(0, 700), 2);
+    EXPECT_EQ(placement.getProfile(2), "CPUSET_SP_TOP_APP");
+}
+
+TEST(ClusterPlacementTest, MovesDownBelowHysteresis) {
+    const auto placement = MakePlacement(50);
+    EXPECT_EQ(placement.nextBand(2, 560), 2);
+    EXPECT_EQ(placement.nextBand(2, 549), 1);
+    EXPECT_EQ(placement.nextBand(2, 100), 0);
+    EXPECT_EQ(placement.nextBand(1, 251), 1);
+    // Out of range bands from an older config are clamped
+    EXPECT_EQ(placement.nextBand(7, 800), 2);
+}
+
+// A paused or stale session is moved to band 0, its band is picked from
+// there again on resume instead of being held by the hysteresis
+TEST(ClusterPlacementTest, ResumeStartsFromBandZero) {
+    const auto placement = MakePlacement(50);
+    const int band = placement.nextBand(0, 700);
+    EXPECT_EQ(band, 2);
+    EXPECT_EQ(placement.nextBand(band, 560), 2);
+    EXPECT_EQ(placement.nextBand(0, 560), 1);
+}
+
+TEST(ClusterPlacementTest, TransitionsAreCounted) {
+    auto placement = MakePlacement(50);
+    placement.recordTransition(0, 2, 4, 0);
+    // The dump formats a copy taken under the session lock
+    const ClusterPlacement::Counters copy = placement.counters();
+    placement.recordTransition(2, 1, 4, 1);
+    const std::string dump = placement.toString();
+    EXPECT_NE(dump.find("up: 1, down: 1, migrations: 8, failed: 1"), std::string::npos) << dump;
+    EXPECT_NE(dump.find("[1] CPUSET_SP_FOREGROUND from 300: 1"), std::string::npos) << dump;
+    const std::string copyDump = placement.toString(copy);
+    EXPECT_NE(copyDump.find("up: 1, down: 0, migrations: 4, failed: 0"), std::string::npos)
+            << copyDump;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "aidl/CpuHeadroomEstimator.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+// A fake /proc/stat and cpufreq tree shaped like an 8 cpu, 3 cluster phone
+const std::string &GetFakeRoot() {
+    // Removed with its content when the benchmark binary exits
+    static const TempDir tempDir("headroom_bench");
+    static const std::string root = [](const std::string &dir) {
+        if (dir.empty()) {
+            return dir;
+        }
+        std::string stat = "cpu  1000 0 1000 8000 0 0 0 0 0 0\n";
+        for (int cpu = 0; cpu < 8; cpu++) {
+            ::android::base::StringAppendF(&stat, "cpu%d 125 0 125 1000 10 5 5 0 0 0\n", cpu);
+        }
+        stat += "intr 123456789 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\nctxt 987654321\n";
+        ::android::base::WriteStringToFile(stat, dir + "/stat");
+        const struct {
+            int first;
+            const char *cpus;
+            const char *maxKhz;
+        } policies[] = {{0, "0-3", "1800000"}, {4, "4-6", "2400000"}, {7, "7", "3000000"}};
+        for (const auto &policy : policies) {
+            const std::string policyDir = dir + "/cpufreq/policy" + std::to_string(policy.first);
+            std::filesystem::create_directories(policyDir);
+            ::android::base::WriteStringToFile(policy.cpus, policyDir + "/related_cpus");
+            ::android::base::WriteStringToFile(policy.maxKhz, policyDir + "/cpuinfo_max_freq");
+            ::android::base::WriteStringToFile("1200000", policyDir + "/scaling_cur_freq");
+        }
+        return dir;
+    }(tempDir.path());
+    return root;
+}
+
+void RunGetHeadroom(benchmark::State &state, CpuHeadroomEstimator *estimator) {
+    if (estimator->getClusterCount() == 0) {
+        state.SkipWithError("no cpufreq policy");
+        return;
+    }
+    size_t cluster = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                estimator->getHeadroom(cluster, std::chrono::steady_clock::now()));
+        cluster = (cluster + 1) % estimator->getClusterCount();
+    }
+}
+
+}  // namespace
+
+// Cost of a sample: one pread of /proc/stat and of each scaling_cur_freq
+static void BM_CpuHeadroom_Sample_Fake(benchmark::State &state) {
+    CpuHeadroomEstimator estimator(GetFakeRoot() + "/stat", GetFakeRoot() + "/cpufreq",
+                                   {.minInterval = std::chrono::milliseconds(0)});
+    RunGetHeadroom(state, &estimator);
+}
+BENCHMARK(BM_CpuHeadroom_Sample_Fake);
+
+static void BM_CpuHeadroom_Sample_Proc(benchmark::State &state) {
+    CpuHeadroomEstimator estimator("/proc/stat", "/sys/devices/system/cpu/cpufreq",
+                                   {.minInterval = std::chrono::milliseconds(0)});
+    RunGetHeadroom(state, &estimator);
+}
+BENCHMARK(BM_CpuHeadroom_Sample_Proc);
+
+// Queries within the sampling interval only read the cached estimate
+static void BM_CpuHeadroom_RateLimited(benchmark::State &state) {
+    CpuHeadroomEstimator estimator(GetFakeRoot() + "/stat", GetFakeRoot() + "/cpufreq",
+                                   {.minInterval = std::chrono::hours(1)});
+    RunGetHeadroom(state, &estimator);
+}
+BENCHMARK(BM_CpuHeadroom_RateLimited)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
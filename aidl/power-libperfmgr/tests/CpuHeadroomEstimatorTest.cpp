@@ -0,0 +1,171 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "aidl/CpuHeadroomEstimator.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringAppendF;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+class CpuHeadroomEstimatorTest : public TempDirFixture {
+  protected:
+    void SetUp() override {
+        ASSERT_NO_FATAL_FAILURE(TempDirFixture::SetUp());
+        mCpuTimes.assign(8, {0, 0});
+        mOnline.assign(8, true);
+        WriteProcStat();
+        AddPolicy(0, "0-3", 1800000, 1800000);
+        AddPolicy(4, "4-7", 3000000, 1500000);
+        mConfig.minInterval = milliseconds(100);
+        mConfig.alpha = 1.0;
+    }
+
+    void AddPolicy(int first, const std::string &cpus, uint64_t maxKhz, uint64_t curKhz) {
+        const std::string dir = mRoot + "/cpufreq/policy" + std::to_string(first);
+        std::filesystem::create_directories(dir);
+        ASSERT_TRUE(::android::base::WriteStringToFile(cpus + "\n", dir + "/related_cpus"));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(maxKhz) + "\n",
+                                                       dir + "/cpuinfo_max_freq"));
+        SetCurFreq(first, curKhz);
+    }
+
+    void SetCurFreq(int first, uint64_t curKhz) {
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                std::to_string(curKhz) + "\n",
+                mRoot + "/cpufreq/policy" + std::to_string(first) + "/scaling_cur_freq"));
+    }
+
+    // Advance every cpu of [first, last] by total ticks, busy of them not idle
+    void Run(int first, int last, uint64_t busy, uint64_t total) {
+        for (int cpu = first; cpu <= last; cpu++) {
+            mCpuTimes[cpu].first += busy;
+            mCpuTimes[cpu].second += total - busy;
+        }
+        WriteProcStat();
+    }
+
+    void WriteProcStat() {
+        std::string stat = "cpu  0 0 0 0 0 0 0 0 0 0\n";
+        for (size_t cpu = 0; cpu < mCpuTimes.size(); cpu++) {
+            if (!mOnline[cpu]) {
+                continue;
+            }
+            // user nice system idle iowait irq softirq steal guest guest_nice
+            StringAppendF(&stat, "cpu%zu %llu 0 0 %llu 0 0 0 0 0 0\n", cpu,
+                          static_cast<unsigned long long>(mCpuTimes[cpu].first),
+                          static_cast<unsigned long long>(mCpuTimes[cpu].second));
+        }
+        stat += "intr 12345 0 0 0\nctxt 67890\n";
+        ASSERT_TRUE(::android::base::WriteStringToFile(stat, mRoot + "/stat"));
+    }
+
+    std::unique_ptr<CpuHeadroomEstimator> Make() {
+        return std::make_unique<CpuHeadroomEstimator>(mRoot + "/stat", mRoot + "/cpufreq",
+                                                      mConfig);
+    }
+
+    // Busy and idle ticks of each cpu
+    std::vector<std::pair<uint64_t, uint64_t>> mCpuTimes;
+    std::vector<bool> mOnline;
+    CpuHeadroomEstimator::Config mConfig;
+    const steady_clock::time_point mStart = steady_clock::now();
+};
+
+TEST_F(CpuHeadroomEstimatorTest, DisabledWithoutCpufreq) {
+    CpuHeadroomEstimator estimator(mRoot + "/stat", mRoot + "/missing", mConfig);
+    EXPECT_EQ(estimator.getClusterCount(), 0u);
+    EXPECT_EQ(estimator.getHeadroom(0, mStart), -1.0);
+}
+
+TEST_F(CpuHeadroomEstimatorTest, HeadroomIsScaledByFrequency) {
+    auto estimator = Make();
+    ASSERT_EQ(estimator->getClusterCount(), 2u);
+    // No delta on the first sample
+    EXPECT_EQ(estimator->getHeadroom(0, mStart), -1.0);
+
+    Run(0, 3, 50, 100);
+    Run(4, 7, 100, 100);
+    const auto t1 = mStart + milliseconds(100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, t1), 0.5);
+    // Fully busy at half the max frequency still leaves half the capacity
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(1, t1), 0.5);
+    EXPECT_EQ(estimator->getHeadroom(2, t1), -1.0);
+}
+
+TEST_F(CpuHeadroomEstimatorTest, SamplesAreRateLimitedAndSmoothed) {
+    mConfig.alpha = 0.5;
+    auto estimator = Make();
+    estimator->getHeadroom(0, mStart);
+    Run(0, 3, 100, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(100)), 0.0);
+
+    // Within the interval the previous estimate is returned
+    Run(0, 3, 0, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(150)), 0.0);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(200)), 0.5);
+}
+
+TEST_F(CpuHeadroomEstimatorTest, DumpDoesNotSample) {
+    auto estimator = Make();
+    estimator->getHeadroom(0, mStart);
+    Run(0, 3, 100, 100);
+    TemporaryFile dump;
+    estimator->dumpToFd(dump.fd);
+    // The pending delta is still used by the next query
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(100)), 0.0);
+    std::string out;
+    ASSERT_TRUE(::android::base::ReadFileToString(dump.path, &out));
+    EXPECT_NE(out.find("no sample yet"), std::string::npos);
+    EXPECT_NE(out.find("Samples: 1,"), std::string::npos);
+}
+
+TEST_F(CpuHeadroomEstimatorTest, OfflineCpusAreIgnored) {
+    auto estimator = Make();
+    estimator->getHeadroom(0, mStart);
+    // cpu2 and cpu3 went offline and vanished from /proc/stat
+    mOnline[2] = false;
+    mOnline[3] = false;
+    Run(0, 1, 25, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(100)), 0.75);
+}
+
+TEST_F(CpuHeadroomEstimatorTest, CpuGoingOfflineAfterBusyInterval) {
+    auto estimator = Make();
+    estimator->getHeadroom(0, mStart);
+    Run(0, 3, 100, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(100)), 0.0);
+    // The busy interval of cpu3 must not be counted again once it is gone
+    mOnline[3] = false;
+    Run(0, 2, 0, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(200)), 1.0);
+    mOnline[3] = true;
+    Run(0, 3, 50, 100);
+    EXPECT_DOUBLE_EQ(estimator->getHeadroom(0, mStart + milliseconds(300)), 0.5);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
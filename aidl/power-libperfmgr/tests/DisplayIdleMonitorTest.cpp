@@ -0,0 +1,147 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include "disp-power/DisplayIdleMonitor.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+// Same length so the node is rewritten in place without ever being empty
+constexpr const char *kIdle = "idle  \n";
+constexpr const char *kActive = "active\n";
+
+// Wait for the eventfd of a subscriber to be signalled, return its count
+uint64_t WaitForSignal(int fd, int timeoutMs) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) != 1) {
+        return 0;
+    }
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return count;
+}
+
+}  // namespace
+
+// epoll refuses regular files, so the fake nodes go through the polled
+// fallback, the test seam of the monitor. The sysfs_notify (POLLPRI) path
+// needs real sysfs nodes and is not covered here.
+class DisplayIdleMonitorTest : public TempDirFixture {
+  protected:
+    std::string AddNode(const std::string &dir, const char *state) {
+        const std::string path = mRoot + dir + "/idle_state";
+        std::filesystem::create_directories(mRoot + dir);
+        EXPECT_TRUE(::android::base::WriteStringToFile(state, path));
+        return path;
+    }
+
+    void SetState(const std::string &path, const char *state) {
+        ::android::base::unique_fd fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+        ASSERT_GE(fd.get(), 0);
+        const ssize_t len = strlen(state);
+        ASSERT_EQ(pwrite(fd.get(), state, len, 0), len);
+    }
+
+};
+
+TEST_F(DisplayIdleMonitorTest, NoDisplays) {
+    DisplayIdleMonitor monitor(mRoot);
+    EXPECT_FALSE(monitor.Init());
+    EXPECT_EQ(monitor.GetDisplayCount(), 0);
+    // Nothing to wait for
+    EXPECT_TRUE(monitor.AllIdle());
+}
+
+TEST_F(DisplayIdleMonitorTest, DiscoversEachPanelOnce) {
+    const std::string card0 = AddNode("/sys/class/drm/card0/device", kIdle);
+    // Connectors are not displays
+    AddNode("/sys/class/drm/card0-DSI-1/device", kIdle);
+    AddNode("/sys/class/graphics/fb0", kIdle);
+    AddNode("/sys/class/graphics/fb1/device", kIdle);
+    // The fb of the first panel exposes the node of its drm card
+    std::filesystem::create_directories(mRoot + "/sys/class/graphics/fb2");
+    std::filesystem::create_hard_link(card0, mRoot + "/sys/class/graphics/fb2/idle_state");
+
+    DisplayIdleMonitor monitor(mRoot);
+    ASSERT_TRUE(monitor.Init());
+    EXPECT_EQ(monitor.GetDisplayCount(), 3);
+    // A second Init keeps the displays already found
+    EXPECT_TRUE(monitor.Init());
+    EXPECT_EQ(monitor.GetDisplayCount(), 3);
+}
+
+TEST_F(DisplayIdleMonitorTest, AllIdleNeedsEveryDisplay) {
+    const std::string inner = AddNode("/sys/class/drm/card0/device", kActive);
+    const std::string outer = AddNode("/sys/class/drm/card1/device", kIdle);
+    DisplayIdleMonitor monitor(mRoot);
+    ASSERT_TRUE(monitor.Init());
+    EXPECT_FALSE(monitor.AllIdle());
+    SetState(inner, kIdle);
+    EXPECT_TRUE(monitor.AllIdle());
+    SetState(outer, kActive);
+    EXPECT_FALSE(monitor.AllIdle());
+}
+
+TEST_F(DisplayIdleMonitorTest, PolledDisplaysSignalSubscribers) {
+    const std::string inner = AddNode("/sys/class/drm/card0/device", kActive);
+    const std::string outer = AddNode("/sys/class/drm/card1/device", kActive);
+    DisplayIdleMonitor monitor(mRoot);
+    ASSERT_TRUE(monitor.Init());
+    const int first = monitor.Subscribe();
+    const int second = monitor.Subscribe();
+    ASSERT_GE(first, 0);
+    ASSERT_GE(second, 0);
+
+    SetState(inner, kIdle);
+    // One display still active, no signal within a few poll intervals
+    EXPECT_EQ(WaitForSignal(first, 200), 0);
+    SetState(outer, kIdle);
+    EXPECT_EQ(WaitForSignal(first, 1000), 1);
+    EXPECT_EQ(WaitForSignal(second, 1000), 1);
+    // Staying idle is not signalled again
+    EXPECT_EQ(WaitForSignal(first, 200), 0);
+
+    monitor.Unsubscribe(second);
+    SetState(outer, kActive);
+    ASSERT_FALSE(monitor.AllIdle());
+    SetState(outer, kIdle);
+    EXPECT_EQ(WaitForSignal(first, 1000), 1);
+    monitor.Unsubscribe(first);
+
+    TemporaryFile dump;
+    monitor.DumpToFd(dump.fd);
+    std::string out;
+    ASSERT_TRUE(::android::base::ReadFileToString(dump.path, &out));
+    EXPECT_NE(out.find("2 display(s), all idle: yes"), std::string::npos) << out;
+    EXPECT_NE(out.find("(polled)"), std::string::npos) << out;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
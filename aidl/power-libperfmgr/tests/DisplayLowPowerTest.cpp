@@ -0,0 +1,204 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disp-power/DisplayLowPower.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr auto kTimeout = std::chrono::seconds(3);
+
+// Stand-in for the PPS daemon on a filesystem UNIX socket, serving one
+// client at a time and keeping what each connection sent
+class StandInDaemon {
+  public:
+    explicit StandInDaemon(const std::string &path) {
+        mListenFd.reset(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (bind(mListenFd.get(), reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(mListenFd.get(), 1) != 0) {
+            mListenFd.reset();
+            return;
+        }
+        mStopFd.reset(eventfd(0, EFD_CLOEXEC));
+        mThread = std::thread(&StandInDaemon::Run, this);
+    }
+
+    ~StandInDaemon() {
+        if (mThread.joinable()) {
+            uint64_t val = 1;
+            EXPECT_EQ(write(mStopFd.get(), &val, sizeof(val)), sizeof(val));
+            mThread.join();
+        }
+    }
+
+    bool ok() const { return mListenFd.get() >= 0; }
+
+    // Wait until connection number index has sent expected
+    bool WaitFor(size_t index, const std::string &expected) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCv.wait_for(lock, kTimeout, [&]() {
+            return index < mReceived.size() && mReceived[index] == expected;
+        });
+    }
+
+    // Hang up on the current client like a restarting daemon
+    void DropClient() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mClientFd.get() >= 0) {
+            shutdown(mClientFd.get(), SHUT_RDWR);
+        }
+    }
+
+  private:
+    void Run() {
+        while (true) {
+            struct pollfd pfd[3] = {{mStopFd.get(), POLLIN, 0},
+                                    {mListenFd.get(), POLLIN, 0},
+                                    {mClientFd.get(), POLLIN, 0}};
+            if (poll(pfd, mClientFd.get() >= 0 ? 3 : 2, -1) < 0) {
+                return;
+            }
+            if (pfd[0].revents) {
+                return;
+            }
+            if (mClientFd.get() < 0 && pfd[1].revents) {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mClientFd.reset(accept4(mListenFd.get(), nullptr, nullptr, SOCK_CLOEXEC));
+                mReceived.emplace_back();
+                continue;
+            }
+            if (mClientFd.get() >= 0 && pfd[2].revents) {
+                char buf[64];
+                const ssize_t len = TEMP_FAILURE_RETRY(read(mClientFd.get(), buf, sizeof(buf)));
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (len <= 0) {
+                    mClientFd.reset();
+                } else {
+                    mReceived.back().append(buf, len);
+                    mCv.notify_all();
+                }
+            }
+        }
+    }
+
+    ::android::base::unique_fd mListenFd;
+    ::android::base::unique_fd mStopFd;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    ::android::base::unique_fd mClientFd;
+    std::vector<std::string> mReceived;
+};
+
+}  // namespace
+
+class DisplayLowPowerTest : public TempDirFixture {
+  protected:
+    void SetUp() override {
+        ASSERT_NO_FATAL_FAILURE(TempDirFixture::SetUp());
+        mSocketPath = mRoot + "/pps";
+    }
+
+    // The client records a command after the daemon may have read it, wait
+    // for the dump to show needle
+    std::string WaitForDump(DisplayLowPower *dlpw, const std::string &needle) {
+        const auto deadline = std::chrono::steady_clock::now() + kTimeout;
+        std::string out;
+        do {
+            TemporaryFile dump;
+            dlpw->DumpToFd(dump.fd);
+            out.clear();
+            EXPECT_TRUE(::android::base::ReadFileToString(dump.path, &out));
+            if (out.find(needle) != std::string::npos) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } while (std::chrono::steady_clock::now() < deadline);
+        return out;
+    }
+
+    std::string mSocketPath;
+};
+
+TEST_F(DisplayLowPowerTest, SendsEachChange) {
+    StandInDaemon daemon(mSocketPath);
+    ASSERT_TRUE(daemon.ok());
+    DisplayLowPower dlpw(mSocketPath);
+    dlpw.Init();
+    dlpw.SetDisplayLowPower(true);
+    ASSERT_TRUE(daemon.WaitFor(0, "foss:on"));
+    // Unchanged state is not sent again
+    dlpw.SetDisplayLowPower(true);
+    dlpw.SetDisplayLowPower(false);
+    ASSERT_TRUE(daemon.WaitFor(0, "foss:onfoss:off"));
+    const std::string needle = "connected, foss desired: off, daemon: off";
+    const std::string dump = WaitForDump(&dlpw, needle);
+    EXPECT_NE(dump.find(needle), std::string::npos) << dump;
+}
+
+TEST_F(DisplayLowPowerTest, TogglesCollapseWhileDisconnected) {
+    DisplayLowPower dlpw(mSocketPath);
+    dlpw.SetDisplayLowPower(true);
+    dlpw.SetDisplayLowPower(false);
+    dlpw.SetDisplayLowPower(true);
+    // No daemon yet, the worker backs off and keeps only the last state
+    dlpw.Init();
+    StandInDaemon daemon(mSocketPath);
+    ASSERT_TRUE(daemon.ok());
+    ASSERT_TRUE(daemon.WaitFor(0, "foss:on"));
+    const std::string dump = WaitForDump(&dlpw, "sent=1 collapsed=2");
+    EXPECT_NE(dump.find("sent=1 collapsed=2"), std::string::npos) << dump;
+}
+
+TEST_F(DisplayLowPowerTest, ReplaysStateAfterDaemonRestart) {
+    StandInDaemon daemon(mSocketPath);
+    ASSERT_TRUE(daemon.ok());
+    DisplayLowPower dlpw(mSocketPath);
+    dlpw.Init();
+    dlpw.SetDisplayLowPower(true);
+    ASSERT_TRUE(daemon.WaitFor(0, "foss:on"));
+
+    daemon.DropClient();
+    // Reconnected after the backoff, the daemon state is unknown so the
+    // desired state is sent again without a new request
+    ASSERT_TRUE(daemon.WaitFor(1, "foss:on"));
+    const std::string dump = WaitForDump(&dlpw, "connects=2 disconnects=1");
+    EXPECT_NE(dump.find("connects=2 disconnects=1"), std::string::npos) << dump;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <latch>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#include "disp-power/InstrumentedMutex.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+namespace {
+
+// Hold the lock while another thread blocks on it. Whether that thread
+// reached lock() before the hold ended can't be observed, so retry until a
+// contended wait was recorded.
+void Contend(InstrumentedMutex *mutex) {
+    for (int attempt = 0; attempt < 10 && mutex->stats()->contendedCount.load() == 0;
+         attempt++) {
+        std::unique_lock<InstrumentedMutex> lock(*mutex);
+        std::latch started(1);
+        std::thread waiter([&]() {
+            started.count_down();
+            std::lock_guard<InstrumentedMutex> waiterLock(*mutex);
+        });
+        started.wait();
+        std::this_thread::sleep_for(milliseconds(10));
+        lock.unlock();
+        waiter.join();
+    }
+}
+
+}  // namespace
+
+TEST(InstrumentedMutexTest, DisabledKeepsNoStats) {
+    InstrumentedMutex mutex("test", false);
+    InstrumentedSharedMutex sharedMutex("test", false);
+    EXPECT_EQ(mutex.stats(), nullptr);
+    EXPECT_EQ(sharedMutex.stats(), nullptr);
+
+    // Still a working lock and condition variable
+    InstrumentedConditionVariable cv;
+    bool ready = false;
+    std::thread notifier([&]() {
+        std::lock_guard<InstrumentedMutex> lock(mutex);
+        ready = true;
+        cv.notify_all();
+    });
+    {
+        std::unique_lock<InstrumentedMutex> lock(mutex);
+        cv.wait(lock, [&]() { return ready; });
+    }
+    notifier.join();
+    ASSERT_TRUE(mutex.try_lock());
+    mutex.unlock();
+    {
+        std::shared_lock<InstrumentedSharedMutex> lock(sharedMutex);
+    }
+    std::lock_guard<InstrumentedSharedMutex> lock(sharedMutex);
+}
+
+TEST(InstrumentedMutexTest, RecordsWaitAndHold) {
+    InstrumentedMutex mutex("test", true);
+    ASSERT_NE(mutex.stats(), nullptr);
+    {
+        std::lock_guard<InstrumentedMutex> lock(mutex);
+        std::this_thread::sleep_for(milliseconds(2));
+    }
+    const LockStats &stats = *mutex.stats();
+    EXPECT_EQ(stats.waitNs.count(), 1);
+    EXPECT_EQ(stats.contendedCount.load(), 0);
+    EXPECT_EQ(stats.holdNs.count(), 1);
+    EXPECT_GE(stats.holdNs.max(), nanoseconds(milliseconds(2)).count());
+    EXPECT_TRUE(stats.callSites().empty());
+
+    Contend(&mutex);
+    ASSERT_GT(stats.contendedCount.load(), 0);
+    const auto sites = stats.callSites();
+    ASSERT_FALSE(sites.empty());
+    uint64_t siteWaits = 0;
+    for (const auto &site : sites) {
+        EXPECT_GT(site.totalWaitNs, 0);
+        siteWaits += site.count;
+    }
+    EXPECT_EQ(siteWaits, stats.contendedCount.load());
+
+    ResetLockStats();
+    EXPECT_EQ(stats.waitNs.count(), 0);
+    EXPECT_EQ(stats.holdNs.count(), 0);
+    EXPECT_EQ(stats.contendedCount.load(), 0);
+    EXPECT_TRUE(stats.callSites().empty());
+}
+
+TEST(InstrumentedMutexTest, ConditionWaitIsNotHoldTime) {
+    constexpr auto kNotifyDelay = milliseconds(50);
+    InstrumentedMutex mutex("test", true);
+    InstrumentedConditionVariable cv;
+    bool ready = false;
+    std::latch waiting(1);
+    std::thread waiter([&]() {
+        std::unique_lock<InstrumentedMutex> lock(mutex);
+        waiting.count_down();
+        cv.wait(lock, [&]() { return ready; });
+    });
+    waiting.wait();
+    std::this_thread::sleep_for(kNotifyDelay);
+    {
+        std::lock_guard<InstrumentedMutex> lock(mutex);
+        ready = true;
+        cv.notify_all();
+    }
+    waiter.join();
+    // Only the short holds around the wait count, not the wait itself
+    EXPECT_LT(mutex.stats()->holdNs.max(), nanoseconds(kNotifyDelay).count());
+}
+
+TEST(InstrumentedMutexTest, ConditionWaitUntilTimesOut) {
+    InstrumentedMutex mutex("test", true);
+    InstrumentedConditionVariable cv;
+    std::unique_lock<InstrumentedMutex> lock(mutex);
+    EXPECT_FALSE(cv.wait_until(lock, std::chrono::steady_clock::now() + milliseconds(1),
+                               []() { return false; }));
+    EXPECT_TRUE(lock.owns_lock());
+    lock.unlock();
+    EXPECT_EQ(mutex.stats()->holdNs.count(), 2);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
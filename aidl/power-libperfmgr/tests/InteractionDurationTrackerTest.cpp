@@ -0,0 +1,67 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include "disp-power/InteractionDurationTracker.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using Tracker = InteractionDurationTracker;
+
+TEST(InteractionDurationTrackerTest, Context) {
+    EXPECT_EQ(Tracker::GetContext(0, 1400), Tracker::CONTEXT_TAP);
+    EXPECT_EQ(Tracker::GetContext(-1, 1400), Tracker::CONTEXT_TAP);
+    EXPECT_EQ(Tracker::GetContext(1399, 1400), Tracker::CONTEXT_SHORT);
+    EXPECT_EQ(Tracker::GetContext(1400, 1400), Tracker::CONTEXT_LONG);
+}
+
+TEST(InteractionDurationTrackerTest, NothingLearnedBeforeMinSamples) {
+    Tracker tracker(8, 90, 100, 4);
+    for (int i = 0; i < 3; i++) {
+        tracker.Record(Tracker::CONTEXT_TAP, 500, false);
+    }
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_TAP), 0);
+    tracker.Record(Tracker::CONTEXT_TAP, 500, false);
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_TAP), 500);
+    // Contexts are learned separately
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_LONG), 0);
+}
+
+TEST(InteractionDurationTrackerTest, PercentileWithHeadroom) {
+    Tracker tracker(10, 90, 125, 1);
+    for (uint32_t ms = 100; ms <= 1000; ms += 100) {
+        tracker.Record(Tracker::CONTEXT_SHORT, ms, false);
+    }
+    // Rank (10 - 1) * 90 / 100 = 8 of the sorted window, 900ms
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_SHORT), 1125);
+}
+
+TEST(InteractionDurationTrackerTest, WindowForgetsOldSamples) {
+    Tracker tracker(4, 100, 100, 1);
+    for (int i = 0; i < 4; i++) {
+        tracker.Record(Tracker::CONTEXT_LONG, 3000, true);
+    }
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_LONG), 3000);
+    for (int i = 0; i < 3; i++) {
+        tracker.Record(Tracker::CONTEXT_LONG, 200, false);
+    }
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_LONG), 3000);
+    tracker.Record(Tracker::CONTEXT_LONG, 200, false);
+    EXPECT_EQ(tracker.GetLearnedMs(Tracker::CONTEXT_LONG), 200);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
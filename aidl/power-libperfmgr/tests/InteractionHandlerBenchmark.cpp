@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "disp-power/DisplayIdleMonitor.h"
+#include "disp-power/InteractionHandler.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int kBurst = 500;
+
+// A fake sysfs with one panel which stays active, so the handler keeps
+// waiting for idle while the bursts come in
+const std::string &GetFakeSysfsRoot() {
+    // Removed with its content when the benchmark binary exits
+    static const TempDir tempDir("interaction_bench");
+    static const std::string root = [](const std::string &dir) {
+        if (dir.empty()) {
+            return dir;
+        }
+        const std::string deviceDir = dir + "/sys/class/drm/card0/device";
+        std::filesystem::create_directories(deviceDir);
+        ::android::base::WriteStringToFile("active\n", deviceDir + "/idle_state");
+        return dir;
+    }(tempDir.path());
+    return root;
+}
+
+}  // namespace
+
+// Bursts of Acquire calls like a fling sending a boost per input event: a
+// mix of taps, short and long durations. Most of them are extended or
+// coalesced into the boost already held.
+static void BM_InteractionHandler_BurstyAcquire(benchmark::State &state) {
+    const std::string &root = GetFakeSysfsRoot();
+    if (root.empty()) {
+        state.SkipWithError("no fake sysfs");
+        return;
+    }
+    auto monitor = std::make_shared<DisplayIdleMonitor>(root);
+    InteractionHandler handler(monitor);
+    if (!handler.Init()) {
+        state.SkipWithError("InteractionHandler init failed");
+        return;
+    }
+    static constexpr int32_t kDurations[] = {0, 0, 100, 0, 2000, 0, 300, 0};
+    for (auto _ : state) {
+        for (int i = 0; i < kBurst; i++) {
+            handler.Acquire(kDurations[i % std::size(kDurations)]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kBurst);
+    handler.Exit();
+}
+BENCHMARK(BM_InteractionHandler_BurstyAcquire);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+#include "aidl/Power.h"
+#include "aidl/PowerExt.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+std::shared_ptr<Power> GetPower() {
+    static std::shared_ptr<Power> power = ndk::SharedRefBase::make<Power>(
+            std::make_shared<DisplayLowPower>(), std::shared_ptr<CpuHeadroomEstimator>());
+    return power;
+}
+
+std::shared_ptr<PowerExt> GetPowerExt() {
+    static std::shared_ptr<PowerExt> powerExt =
+            ndk::SharedRefBase::make<PowerExt>(std::make_shared<DisplayLowPower>());
+    return powerExt;
+}
+
+}  // namespace
+
+static void BM_Power_SetBoostInteraction(benchmark::State &state) {
+    auto power = GetPower();
+    for (auto _ : state) {
+        power->setBoost(Boost::INTERACTION, 0);
+    }
+}
+BENCHMARK(BM_Power_SetBoostInteraction);
+
+static void BM_Power_SetMode(benchmark::State &state) {
+    auto power = GetPower();
+    bool enabled = false;
+    for (auto _ : state) {
+        enabled = !enabled;
+        power->setMode(Mode::LAUNCH, enabled);
+    }
+}
+BENCHMARK(BM_Power_SetMode);
+
+static void BM_Power_IsModeSupported(benchmark::State &state) {
+    auto power = GetPower();
+    bool supported;
+    for (auto _ : state) {
+        power->isModeSupported(Mode::GAME, &supported);
+        benchmark::DoNotOptimize(supported);
+    }
+}
+BENCHMARK(BM_Power_IsModeSupported);
+
+static void BM_PowerExt_SetBoost(benchmark::State &state) {
+    auto powerExt = GetPowerExt();
+    const std::string boost("DISPLAY_UPDATE_IMMINENT");
+    for (auto _ : state) {
+        powerExt->setBoost(boost, 0);
+    }
+}
+BENCHMARK(BM_PowerExt_SetBoost);
+
+// Unknown names are resolved on every call instead of growing the cache
+static void BM_PowerExt_IsModeSupportedUnknown(benchmark::State &state) {
+    auto powerExt = GetPowerExt();
+    bool supported;
+    uint64_t i = 0;
+    for (auto _ : state) {
+        powerExt->isModeSupported("UNKNOWN_MODE_" + std::to_string(i++), &supported);
+        benchmark::DoNotOptimize(supported);
+    }
+}
+BENCHMARK(BM_PowerExt_IsModeSupportedUnknown);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <benchmark/benchmark.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "aidl/PowerHintSession.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int64_t kTargetNs = 16666666;
+
+std::vector<WorkDuration> MakeDurations() {
+    std::vector<WorkDuration> durations(1);
+    durations[0].timeStampNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count();
+    durations[0].durationNanos = kTargetNs * 11 / 10;
+    return durations;
+}
+
+std::shared_ptr<PowerHintSession> MakeSession() {
+    return ndk::SharedRefBase::make<PowerHintSession>(getpid(), getuid(),
+                                                      std::vector<int32_t>{gettid()}, kTargetNs);
+}
+
+}  // namespace
+
+// Every binder thread reports on the same session, the worst case for the
+// per-session lock
+static void BM_ReportActualWorkDuration_SharedSession(benchmark::State &state) {
+    static std::shared_ptr<PowerHintSession> session = MakeSession();
+    const std::vector<WorkDuration> durations = MakeDurations();
+    for (auto _ : state) {
+        session->reportActualWorkDuration(durations);
+    }
+}
+BENCHMARK(BM_ReportActualWorkDuration_SharedSession)->ThreadRange(1, 8)->UseRealTime();
+
+// Every binder thread reports on its own session, only PowerSessionManager
+// state is shared
+static void BM_ReportActualWorkDuration_SessionPerThread(benchmark::State &state) {
+    std::shared_ptr<PowerHintSession> session = MakeSession();
+    const std::vector<WorkDuration> durations = MakeDurations();
+    for (auto _ : state) {
+        session->reportActualWorkDuration(durations);
+    }
+    session->close();
+}
+BENCHMARK(BM_ReportActualWorkDuration_SessionPerThread)->ThreadRange(1, 8)->UseRealTime();
+
+// Session hints racing with reports from other binder threads
+static void BM_SendHint_SharedSession(benchmark::State &state) {
+    static std::shared_ptr<PowerHintSession> session = MakeSession();
+    const std::vector<WorkDuration> durations = MakeDurations();
+    for (auto _ : state) {
+        if (state.thread_index() % 2) {
+            session->sendHint(SessionHint::CPU_LOAD_UP);
+        } else {
+            session->reportActualWorkDuration(durations);
+        }
+    }
+}
+BENCHMARK(BM_SendHint_SharedSession)->ThreadRange(2, 8)->UseRealTime();
+
+// Session churn as seen from WebView or a launcher: create, report once and
+// close, with the thread count of the session as argument
+static void BM_CreateCloseSession(benchmark::State &state) {
+    const std::vector<int32_t> threadIds(state.range(0), gettid());
+    const std::vector<WorkDuration> durations = MakeDurations();
+    for (auto _ : state) {
+        auto session = ndk::SharedRefBase::make<PowerHintSession>(getpid(), getuid(), threadIds,
+                                                                  kTargetNs);
+        session->reportActualWorkDuration(durations);
+        session->close();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateCloseSession)->Arg(1)->Arg(4)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
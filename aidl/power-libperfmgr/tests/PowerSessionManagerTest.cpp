@@ -0,0 +1,178 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aidl/PowerHintSession.h"
+#include "aidl/PowerSessionManager.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int64_t kTargetNs = 16666666;
+
+int64_t ParseSnapshotNs(const std::string &json) {
+    const std::string key = "{\"snapshot_ns\":";
+    if (json.compare(0, key.size(), key) != 0) {
+        return -1;
+    }
+    return strtoll(json.c_str() + key.size(), nullptr, 10);
+}
+
+size_t CountOccurrences(const std::string &haystack, const std::string &needle) {
+    size_t count = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos;
+         pos = haystack.find(needle, pos + needle.size())) {
+        count++;
+    }
+    return count;
+}
+
+}  // namespace
+
+class PowerSessionManagerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        for (int i = 0; i < kSessions; i++) {
+            mSessions.push_back(ndk::SharedRefBase::make<PowerHintSession>(
+                    getpid(), getuid(), std::vector<int32_t>{gettid()}, kTargetNs));
+        }
+        std::vector<WorkDuration> durations(1);
+        durations[0].durationNanos = kTargetNs;
+        for (auto &session : mSessions) {
+            session->reportActualWorkDuration(durations);
+        }
+    }
+
+    void TearDown() override {
+        for (auto &session : mSessions) {
+            session->close();
+        }
+    }
+
+    std::string DumpJson() {
+        TemporaryFile file;
+        PowerSessionManager::getInstance()->dumpToFd(file.fd, true);
+        std::string json;
+        ::android::base::ReadFileToString(file.path, &json);
+        return json;
+    }
+
+    static constexpr int kSessions = 64;
+    std::vector<std::shared_ptr<PowerHintSession>> mSessions;
+};
+
+// The dump copies a snapshot under the session lock and formats it after
+// releasing the lock, reports only wait for the copy
+TEST_F(PowerSessionManagerTest, DumpHoldsSessionLockOnlyForSnapshot) {
+    constexpr int kDumps = 20;
+    int64_t maxSnapshotNs = 0;
+    int64_t totalDumpNs = 0;
+    int64_t totalSnapshotNs = 0;
+    for (int i = 0; i < kDumps; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        const std::string json = DumpJson();
+        totalDumpNs += (std::chrono::steady_clock::now() - start).count();
+        ASSERT_GE(CountOccurrences(json, "\"tid\":"), static_cast<size_t>(kSessions));
+        const int64_t snapshotNs = ParseSnapshotNs(json);
+        ASSERT_GE(snapshotNs, 0) << json.substr(0, 64);
+        maxSnapshotNs = std::max(maxSnapshotNs, snapshotNs);
+        totalSnapshotNs += snapshotNs;
+    }
+    RecordProperty("max_snapshot_ns", std::to_string(maxSnapshotNs));
+    RecordProperty("avg_dump_ns", std::to_string(totalDumpNs / kDumps));
+    EXPECT_LT(maxSnapshotNs, 2000000);
+    EXPECT_LT(totalSnapshotNs, totalDumpNs / 2);
+}
+
+// A thread exiting is only noticed when setting its uclamp fails, it is
+// then unlinked from the session for good
+TEST_F(PowerSessionManagerTest, ExitedThreadIsDropped) {
+    pid_t exitedTid = 0;
+    std::thread([&exitedTid]() { exitedTid = gettid(); }).join();
+    ASSERT_GT(exitedTid, 0);
+
+    constexpr int64_t kSessionId = 1 << 30;
+    auto descriptor = std::make_shared<AppHintDesc>(kSessionId, getpid(), getuid(),
+                                                    std::chrono::nanoseconds(kTargetNs));
+    auto psm = PowerSessionManager::getInstance();
+    psm->addPowerSession("exited", descriptor, {gettid(), exitedTid});
+    std::vector<pid_t> taskIds;
+    psm->getTaskIds(kSessionId, &taskIds);
+    EXPECT_EQ(taskIds, std::vector<pid_t>{gettid()});
+
+    // Applying the next vote does not link it again
+    psm->voteSet(kSessionId, AdpfHintType::ADPF_CPU_LOAD_UP, kUclampMax, kUclampMax,
+                 std::chrono::steady_clock::now(), std::chrono::milliseconds(10));
+    psm->getTaskIds(kSessionId, &taskIds);
+    EXPECT_EQ(taskIds, std::vector<pid_t>{gettid()});
+    psm->removePowerSession(kSessionId);
+}
+
+// Timeouts are rounded up to whole frames, exact multiples stay as they are
+TEST(PowerSessionManagerVsyncTest, SnapToVsyncRoundsUp) {
+    using std::chrono::nanoseconds;
+    auto psm = PowerSessionManager::getInstance();
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_60FPS);
+    const nanoseconds period(std::nano::den / 60);
+    for (int frames = 1; frames <= 3; frames++) {
+        EXPECT_EQ(psm->snapToVsync(period * frames), period * frames);
+        EXPECT_EQ(psm->snapToVsync(period * frames - nanoseconds(1)), period * frames);
+        EXPECT_EQ(psm->snapToVsync(period * frames + nanoseconds(1)), period * (frames + 1));
+    }
+    EXPECT_EQ(psm->snapToVsync(nanoseconds(0)), nanoseconds(0));
+    EXPECT_EQ(psm->snapToVsync(nanoseconds(-1)), nanoseconds(-1));
+
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_120FPS);
+    EXPECT_EQ(psm->snapToVsync(period), period);
+    EXPECT_EQ(psm->snapToVsync(period + nanoseconds(1)), period + period / 2);
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_60FPS);
+}
+
+// A target counts as frame paced within 1% of a period from a multiple
+TEST(PowerSessionManagerVsyncTest, VsyncMultipleAcceptsJitter) {
+    using std::chrono::nanoseconds;
+    auto psm = PowerSessionManager::getInstance();
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_60FPS);
+    const nanoseconds period(std::nano::den / 60);
+    const nanoseconds jitter = period / 100;
+    for (int frames = 1; frames <= 3; frames++) {
+        EXPECT_EQ(psm->getVsyncMultiple(period * frames), frames);
+        EXPECT_EQ(psm->getVsyncMultiple(period * frames - jitter), frames);
+        EXPECT_EQ(psm->getVsyncMultiple(period * frames + jitter), frames);
+        EXPECT_EQ(psm->getVsyncMultiple(period * frames - jitter - nanoseconds(1)), 0);
+        EXPECT_EQ(psm->getVsyncMultiple(period * frames + jitter + nanoseconds(1)), 0);
+    }
+    EXPECT_EQ(psm->getVsyncMultiple(period / 2), 0);
+    EXPECT_EQ(psm->getVsyncMultiple(nanoseconds(0)), 0);
+
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_120FPS);
+    EXPECT_EQ(psm->getVsyncMultiple(period), 2);
+    psm->updateRefreshRate(AdpfRefreshRate::REFRESH_60FPS);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Counts callback runs so a test can wait for them instead of sleeping.
+// Neither side allocates.
+class RunCounter {
+  public:
+    void add() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCount++;
+        }
+        mCv.notify_all();
+    }
+
+    // False if expected runs were not reached in time
+    bool waitFor(uint64_t expected,
+                 std::chrono::steady_clock::duration timeout = std::chrono::seconds(10)) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mCv.wait_for(lock, timeout, [&]() { return mCount >= expected; });
+    }
+
+    uint64_t count() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCount;
+    }
+
+  private:
+    mutable std::mutex mMutex;
+    std::condition_variable mCv;
+    uint64_t mCount{0};
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
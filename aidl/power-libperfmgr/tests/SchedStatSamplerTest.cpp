@@ -0,0 +1,172 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "aidl/SchedStatSampler.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+namespace {
+
+constexpr int64_t kTargetNs = 16666666;
+
+// One frame of a replayed trace: the time the frame took without any boost
+// and the part of it the threads spent running or runnable
+struct Frame {
+    int64_t unboostedNs;
+    int64_t busyNs;
+};
+
+}  // namespace
+
+class SchedStatSamplerTest : public TempDirFixture {
+  protected:
+    // The schedstat file is rewritten in place so the sampler's cached fd
+    // sees the new value
+    void SetSchedStat(pid_t tid, uint64_t runNs, uint64_t waitNs) {
+        const std::string dir = StringPrintf("%s/%d", mRoot.c_str(), tid);
+        std::filesystem::create_directories(dir);
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                StringPrintf("%llu %llu 42\n", static_cast<unsigned long long>(runNs),
+                             static_cast<unsigned long long>(waitNs)),
+                dir + "/schedstat"));
+    }
+
+};
+
+TEST_F(SchedStatSamplerTest, FirstSampleHasNoBaseline) {
+    SchedStatSampler sampler(mRoot);
+    SetSchedStat(100, 1000, 0);
+    EXPECT_FALSE(sampler.sampleBusyFraction({100}, kTargetNs).has_value());
+}
+
+TEST_F(SchedStatSamplerTest, FractionOfReportedWork) {
+    SchedStatSampler sampler(mRoot);
+    SetSchedStat(100, 0, 0);
+    SetSchedStat(101, 0, 0);
+    sampler.sampleBusyFraction({100, 101}, kTargetNs);
+
+    // Idle time between frames is not part of the reported work, a thread
+    // running for the whole 10ms frame is fully busy
+    SetSchedStat(100, 8000000, 2000000);
+    SetSchedStat(101, 2000000, 0);
+    auto busy = sampler.sampleBusyFraction({100, 101}, 10000000);
+    ASSERT_TRUE(busy.has_value());
+    EXPECT_DOUBLE_EQ(busy.value(), 1.0);
+
+    // A batch of two 10ms frames with 5ms of CPU each
+    SetSchedStat(100, 13000000, 2000000);
+    busy = sampler.sampleBusyFraction({100, 101}, 20000000);
+    ASSERT_TRUE(busy.has_value());
+    EXPECT_DOUBLE_EQ(busy.value(), 0.25);
+}
+
+TEST_F(SchedStatSamplerTest, MissingTasksAreSkipped) {
+    SchedStatSampler sampler(mRoot);
+    SetSchedStat(100, 0, 0);
+    sampler.sampleBusyFraction({100, 999}, kTargetNs);
+    SetSchedStat(100, 5000000, 0);
+    auto busy = sampler.sampleBusyFraction({100, 999}, 10000000);
+    ASSERT_TRUE(busy.has_value());
+    EXPECT_DOUBLE_EQ(busy.value(), 0.5);
+    EXPECT_FALSE(sampler.sampleBusyFraction({999}, 10000000).has_value());
+}
+
+// Replays a trace which alternates CPU bound bursts with frames blocked on
+// fences through a simple boost model, with and without schedstat gating.
+// The energy proxy is the sum of the boost held over the frames; a boost only
+// shortens the CPU part of a frame. Gating gives up the boost built while
+// blocked, so each CPU bound burst needs a few more frames to ramp up.
+TEST_F(SchedStatSamplerTest, ReplayGatingSavesBoost) {
+    constexpr int kPhaseFrames = 30;
+    constexpr int kPhases = 20;
+    constexpr int kRampFrames = 8;
+    std::vector<Frame> trace;
+    for (int i = 0; i < kPhaseFrames * kPhases; i++) {
+        if ((i / kPhaseFrames) % 2) {
+            // GPU bound: long frames with little CPU work
+            trace.push_back({kTargetNs * 3 / 2, kTargetNs / 5});
+        } else {
+            // CPU bound: slightly over target
+            trace.push_back({kTargetNs * 11 / 10, kTargetNs * 11 / 10});
+        }
+    }
+
+    struct Result {
+        int64_t energy{0};
+        int misses{0};
+        int cpuMisses{0};
+    };
+    auto replay = [&](bool gating) {
+        SchedStatSampler sampler(mRoot);
+        constexpr pid_t kTid = 200;
+        constexpr int kBoostStep = 50;
+        constexpr int kBoostMax = 1024;
+        uint64_t runNs = 0;
+        int boost = 0;
+        Result result;
+        SetSchedStat(kTid, runNs, 0);
+        sampler.sampleBusyFraction({kTid}, 0);
+        for (const auto &frame : trace) {
+            // Up to halves the CPU part of the frame at full boost
+            const int64_t busyNs = frame.busyNs - frame.busyNs * boost / (2 * kBoostMax);
+            const int64_t durationNs = frame.unboostedNs - (frame.busyNs - busyNs);
+            runNs += busyNs;
+            SetSchedStat(kTid, runNs, 0);
+            const auto busy = sampler.sampleBusyFraction({kTid}, durationNs);
+
+            result.energy += boost;
+            if (durationNs > kTargetNs) {
+                result.misses++;
+                result.cpuMisses += frame.busyNs == frame.unboostedNs;
+                const bool cpuBound = !busy.has_value() || busy.value() >= 0.6;
+                if (!gating || cpuBound) {
+                    boost = std::min(boost + kBoostStep, kBoostMax);
+                }
+            } else {
+                boost = std::max(boost - kBoostStep, 0);
+            }
+        }
+        return result;
+    };
+
+    const Result ungated = replay(false);
+    const Result gated = replay(true);
+    RecordProperty("energy_ungated", std::to_string(ungated.energy));
+    RecordProperty("energy_gated", std::to_string(gated.energy));
+    RecordProperty("misses_ungated", std::to_string(ungated.misses));
+    RecordProperty("misses_gated", std::to_string(gated.misses));
+    RecordProperty("cpu_misses_ungated", std::to_string(ungated.cpuMisses));
+    RecordProperty("cpu_misses_gated", std::to_string(gated.cpuMisses));
+    EXPECT_LT(gated.energy, ungated.energy / 2);
+    // Blocked frames miss either way, the boost does not shorten the wait
+    EXPECT_EQ(gated.misses - gated.cpuMisses, ungated.misses - ungated.cpuMisses);
+    EXPECT_LE(gated.cpuMisses, ungated.cpuMisses + kPhases / 2 * kRampFrames);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "aidl/SessionCheckpoint.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+namespace {
+
+constexpr int64_t kTargetNs = 16666666;
+
+// Minimal stand-in for the session PID loop: a frame takes workNs at full
+// capacity and the set point buys capacity linearly from a 25% floor. The
+// controller aims at 90% of the target so a converged session does not miss.
+struct FrameModel {
+    int64_t workNs{10000000};
+
+    int64_t durationNs(int setPoint) const {
+        return workNs / (0.25 + 0.75 * setPoint / 1024.0);
+    }
+
+    static int nextSetPoint(int setPoint, int64_t durationNs) {
+        const double error = (durationNs - kTargetNs * 0.9) / kTargetNs;
+        return std::clamp(setPoint + std::clamp(static_cast<int>(512 * error), -64, 64), 0, 1024);
+    }
+};
+
+// Frames missing the target over the first frames of a session starting at setPoint
+int CountMisses(const FrameModel &model, int setPoint, int frames, int *finalSetPoint) {
+    int misses = 0;
+    for (int i = 0; i < frames; i++) {
+        const int64_t duration = model.durationNs(setPoint);
+        if (duration > kTargetNs) {
+            misses++;
+        }
+        setPoint = FrameModel::nextSetPoint(setPoint, duration);
+    }
+    *finalSetPoint = setPoint;
+    return misses;
+}
+
+}  // namespace
+
+class SessionCheckpointTest : public TempDirFixture {
+  protected:
+    void SetUp() override {
+        ASSERT_NO_FATAL_FAILURE(TempDirFixture::SetUp());
+        mConfig.path = mRoot + "/adpf.ckpt";
+        mConfig.procRoot = mRoot + "/proc";
+    }
+
+    void AddTask(int32_t tgid, int32_t tid) {
+        std::filesystem::create_directories(
+                StringPrintf("%s/%d/task/%d", mConfig.procRoot.c_str(), tgid, tid));
+    }
+
+    SessionCheckpoint::Record MakeRecord(int32_t tgid, std::vector<int32_t> tids, int setPoint) {
+        SessionCheckpoint::Record record;
+        record.tgid = tgid;
+        record.uid = static_cast<int32_t>(getuid());
+        record.state = {kTargetNs, setPoint, 1000, -20};
+        record.tids = std::move(tids);
+        return record;
+    }
+
+    SessionCheckpoint::Config mConfig;
+};
+
+TEST_F(SessionCheckpointTest, DisabledWithoutPath) {
+    SessionCheckpoint checkpoint(SessionCheckpoint::Config{});
+    EXPECT_FALSE(checkpoint.enabled());
+    EXPECT_FALSE(checkpoint.write({MakeRecord(100, {101}, 300)}));
+}
+
+TEST_F(SessionCheckpointTest, RestoresLiveRecords) {
+    AddTask(100, 101);
+    AddTask(100, 102);
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        auto live = MakeRecord(100, {101, 103}, 512);
+        live.votes.push_back({3, 800, 1024, 0});
+        live.votes.push_back(
+                {4, 900, 1024,
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         (std::chrono::steady_clock::now() + std::chrono::seconds(10))
+                                 .time_since_epoch())
+                         .count()});
+        ASSERT_TRUE(checkpoint.write({live, MakeRecord(200, {201}, 300)}));
+    }
+
+    SessionCheckpoint checkpoint(mConfig);
+    const auto now = std::chrono::steady_clock::now();
+    checkpoint.load(now);
+    // The thread group of the second record is gone
+    EXPECT_FALSE(checkpoint.take(200, getuid(), {201}, now));
+    // Same tgid but another uid
+    EXPECT_FALSE(checkpoint.take(100, getuid() + 1, {101}, now));
+    auto record = checkpoint.take(100, getuid(), {102, 101}, now);
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->state.clientTargetNs, kTargetNs);
+    EXPECT_EQ(record->state.setPoint, 512);
+    EXPECT_EQ(record->state.integralError, 1000);
+    EXPECT_EQ(record->state.previousError, -20);
+    // Exited threads and expired votes are dropped
+    EXPECT_EQ(record->tids, std::vector<int32_t>({101}));
+    ASSERT_EQ(record->votes.size(), 1);
+    EXPECT_EQ(record->votes[0].voteId, 4);
+    // A record is only restored once
+    EXPECT_FALSE(checkpoint.take(100, getuid(), {101}, now));
+}
+
+TEST_F(SessionCheckpointTest, CorruptOrStaleFileIsIgnored) {
+    AddTask(100, 101);
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        ASSERT_TRUE(checkpoint.write({MakeRecord(100, {101}, 512)}));
+    }
+    std::string data;
+    ASSERT_TRUE(::android::base::ReadFileToString(mConfig.path, &data));
+
+    const auto now = std::chrono::steady_clock::now();
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        checkpoint.load(now + mConfig.maxAge + std::chrono::seconds(1));
+        EXPECT_FALSE(checkpoint.take(100, getuid(), {101}, now));
+    }
+    data[data.size() / 2] ^= 0x5a;
+    ASSERT_TRUE(::android::base::WriteStringToFile(data, mConfig.path));
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        checkpoint.load(now);
+        EXPECT_FALSE(checkpoint.take(100, getuid(), {101}, now));
+    }
+}
+
+// Restore cost on the startup path with a busy device's worth of sessions
+TEST_F(SessionCheckpointTest, RestoreTime) {
+    constexpr int kSessions = 128;
+    constexpr int kThreads = 8;
+    std::vector<SessionCheckpoint::Record> records;
+    for (int s = 0; s < kSessions; s++) {
+        const int32_t tgid = 1000 + s * 100;
+        std::vector<int32_t> tids;
+        for (int t = 1; t <= kThreads; t++) {
+            AddTask(tgid, tgid + t);
+            tids.push_back(tgid + t);
+        }
+        records.push_back(MakeRecord(tgid, std::move(tids), s * 8));
+    }
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        ASSERT_TRUE(checkpoint.write(records));
+    }
+
+    SessionCheckpoint checkpoint(mConfig);
+    const auto start = std::chrono::steady_clock::now();
+    checkpoint.load(start);
+    const auto loadUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    RecordProperty("load_us", std::to_string(loadUs));
+    EXPECT_LT(loadUs, 100000);
+    for (const auto &r : records) {
+        auto restored = checkpoint.take(r.tgid, r.uid, {r.tids.back()}, start);
+        ASSERT_TRUE(restored);
+        EXPECT_EQ(restored->state.setPoint, r.state.setPoint);
+        EXPECT_EQ(restored->tids.size(), kThreads);
+    }
+}
+
+// A session recreated after a power HAL restart resumes from its converged
+// set point instead of ramping up from the init value again
+TEST_F(SessionCheckpointTest, RestoredSessionSkipsRampUp) {
+    constexpr int kInitSetPoint = 162;
+    constexpr int kFrames = 120;
+    const FrameModel model;
+    int converged = 0;
+    const int coldMisses = CountMisses(model, kInitSetPoint, kFrames, &converged);
+
+    AddTask(100, 101);
+    SessionCheckpoint::ControllerStateSlot slot;
+    slot.store({kTargetNs, converged, 0, 0});
+    auto record = MakeRecord(100, {101}, 0);
+    record.state = slot.load();
+    {
+        SessionCheckpoint checkpoint(mConfig);
+        ASSERT_TRUE(checkpoint.write({record}));
+    }
+    SessionCheckpoint checkpoint(mConfig);
+    const auto now = std::chrono::steady_clock::now();
+    checkpoint.load(now);
+    auto restored = checkpoint.take(100, getuid(), {101}, now);
+    ASSERT_TRUE(restored);
+    int restoredFinal = 0;
+    const int restoredMisses =
+            CountMisses(model, restored->state.setPoint, kFrames, &restoredFinal);
+
+    RecordProperty("cold_misses", std::to_string(coldMisses));
+    RecordProperty("restored_misses", std::to_string(restoredMisses));
+    EXPECT_GT(coldMisses, 0);
+    EXPECT_EQ(restoredMisses, 0);
+    EXPECT_NEAR(restoredFinal, converged, 64);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
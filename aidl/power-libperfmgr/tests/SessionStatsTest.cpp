@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "aidl/SessionStats.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+uint64_t ReadVarint(const std::string &in, size_t *pos) {
+    uint64_t value = 0;
+    for (int shift = 0; *pos < in.size(); shift += 7) {
+        const uint8_t byte = static_cast<uint8_t>(in[(*pos)++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    return value;
+}
+
+}  // namespace
+
+TEST(SessionStatsTest, VarintAndFixed32AreLittleEndian) {
+    std::string out;
+    appendVarint(&out, 1);
+    appendVarint(&out, 300);
+    appendFixed32(&out, 0x01020304);
+    EXPECT_EQ(out, std::string("\x01\xac\x02\x04\x03\x02\x01", 7));
+}
+
+TEST(SessionStatsTest, BinaryExportRoundTrips) {
+    SessionStats stats;
+    const auto start = std::chrono::steady_clock::now();
+    stats.recordReport(1, start);
+    stats.recordReport(3, start + std::chrono::milliseconds(16));
+    stats.actualToTargetPct.record(90);
+    stats.actualToTargetPct.record(90);
+    stats.actualToTargetPct.record(150);
+
+    std::string out;
+    stats.appendBinary(&out);
+    size_t pos = 0;
+    const Histogram *histograms[] = {&stats.actualToTargetPct, &stats.uclampMin, &stats.batchSize,
+                                     &stats.reportIntervalUs};
+    for (const auto *histogram : histograms) {
+        EXPECT_EQ(ReadVarint(out, &pos), histogram->count());
+        uint64_t nonEmpty = ReadVarint(out, &pos);
+        uint64_t total = 0;
+        while (nonEmpty-- > 0) {
+            const uint64_t index = ReadVarint(out, &pos);
+            const uint64_t count = ReadVarint(out, &pos);
+            EXPECT_EQ(histogram->bucket(index), count);
+            total += count;
+        }
+        EXPECT_EQ(total, histogram->count());
+    }
+    EXPECT_EQ(pos, out.size());
+    EXPECT_EQ(stats.batchSize.count(), 2u);
+    EXPECT_EQ(stats.reportIntervalUs.count(), 1u);
+}
+
+TEST(SessionStatsTest, ResetClearsEverything) {
+    SessionStats stats;
+    stats.recordReport(2, std::chrono::steady_clock::now());
+    stats.uclampMin.record(512);
+    stats.reset();
+    std::string out;
+    stats.appendBinary(&out);
+    // Count and non-empty bucket count of four empty histograms
+    EXPECT_EQ(out, std::string(8, '\0'));
+}
+
+// The budget picks the app session with the latest report as the foreground
+TEST(SessionStatsTest, LastReportTimeFollowsWorkReports) {
+    SessionStats stats;
+    EXPECT_EQ(stats.lastReportTime(), std::chrono::steady_clock::time_point{});
+    const auto now = std::chrono::steady_clock::now();
+    stats.recordReport(1, now);
+    EXPECT_EQ(stats.lastReportTime(), now);
+    stats.reset();
+    EXPECT_EQ(stats.lastReportTime(), std::chrono::steady_clock::time_point{});
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
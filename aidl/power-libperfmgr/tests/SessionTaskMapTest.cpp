@@ -0,0 +1,42 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "aidl/SessionTaskMap.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Auto-discovery links the client threads of a session together with the
+// threads it found, a dead thread must not come back from that list
+TEST(SessionTaskMapTest, DeadTaskLeavesClientThreads) {
+    constexpr int64_t kSessionId = 1;
+    SessionValueEntry sve;
+    sve.clientTaskIds = {100, 101, 102};
+    sve.votes = std::make_shared<Votes>();
+    SessionTaskMap map;
+    ASSERT_TRUE(map.add(kSessionId, sve, sve.clientTaskIds));
+
+    EXPECT_TRUE(map.removeDeadTaskSessionMap(kSessionId, 101));
+    EXPECT_EQ(map.findSession(kSessionId)->clientTaskIds, (std::vector<pid_t>{100, 102}));
+    EXPECT_EQ(map.getSessionCount(101), 0);
+    EXPECT_EQ(map.getSessionCount(100), 1);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
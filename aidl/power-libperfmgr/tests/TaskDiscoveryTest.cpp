@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "aidl/TaskDiscovery.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+class TaskDiscoveryTest : public TempDirFixture {
+  protected:
+    void AddTask(pid_t tgid, pid_t tid, const std::string &comm) {
+        const std::string dir = StringPrintf("%s/%d/task/%d", mRoot.c_str(), tgid, tid);
+        std::filesystem::create_directories(dir);
+        ASSERT_TRUE(::android::base::WriteStringToFile(comm + "\n", dir + "/comm"));
+    }
+
+    std::vector<pid_t> Find(const TaskDiscovery &discovery, pid_t tgid) {
+        std::vector<pid_t> taskIds;
+        discovery.findMatchingTasks(tgid, &taskIds);
+        std::sort(taskIds.begin(), taskIds.end());
+        return taskIds;
+    }
+
+};
+
+TEST_F(TaskDiscoveryTest, DisabledWithoutPrefixes) {
+    AddTask(100, 101, "RenderThread");
+    TaskDiscovery discovery(mRoot, {"", ""});
+    EXPECT_FALSE(discovery.enabled());
+    EXPECT_TRUE(Find(discovery, 100).empty());
+}
+
+TEST_F(TaskDiscoveryTest, MatchesCommPrefixes) {
+    AddTask(100, 100, "com.example.gam");
+    AddTask(100, 101, "RenderThread");
+    AddTask(100, 102, "UnityMain");
+    AddTask(100, 103, "UnityGfxDeviceW");
+    AddTask(100, 104, "Binder:100_1");
+    AddTask(200, 201, "UnityMain");
+    TaskDiscovery discovery(mRoot, {"Unity", "RenderThread"});
+    EXPECT_TRUE(discovery.enabled());
+    EXPECT_EQ(Find(discovery, 100), std::vector<pid_t>({101, 102, 103}));
+    EXPECT_EQ(Find(discovery, 200), std::vector<pid_t>({201}));
+}
+
+TEST_F(TaskDiscoveryTest, AppendsToExistingTasks) {
+    AddTask(100, 102, "UnityMain");
+    TaskDiscovery discovery(mRoot, {"Unity"});
+    std::vector<pid_t> taskIds{100};
+    discovery.findMatchingTasks(100, &taskIds);
+    EXPECT_EQ(taskIds, std::vector<pid_t>({100, 102}));
+}
+
+TEST_F(TaskDiscoveryTest, ExitedProcessIsIgnored) {
+    AddTask(100, 102, "UnityMain");
+    TaskDiscovery discovery(mRoot, {"Unity"});
+    EXPECT_TRUE(Find(discovery, 300).empty());
+    // A thread which exits between readdir and reading comm is skipped
+    std::filesystem::create_directories(mRoot + "/100/task/103");
+    EXPECT_EQ(Find(discovery, 100), std::vector<pid_t>({102}));
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
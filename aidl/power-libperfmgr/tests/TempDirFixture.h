@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Fresh directory under the system temp dir, removed with its content on
+// destruction. path() is empty if the directory could not be made.
+class TempDir {
+  public:
+    explicit TempDir(const std::string &prefix) {
+        std::string path = std::filesystem::temp_directory_path() / (prefix + "_XXXXXX");
+        if (mkdtemp(path.data()) != nullptr) {
+            mPath = path;
+        }
+    }
+
+    ~TempDir() {
+        if (!mPath.empty()) {
+            std::error_code ec;
+            std::filesystem::remove_all(mPath, ec);
+        }
+    }
+
+    TempDir(const TempDir &) = delete;
+    TempDir &operator=(const TempDir &) = delete;
+
+    const std::string &path() const { return mPath; }
+
+  private:
+    std::string mPath;
+};
+
+// Gives each test its own TempDir in mRoot, named after the test suite.
+// Fixtures overriding SetUp call TempDirFixture::SetUp() first.
+class TempDirFixture : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mTempDir = std::make_unique<TempDir>(
+                ::testing::UnitTest::GetInstance()->current_test_info()->test_suite_name());
+        mRoot = mTempDir->path();
+        ASSERT_FALSE(mRoot.empty());
+    }
+
+    void TearDown() override { mTempDir.reset(); }
+
+    std::string mRoot;
+
+  private:
+    std::unique_ptr<TempDir> mTempDir;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include "aidl/ThermalHeadroomMonitor.h"
+#include "tests/TempDirFixture.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+class ThermalHeadroomMonitorTest : public TempDirFixture {
+  protected:
+    void SetUp() override {
+        ASSERT_NO_FATAL_FAILURE(TempDirFixture::SetUp());
+        mConfig.zoneTypes = {"cpu-big", "skin"};
+        mConfig.windowMc = 10000;
+        mConfig.minScale = 0.5;
+        mConfig.pollInterval = milliseconds(500);
+    }
+
+    void AddZone(int index, const std::string &type, int tempMc, int tripMc) {
+        const std::string dir = mRoot + "/thermal_zone" + std::to_string(index);
+        std::filesystem::create_directories(dir);
+        ASSERT_TRUE(::android::base::WriteStringToFile(type + "\n", dir + "/type"));
+        ASSERT_TRUE(::android::base::WriteStringToFile(std::to_string(tripMc) + "\n",
+                                                       dir + "/trip_point_0_temp"));
+        SetTemp(index, tempMc);
+    }
+
+    // Rewritten in place so the monitor's cached fd sees the new value
+    void SetTemp(int index, int tempMc) {
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                std::to_string(tempMc) + "\n",
+                mRoot + "/thermal_zone" + std::to_string(index) + "/temp"));
+    }
+
+    ThermalHeadroomMonitor::Config mConfig;
+    const steady_clock::time_point mStart = steady_clock::now();
+};
+
+TEST_F(ThermalHeadroomMonitorTest, DisabledWithoutZones) {
+    AddZone(0, "cpu-big", 95000, 90000);
+    mConfig.zoneTypes.clear();
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    EXPECT_FALSE(monitor.enabled());
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart), 1.0);
+}
+
+TEST_F(ThermalHeadroomMonitorTest, ScaleIsLinearInTheWindow) {
+    AddZone(0, "cpu-big", 50000, 90000);
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    ASSERT_TRUE(monitor.enabled());
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart), 1.0);
+
+    // 1.0 at the edge of the window, minScale at the throttling temperature
+    const int temps[] = {80000, 82500, 85000, 87500, 90000, 95000};
+    const double scales[] = {1.0, 0.875, 0.75, 0.625, 0.5, 0.5};
+    for (size_t i = 0; i < std::size(temps); i++) {
+        SetTemp(0, temps[i]);
+        EXPECT_DOUBLE_EQ(monitor.getScale(mStart + milliseconds(500) * (i + 1)), scales[i])
+                << temps[i];
+    }
+}
+
+TEST_F(ThermalHeadroomMonitorTest, ScaleStartsDroppingAtTheWindow) {
+    AddZone(0, "cpu-big", 80500, 90000);
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    // Just inside the window, the scale must not jump down to minScale
+    const double scale = monitor.getScale(mStart);
+    EXPECT_LT(scale, 1.0);
+    EXPECT_GT(scale, 0.95);
+}
+
+TEST_F(ThermalHeadroomMonitorTest, HottestZoneWinsAndOthersAreIgnored) {
+    AddZone(0, "cpu-big", 70000, 90000);
+    AddZone(1, "skin", 43000, 45000);
+    AddZone(2, "gpu", 89000, 90000);
+    mConfig.windowMc = 4000;
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart), 0.75);
+}
+
+TEST_F(ThermalHeadroomMonitorTest, ConfiguredThrottleOverridesTripPoint) {
+    AddZone(0, "cpu-big", 75000, 90000);
+    mConfig.throttleMc = 80000;
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart), 0.75);
+}
+
+TEST_F(ThermalHeadroomMonitorTest, PollsAtMostOncePerInterval) {
+    AddZone(0, "cpu-big", 70000, 90000);
+    ThermalHeadroomMonitor monitor(mRoot, mConfig);
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart), 1.0);
+    SetTemp(0, 90000);
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart + milliseconds(100)), 1.0);
+    EXPECT_DOUBLE_EQ(monitor.getScale(mStart + milliseconds(500)), 0.5);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "aidl/UclampBudget.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int kUclampMinHigh = 1024;
+
+UclampBudget::Request MakeRequest(int64_t sessionId, int64_t tgid, int requestedMin,
+                                  bool foreground = false) {
+    UclampBudget::Request request;
+    request.sessionId = sessionId;
+    request.tgid = tgid;
+    request.requestedMin = requestedMin;
+    request.foreground = foreground;
+    return request;
+}
+
+int Usage(const std::vector<UclampBudget::Request> &requests, UclampBudget::Mode mode,
+          bool (*pred)(const UclampBudget::Request &)) {
+    int usage = 0;
+    for (const auto &r : requests) {
+        if (pred(r)) {
+            usage = mode == UclampBudget::Mode::SUM ? usage + r.grantedMin
+                                                    : std::max(usage, r.grantedMin);
+        }
+    }
+    return usage;
+}
+
+}  // namespace
+
+TEST(UclampBudgetTest, DisabledGrantsRequests) {
+    UclampBudget budget(0, 0, UclampBudget::Mode::SUM);
+    EXPECT_FALSE(budget.enabled());
+    std::vector<UclampBudget::Request> requests{MakeRequest(1, 100, 1024),
+                                                MakeRequest(2, 100, 1024)};
+    budget.arbitrate(&requests);
+    EXPECT_EQ(requests[0].grantedMin, 1024);
+    EXPECT_EQ(requests[1].grantedMin, 1024);
+}
+
+TEST(UclampBudgetTest, TgidBudgetDegradesProportionally) {
+    UclampBudget budget(1024, 0, UclampBudget::Mode::SUM);
+    // Three sessions of one game all pinning mUclampMinHigh
+    std::vector<UclampBudget::Request> requests{
+            MakeRequest(1, 100, 1024), MakeRequest(2, 100, 512), MakeRequest(3, 100, 512),
+            MakeRequest(4, 200, 800)};
+    budget.arbitrate(&requests);
+    EXPECT_EQ(requests[0].grantedMin, 512);
+    EXPECT_EQ(requests[1].grantedMin, 256);
+    EXPECT_EQ(requests[2].grantedMin, 256);
+    // Other thread groups are not affected
+    EXPECT_EQ(requests[3].grantedMin, 800);
+}
+
+TEST(UclampBudgetTest, ForegroundIsServedFirst) {
+    UclampBudget budget(0, 1500, UclampBudget::Mode::SUM);
+    std::vector<UclampBudget::Request> requests{
+            MakeRequest(1, 100, 1024, true), MakeRequest(2, 200, 1024), MakeRequest(3, 300, 512)};
+    budget.arbitrate(&requests);
+    EXPECT_EQ(requests[0].grantedMin, 1024);
+    // 476 left for 1536 requested in the background
+    EXPECT_EQ(requests[1].grantedMin, 317);
+    EXPECT_EQ(requests[2].grantedMin, 158);
+}
+
+TEST(UclampBudgetTest, MaxModeCapsEachSession) {
+    UclampBudget budget(0, 600, UclampBudget::Mode::MAX);
+    std::vector<UclampBudget::Request> requests{MakeRequest(1, 100, 1024, true),
+                                                MakeRequest(2, 200, 300)};
+    budget.arbitrate(&requests);
+    EXPECT_EQ(requests[0].grantedMin, 600);
+    EXPECT_EQ(requests[1].grantedMin, 300);
+}
+
+// Many sessions from a few thread groups vote at random over a long run, the
+// budgets must hold on every round and the foreground keeps what the budgets
+// allow it no matter how much the background asks for.
+TEST(UclampBudgetTest, SimulationWithManyCompetingSessions) {
+    constexpr int kSessions = 48;
+    constexpr int kTgids = 6;
+    constexpr int kRounds = 2000;
+
+    for (auto mode : {UclampBudget::Mode::SUM, UclampBudget::Mode::MAX}) {
+        const int tgidBudget = mode == UclampBudget::Mode::SUM ? 1536 : 768;
+        const int globalBudget = mode == UclampBudget::Mode::SUM ? 3072 : 512;
+        UclampBudget budget(tgidBudget, globalBudget, mode);
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> boost(0, kUclampMinHigh);
+        std::uniform_int_distribution<int> tgid(0, kTgids - 1);
+        int64_t requestedTotal = 0;
+        int64_t grantedTotal = 0;
+
+        for (int round = 0; round < kRounds; round++) {
+            const int foregroundTgid = tgid(rng);
+            std::vector<UclampBudget::Request> requests;
+            for (int i = 0; i < kSessions; i++) {
+                const int64_t sessionTgid = i % kTgids;
+                requests.push_back(MakeRequest(i, sessionTgid, boost(rng),
+                                               sessionTgid == foregroundTgid));
+            }
+            budget.arbitrate(&requests);
+
+            for (const auto &r : requests) {
+                ASSERT_GE(r.grantedMin, 0);
+                ASSERT_LE(r.grantedMin, r.requestedMin);
+                requestedTotal += r.requestedMin;
+                grantedTotal += r.grantedMin;
+            }
+            for (int t = 0; t < kTgids; t++) {
+                int usage = 0;
+                for (const auto &r : requests) {
+                    if (r.tgid == t) {
+                        usage = mode == UclampBudget::Mode::SUM ? usage + r.grantedMin
+                                                                : std::max(usage, r.grantedMin);
+                    }
+                }
+                ASSERT_LE(usage, tgidBudget);
+            }
+            const int foreground =
+                    Usage(requests, mode, [](const auto &r) { return r.foreground; });
+            const int background =
+                    Usage(requests, mode, [](const auto &r) { return !r.foreground; });
+            if (mode == UclampBudget::Mode::SUM) {
+                ASSERT_LE(foreground + background, globalBudget);
+            } else {
+                ASSERT_LE(std::max(foreground, background), globalBudget);
+            }
+            // Background sessions never take from the foreground
+            int foregroundRequested = 0;
+            for (const auto &r : requests) {
+                if (r.foreground) {
+                    foregroundRequested = mode == UclampBudget::Mode::SUM
+                                                  ? foregroundRequested + r.requestedMin
+                                                  : std::max(foregroundRequested, r.requestedMin);
+                }
+            }
+            ASSERT_GE(foreground,
+                      std::min({foregroundRequested, tgidBudget, globalBudget}) - kSessions);
+        }
+        RecordProperty(mode == UclampBudget::Mode::SUM ? "granted_pct_sum" : "granted_pct_max",
+                       std::to_string(grantedTotal * 100 / requestedTotal));
+        EXPECT_LT(grantedTotal, requestedTotal);
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
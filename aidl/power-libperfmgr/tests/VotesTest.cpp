@@ -0,0 +1,230 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "aidl/AdpfTypes.h"
+#include "aidl/UClampVoter.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using TimePoint = std::chrono::steady_clock::time_point;
+
+namespace {
+
+// Virtual clock, all tests run on fixed time points
+const TimePoint kT0 = TimePoint(std::chrono::seconds(100));
+constexpr int kDefault = static_cast<int>(AdpfHintType::ADPF_VOTE_DEFAULT);
+constexpr int kLoadUp = static_cast<int>(AdpfHintType::ADPF_CPU_LOAD_UP);
+constexpr int kLoadReset = static_cast<int>(AdpfHintType::ADPF_CPU_LOAD_RESET);
+
+UclampRange RangeAt(const Votes &votes, TimePoint t) {
+    UclampRange range;
+    votes.getUclampRange(&range, t);
+    return range;
+}
+
+struct Update {
+    TimePoint time;
+    int voteId;
+    VoteRange vote;
+};
+
+// Wakeups of the previous scheme: a timeout per vote id, queued at the vote
+// deadline when the vote was inactive or its deadline moved earlier. A
+// timeout deactivates its vote if the deadline passed, otherwise it requeues
+// itself at the current deadline.
+uint64_t ReplayPerVoteTimeouts(const std::vector<Update> &updates) {
+    std::map<int, std::pair<bool, TimePoint>> votes;
+    std::multimap<TimePoint, int> queue;
+    uint64_t wakeups = 0;
+    auto runUntil = [&](TimePoint t) {
+        while (!queue.empty() && queue.begin()->first <= t) {
+            const auto [deadline, voteId] = *queue.begin();
+            queue.erase(queue.begin());
+            wakeups++;
+            auto &[active, timeout] = votes[voteId];
+            if (!active) {
+                continue;
+            }
+            if (timeout <= deadline) {
+                active = false;
+            } else {
+                queue.emplace(timeout, voteId);
+            }
+        }
+    };
+    for (const auto &u : updates) {
+        runUntil(u.time);
+        const TimePoint deadline = u.time + u.vote.durationNs();
+        auto &[active, timeout] = votes[u.voteId];
+        if (!active || deadline < timeout) {
+            queue.emplace(deadline, u.voteId);
+        }
+        active = true;
+        timeout = deadline;
+    }
+    runUntil(TimePoint::max());
+    return wakeups;
+}
+
+}  // namespace
+
+TEST(VotesTest, NoChangeWithoutVotes) {
+    Votes votes;
+    EXPECT_EQ(votes.nextChangeTime(kT0), TimePoint::max());
+}
+
+TEST(VotesTest, SingleVoteBoundaries) {
+    Votes votes;
+    votes.add(kDefault, VoteRange::makeMinRange(300, kT0 + milliseconds(10), milliseconds(20)));
+    // Before the vote starts
+    EXPECT_EQ(votes.nextChangeTime(kT0), kT0 + milliseconds(10));
+    // The end of the vote is still in range
+    EXPECT_EQ(votes.nextChangeTime(kT0 + milliseconds(10)),
+              kT0 + milliseconds(30) + nanoseconds(1));
+    EXPECT_EQ(RangeAt(votes, kT0 + milliseconds(30)).uclampMin, 300);
+    EXPECT_EQ(RangeAt(votes, kT0 + milliseconds(30) + nanoseconds(1)).uclampMin, kUclampMin);
+    EXPECT_EQ(votes.nextChangeTime(kT0 + milliseconds(31)), TimePoint::max());
+}
+
+TEST(VotesTest, HiddenVoteIsNotAChange) {
+    Votes votes;
+    votes.add(kDefault, VoteRange::makeMinRange(300, kT0, milliseconds(100)));
+    votes.add(kLoadUp, VoteRange::makeMinRange(800, kT0, milliseconds(50)));
+    // Weaker and ends before the stronger vote, never visible
+    votes.add(kLoadReset, VoteRange::makeMinRange(500, kT0 + milliseconds(10), milliseconds(20)));
+    const TimePoint loadUpEnd = kT0 + milliseconds(50) + nanoseconds(1);
+    EXPECT_EQ(votes.nextChangeTime(kT0), loadUpEnd);
+    EXPECT_EQ(votes.nextChangeTime(loadUpEnd), kT0 + milliseconds(100) + nanoseconds(1));
+}
+
+TEST(VotesTest, LastVoteEndingIsAChange) {
+    Votes votes;
+    votes.add(kLoadUp, VoteRange::makeMinRange(800, kT0, milliseconds(50)));
+    // Same range as no vote at all, but keeps the session from timing out
+    votes.add(kDefault, VoteRange::makeMinRange(kUclampMin, kT0, milliseconds(100)));
+    const TimePoint loadUpEnd = kT0 + milliseconds(50) + nanoseconds(1);
+    const TimePoint defaultEnd = kT0 + milliseconds(100) + nanoseconds(1);
+    EXPECT_EQ(votes.nextChangeTime(kT0), loadUpEnd);
+    EXPECT_EQ(votes.nextChangeTime(loadUpEnd), defaultEnd);
+    EXPECT_EQ(RangeAt(votes, loadUpEnd).uclampMin, RangeAt(votes, defaultEnd).uclampMin);
+    EXPECT_FALSE(votes.allTimedOut(defaultEnd - nanoseconds(1)));
+    EXPECT_TRUE(votes.allTimedOut(defaultEnd));
+    EXPECT_EQ(votes.nextChangeTime(defaultEnd), TimePoint::max());
+}
+
+TEST(VotesTest, InactiveVotesAreIgnored) {
+    Votes votes;
+    votes.add(kDefault, VoteRange::makeMinRange(300, kT0, milliseconds(100)));
+    votes.add(kLoadUp, VoteRange::makeMinRange(800, kT0, milliseconds(50)));
+    votes.setUseVote(kLoadUp, false);
+    EXPECT_EQ(votes.nextChangeTime(kT0), kT0 + milliseconds(100) + nanoseconds(1));
+}
+
+TEST(VotesTest, DeactivateExpired) {
+    Votes votes;
+    votes.add(kDefault, VoteRange::makeMinRange(300, kT0, milliseconds(100)));
+    votes.add(kLoadUp, VoteRange::makeMinRange(800, kT0, milliseconds(50)));
+    // A vote ending exactly at t is still in range
+    EXPECT_EQ(votes.deactivateExpired(kT0 + milliseconds(50)), 0);
+    EXPECT_EQ(votes.deactivateExpired(kT0 + milliseconds(60)), 1);
+    EXPECT_FALSE(votes.voteIsActive(kLoadUp));
+    EXPECT_TRUE(votes.voteIsActive(kDefault));
+    EXPECT_EQ(votes.deactivateExpired(kT0 + milliseconds(60)), 0);
+    EXPECT_EQ(RangeAt(votes, kT0 + milliseconds(60)).uclampMin, 300);
+}
+
+// Replays a game session on the virtual clock: a default vote refreshed on
+// every frame, periodic CPU_LOAD_UP boosts and short load resets. Each vote
+// update applies the range and queues a single evaluation at nextChangeTime,
+// the way PowerSessionManager does. The applied range must match the votes
+// at every sample, and the evaluations run are counted against the wakeups
+// of the previous per-vote timeout scheme replayed on the same updates.
+TEST(VotesTest, TimelineReplayMatchesVotes) {
+    constexpr auto kFrame = microseconds(16667);
+    constexpr auto kStale = kFrame * 4;
+    constexpr auto kSample = microseconds(250);
+    constexpr int kFrames = 3600;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> setPoint(100, 600);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    std::vector<Update> updates;
+    for (int f = 0; f < kFrames; f++) {
+        const TimePoint t = kT0 + kFrame * f;
+        // Frames are dropped now and then
+        if (percent(rng) < 95) {
+            updates.push_back({t, kDefault, VoteRange::makeMinRange(setPoint(rng), t, kStale)});
+        }
+        if (f % 30 == 0) {
+            updates.push_back(
+                    {t, kLoadUp, VoteRange::makeMinRange(kUclampMax, t, milliseconds(20))});
+        }
+        if (percent(rng) < 5) {
+            updates.push_back(
+                    {t, kLoadReset, VoteRange::makeMinRange(700, t, milliseconds(8))});
+        }
+    }
+
+    Votes votes;
+    UclampRange applied;
+    TimePoint pending = TimePoint::max();
+    uint64_t evaluationsRun = 0;
+    auto runEvaluations = [&](TimePoint until) {
+        while (pending <= until) {
+            votes.deactivateExpired(pending);
+            applied = RangeAt(votes, pending);
+            evaluationsRun++;
+            pending = votes.nextChangeTime(pending);
+        }
+    };
+
+    size_t next = 0;
+    const TimePoint end = kT0 + kFrame * kFrames + kStale * 2;
+    for (TimePoint t = kT0; t <= end; t += kSample) {
+        for (; next < updates.size() && updates[next].time <= t; next++) {
+            const auto &u = updates[next];
+            runEvaluations(u.time);
+            votes.add(u.voteId, u.vote);
+            applied = RangeAt(votes, u.time);
+            pending = votes.nextChangeTime(u.time);
+        }
+        runEvaluations(t);
+        const UclampRange expected = RangeAt(votes, t);
+        ASSERT_EQ(applied.uclampMin, expected.uclampMin);
+        ASSERT_EQ(applied.uclampMax, expected.uclampMax);
+    }
+    EXPECT_EQ(pending, TimePoint::max());
+
+    const uint64_t baselineWakeups = ReplayPerVoteTimeouts(updates);
+    RecordProperty("vote_updates", std::to_string(updates.size()));
+    RecordProperty("evaluations_run", std::to_string(evaluationsRun));
+    RecordProperty("baseline_wakeups", std::to_string(baselineWakeups));
+    // The previous scheme wakes up at every end of the refreshed default
+    // vote only to requeue itself, evaluations only run on actual changes
+    EXPECT_LT(evaluationsRun * 2, baselineWakeups);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl